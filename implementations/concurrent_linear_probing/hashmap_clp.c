@@ -0,0 +1,528 @@
+#include "hashmap_clp.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Deleted keys keep their slots until the next resize, so the load factor counts claimed slots
+// and is lower than in hashmap_lp
+#define MAX_LOAD_FACTOR 50
+#define INITIAL_SLOTS_COUNT 16
+#define MIGRATION_CHUNK 1024
+
+// Key 0 marks an empty slot, so its value is kept outside of the tables
+#define EMPTY_KEY 0
+
+// A slot whose value is MOVED has been copied into the next table, and everything about
+// its key is looked up there. Empty slots are sealed the same way, so no key is claimed
+// in a table that is being migrated.
+static const char moved_marker;
+#define MOVED ((void *) &moved_marker)
+
+struct slot {
+    _Atomic uint64_t key;
+    // NULL when the key was deleted or its insert is not finished yet
+    _Atomic(void *) value;
+};
+
+struct table {
+    uint64_t slots_count;
+    struct slot *slots;
+    atomic_size_t claimed_count;
+    // The table the entries are migrated to, set once
+    _Atomic(struct table *) next;
+    atomic_size_t chunks_claimed;
+    atomic_size_t chunks_migrated;
+    // Link in the list of replaced tables
+    struct table *retired_next;
+};
+
+// Replaced tables are freed by epochs. Every operation registers in the epoch it starts in, and the tables
+// replaced so far are set aside as pending when the epoch changes. The operations that start after the change
+// reach only the tables that replaced them, so the pending ones are freed once no operation of the previous
+// epoch is left. Only the parity of the epoch matters for that, since the epoch changes again only after that.
+struct hashmap_clp {
+    _Atomic(struct table *) table;
+    _Atomic(struct table *) retired;
+    _Atomic(struct table *) pending;
+    atomic_size_t epoch;
+    // Operations in flight by the parity of their epoch
+    atomic_size_t active[2];
+    atomic_flag reclaiming;
+    atomic_size_t entries_count;
+    _Atomic(void *) zero_key_value;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+enum lookup {
+    found,
+    absent,
+    // The key has to be looked up in the next table
+    forwarded
+};
+
+// Smallest power of two slots count that keeps entries_count entries under the load factor.
+static uint64_t slots_count_for(uint64_t entries_count) {
+    uint64_t slots_count = INITIAL_SLOTS_COUNT;
+    while (100 * entries_count >= MAX_LOAD_FACTOR * slots_count) {
+        slots_count *= 2;
+    }
+    return slots_count;
+}
+
+static inline uint64_t chunks_count(const struct table *const table) {
+    return (table->slots_count + MIGRATION_CHUNK - 1) / MIGRATION_CHUNK;
+}
+
+static struct table *table_new(const struct hashmap_clp *const self, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    struct table *table = allocator->alloc(allocator->context, sizeof(struct table));
+    if (table == NULL) {
+        return NULL;
+    }
+    // Zeroed memory is a table of empty slots
+    table->slots = allocator->alloc_zeroed(allocator->context, slots_count * sizeof(struct slot));
+    if (table->slots == NULL) {
+        allocator->free(allocator->context, table, sizeof(struct table));
+        return NULL;
+    }
+    table->slots_count = slots_count;
+    atomic_init(&table->claimed_count, 0);
+    atomic_init(&table->next, NULL);
+    atomic_init(&table->chunks_claimed, 0);
+    atomic_init(&table->chunks_migrated, 0);
+    table->retired_next = NULL;
+    return table;
+}
+
+static void table_free(const struct hashmap_clp *const self, struct table *table) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    allocator->free(allocator->context, table->slots, table->slots_count * sizeof(struct slot));
+    allocator->free(allocator->context, table, sizeof(struct table));
+}
+
+// Allocates the next table unless another thread did it first. Returns false when there is no memory.
+static bool start_resize(struct hashmap_clp *const self, struct table *table) {
+    if (atomic_load(&table->next) != NULL) {
+        return true;
+    }
+
+    // Sized for twice the live entries, so deleted keys are dropped and the migrated entries take
+    // at most a quarter of the new table, leaving room for the inserts that go there meanwhile
+    struct table *next = table_new(self, slots_count_for(2 * atomic_load(&self->entries_count)));
+    if (next == NULL) {
+        return false;
+    }
+    struct table *expected = NULL;
+    if (!atomic_compare_exchange_strong(&table->next, &expected, next)) {
+        table_free(self, next);
+    }
+    return true;
+}
+
+// Finds the slot of the key. A missing key gets a slot claimed for it if claim is set and the table
+// takes new keys, which it doesn't once a resize has started. Migration claims past the load factor,
+// because its entries must land somewhere.
+static enum lookup lookup(struct hashmap_clp *const self, struct table *table, uint64_t key, uint64_t hash,
+                          bool claim, bool migration, struct slot **slot) {
+    uint64_t mask = table->slots_count - 1;
+    for (uint64_t i = 0, index = hash & mask; i < table->slots_count; ++i, index = (index + 1) & mask) {
+        *slot = table->slots + index;
+        uint64_t slot_key = atomic_load(&(*slot)->key);
+        if (slot_key == key) {
+            return found;
+        }
+        if (slot_key != EMPTY_KEY) {
+            continue;
+        }
+
+        if (atomic_load(&(*slot)->value) == MOVED || atomic_load(&table->next) != NULL) {
+            return forwarded;
+        }
+        if (!claim) {
+            return absent;
+        }
+        if (!migration && 100 * atomic_load(&table->claimed_count) >= MAX_LOAD_FACTOR * table->slots_count) {
+            return start_resize(self, table) ? forwarded : absent;
+        }
+        if (atomic_compare_exchange_strong(&(*slot)->key, &slot_key, key)) {
+            atomic_fetch_add(&table->claimed_count, 1);
+            return found;
+        }
+        if (slot_key == key) {
+            return found;
+        }
+    }
+
+    // Every slot is claimed
+    if (atomic_load(&table->next) != NULL) {
+        return forwarded;
+    }
+    return claim && start_resize(self, table) ? forwarded : absent;
+}
+
+// Replaces the tables that are fully migrated with their next ones.
+static void promote(struct hashmap_clp *const self) {
+    struct table *table = atomic_load(&self->table);
+    while (atomic_load(&table->next) != NULL && atomic_load(&table->chunks_migrated) == chunks_count(table)) {
+        if (atomic_compare_exchange_strong(&self->table, &table, atomic_load(&table->next))) {
+            struct table *retired = atomic_load(&self->retired);
+            do {
+                table->retired_next = retired;
+            } while (!atomic_compare_exchange_weak(&self->retired, &retired, table));
+        }
+        table = atomic_load(&self->table);
+    }
+}
+
+// Registers an operation in the current epoch and returns the bits of the parities it counts under. If the epoch
+// changed before it was counted, the change might have missed it, so it counts under both parities instead of
+// trying again. The operation then holds back both pending lists until it is over, but never takes more than
+// two steps to register, which keeps finds wait-free.
+static unsigned enter(struct hashmap_clp *const self) {
+    size_t epoch = atomic_load(&self->epoch);
+    atomic_fetch_add(&self->active[epoch & 1], 1);
+    if (atomic_load(&self->epoch) == epoch) {
+        return 1u << (epoch & 1);
+    }
+    atomic_fetch_add(&self->active[(epoch + 1) & 1], 1);
+    return 3;
+}
+
+static void free_tables(const struct hashmap_clp *const self, struct table *table) {
+    while (table != NULL) {
+        struct table *next = table->retired_next;
+        table_free(self, table);
+        table = next;
+    }
+}
+
+// Frees the pending tables once no operation may still hold them, and sets the retired ones aside as pending
+// by changing the epoch. One thread reclaims at a time, the others go on without waiting.
+static void reclaim(struct hashmap_clp *const self) {
+    if (atomic_flag_test_and_set(&self->reclaiming)) {
+        return;
+    }
+    while (1) {
+        struct table *pending = atomic_load(&self->pending);
+        if (pending != NULL) {
+            if (atomic_load(&self->active[(atomic_load(&self->epoch) - 1) & 1]) != 0) {
+                break;
+            }
+            atomic_store(&self->pending, NULL);
+            free_tables(self, pending);
+        }
+        struct table *retired = atomic_exchange(&self->retired, NULL);
+        if (retired == NULL) {
+            break;
+        }
+        atomic_store(&self->pending, retired);
+        atomic_fetch_add(&self->epoch, 1);
+    }
+    atomic_flag_clear(&self->reclaiming);
+}
+
+// Ends an operation, which holds no table from now on.
+static void leave(struct hashmap_clp *const self, unsigned parities) {
+    for (size_t parity = 0; parity < 2; ++parity) {
+        if (parities & (1u << parity)) {
+            atomic_fetch_sub(&self->active[parity], 1);
+        }
+    }
+}
+
+// Ends an insert, delete or clear and reclaims the tables it can. Only writers replace tables, so finds leave
+// the reclaiming to them and never free anything.
+static void leave_writer(struct hashmap_clp *const self, unsigned parities) {
+    leave(self, parities);
+    if (atomic_load(&self->retired) != NULL || atomic_load(&self->pending) != NULL) {
+        reclaim(self);
+    }
+}
+
+// Puts a migrated value into the table chain starting from next. own is what the same migrator put
+// there before sealing failed, any other value was inserted by a writer racing with the migrated one.
+// A NULL value takes back the own copy of a value deleted before sealing.
+static void migrate_value(struct hashmap_clp *const self, struct table *next, uint64_t key, void *value,
+                          void *own) {
+    uint64_t hash = self->hasher(key);
+    while (1) {
+        struct slot *slot;
+        if (lookup(self, next, key, hash, true, true, &slot) == forwarded) {
+            next = atomic_load(&next->next);
+            continue;
+        }
+
+        void *previous = atomic_load(&slot->value);
+        while (previous != MOVED && (value != NULL || previous == own) &&
+               !atomic_compare_exchange_weak(&slot->value, &previous, value)) {}
+        if (previous == MOVED) {
+            next = atomic_load(&next->next);
+            continue;
+        }
+        // The racing writer and the one whose value is migrated were concurrent, and the migrated value wins
+        if (value != NULL && previous != NULL && previous != own) {
+            atomic_fetch_sub(&self->entries_count, 1);
+            if (self->value_free != NULL) {
+                self->value_free(previous);
+            }
+        }
+        return;
+    }
+}
+
+// The value is copied before the slot is sealed, so lookups that see MOVED find it in the next table.
+// Until then nobody looks for the key there, and if a writer replaces the value in between, the copy
+// is simply made again.
+static void migrate_slot(struct hashmap_clp *const self, struct table *table, struct slot *slot) {
+    void *own = NULL;
+    void *value = atomic_load(&slot->value);
+    while (1) {
+        if (value != NULL || own != NULL) {
+            migrate_value(self, atomic_load(&table->next), atomic_load(&slot->key), value, own);
+            own = value;
+        }
+        if (atomic_compare_exchange_strong(&slot->value, &value, MOVED)) {
+            return;
+        }
+    }
+}
+
+// Migrates one chunk of the table if any is left.
+static void help_migrate(struct hashmap_clp *const self, struct table *table) {
+    uint64_t chunk = atomic_fetch_add(&table->chunks_claimed, 1);
+    if (chunk >= chunks_count(table)) {
+        return;
+    }
+
+    uint64_t end = (chunk + 1) * MIGRATION_CHUNK < table->slots_count ? (chunk + 1) * MIGRATION_CHUNK
+                                                                      : table->slots_count;
+    for (uint64_t i = chunk * MIGRATION_CHUNK; i < end; ++i) {
+        migrate_slot(self, table, table->slots + i);
+    }
+    if (atomic_fetch_add(&table->chunks_migrated, 1) + 1 == chunks_count(table)) {
+        promote(self);
+    }
+}
+
+struct hashmap_clp *hashmap_clp_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_clp_new_with_options(hasher, value_free, (struct hashmap_clp_options) {0});
+}
+
+struct hashmap_clp *hashmap_clp_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                  size_t capacity) {
+    return hashmap_clp_new_with_options(hasher, value_free, (struct hashmap_clp_options) {.capacity = capacity});
+}
+
+struct hashmap_clp *hashmap_clp_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                 struct hashmap_clp_options options) {
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_clp *self = allocator->alloc(allocator->context, sizeof(struct hashmap_clp));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    struct table *table = table_new(self, slots_count_for(options.capacity));
+    if (table == NULL) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_clp));
+        return NULL;
+    }
+    atomic_init(&self->table, table);
+    atomic_init(&self->retired, NULL);
+    atomic_init(&self->pending, NULL);
+    atomic_init(&self->epoch, 0);
+    atomic_init(&self->active[0], 0);
+    atomic_init(&self->active[1], 0);
+    atomic_flag_clear(&self->reclaiming);
+    atomic_init(&self->entries_count, 0);
+    atomic_init(&self->zero_key_value, NULL);
+    self->hasher = hasher;
+    self->value_free = value_free;
+
+    return self;
+}
+
+bool hashmap_clp_insert(struct hashmap_clp *const self, uint64_t key, void *value) {
+    if (self == NULL || value == NULL) {
+        return false;
+    }
+
+    void *previous;
+    if (key == EMPTY_KEY) {
+        previous = atomic_exchange(&self->zero_key_value, value);
+    } else {
+        uint64_t hash = self->hasher(key);
+        unsigned parities = enter(self);
+        struct table *table = atomic_load(&self->table);
+        while (1) {
+            if (atomic_load(&table->next) != NULL) {
+                help_migrate(self, table);
+            }
+            struct slot *slot;
+            enum lookup result = lookup(self, table, key, hash, true, false, &slot);
+            if (result == absent) {
+                // No memory for the next table
+                leave_writer(self, parities);
+                return false;
+            }
+            if (result == found) {
+                previous = atomic_load(&slot->value);
+                while (previous != MOVED && !atomic_compare_exchange_weak(&slot->value, &previous, value)) {}
+                if (previous != MOVED) {
+                    break;
+                }
+            }
+            table = atomic_load(&table->next);
+        }
+        leave_writer(self, parities);
+    }
+
+    if (previous == NULL) {
+        atomic_fetch_add(&self->entries_count, 1);
+    } else if (previous != value && self->value_free != NULL) {
+        self->value_free(previous);
+    }
+    return true;
+}
+
+void *hashmap_clp_find(struct hashmap_clp *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+    if (key == EMPTY_KEY) {
+        return atomic_load(&self->zero_key_value);
+    }
+
+    uint64_t hash = self->hasher(key);
+    unsigned parities = enter(self);
+    void *value = NULL;
+    struct table *table = atomic_load(&self->table);
+    while (table != NULL) {
+        uint64_t mask = table->slots_count - 1;
+        bool look_further = true;
+        for (uint64_t i = 0, index = hash & mask; i < table->slots_count; ++i, index = (index + 1) & mask) {
+            struct slot *slot = table->slots + index;
+            uint64_t slot_key = atomic_load(&slot->key);
+            if (slot_key == key) {
+                value = atomic_load(&slot->value);
+                look_further = value == MOVED;
+                break;
+            }
+            // Keys missing from a table that is being migrated are inserted right into the next one
+            if (slot_key == EMPTY_KEY) {
+                look_further = atomic_load(&slot->value) == MOVED || atomic_load(&table->next) != NULL;
+                break;
+            }
+        }
+        if (!look_further) {
+            break;
+        }
+        // The key is sealed in this table, or may be in the next one
+        value = NULL;
+        table = atomic_load(&table->next);
+    }
+    leave(self, parities);
+    return value;
+}
+
+bool hashmap_clp_delete(struct hashmap_clp *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    void *previous;
+    if (key == EMPTY_KEY) {
+        previous = atomic_exchange(&self->zero_key_value, NULL);
+    } else {
+        uint64_t hash = self->hasher(key);
+        unsigned parities = enter(self);
+        struct table *table = atomic_load(&self->table);
+        while (table != NULL) {
+            if (atomic_load(&table->next) != NULL) {
+                help_migrate(self, table);
+            }
+            struct slot *slot;
+            enum lookup result = lookup(self, table, key, hash, false, false, &slot);
+            if (result == absent) {
+                leave_writer(self, parities);
+                return false;
+            }
+            if (result == found) {
+                previous = atomic_load(&slot->value);
+                while (previous != MOVED && previous != NULL &&
+                       !atomic_compare_exchange_weak(&slot->value, &previous, NULL)) {}
+                if (previous != MOVED) {
+                    break;
+                }
+            }
+            table = atomic_load(&table->next);
+        }
+        leave_writer(self, parities);
+        if (table == NULL) {
+            return false;
+        }
+    }
+
+    if (previous == NULL) {
+        return false;
+    }
+    atomic_fetch_sub(&self->entries_count, 1);
+    if (self->value_free != NULL) {
+        self->value_free(previous);
+    }
+    return true;
+}
+
+size_t hashmap_clp_size(struct hashmap_clp *const self) {
+    if (self == NULL) {
+        return 0;
+    }
+
+    return atomic_load(&self->entries_count);
+}
+
+void hashmap_clp_clear(struct hashmap_clp *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    hashmap_clp_delete(self, EMPTY_KEY);
+    unsigned parities = enter(self);
+    for (struct table *table = atomic_load(&self->table); table != NULL; table = atomic_load(&table->next)) {
+        for (uint64_t i = 0; i < table->slots_count; ++i) {
+            struct slot *slot = table->slots + i;
+            void *value = atomic_load(&slot->value);
+            while (value != MOVED && value != NULL && !atomic_compare_exchange_weak(&slot->value, &value, NULL)) {}
+            if (value == MOVED || value == NULL) {
+                continue;
+            }
+            atomic_fetch_sub(&self->entries_count, 1);
+            if (self->value_free != NULL) {
+                self->value_free(value);
+            }
+        }
+    }
+    leave_writer(self, parities);
+}
+
+void hashmap_clp_free(struct hashmap_clp *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    hashmap_clp_clear(self);
+    struct table *table = atomic_load(&self->table);
+    while (table != NULL) {
+        struct table *next = atomic_load(&table->next);
+        table_free(self, table);
+        table = next;
+    }
+    free_tables(self, atomic_load(&self->retired));
+    free_tables(self, atomic_load(&self->pending));
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_clp));
+}
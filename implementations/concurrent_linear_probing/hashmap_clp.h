@@ -0,0 +1,54 @@
+#ifndef HASHMAPS_HASHMAP_CLP_H
+#define HASHMAPS_HASHMAP_CLP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+// Lock-free linear probing map that can be shared between threads. Keys and values are claimed
+// and replaced with CAS, finds are wait-free, and growth is cooperative: every insert and delete
+// that finds a resize going on moves a chunk of the old slots before doing its own work.
+//
+// A replaced table is freed once every operation that started before the replacement is over,
+// since finds may still be probing it until then. Inserts, deletes and clear free such tables,
+// finds never do.
+struct hashmap_clp;
+
+struct hashmap_clp_options {
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Where the slots and the map itself are allocated. NULL means malloc and free.
+    // The allocator is called from any thread without locks, so it must be thread-safe.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map, and inserts return false when there is no memory to grow it.
+struct hashmap_clp *hashmap_clp_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
+
+struct hashmap_clp *hashmap_clp_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                  size_t capacity);
+
+struct hashmap_clp *hashmap_clp_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                 struct hashmap_clp_options options);
+
+// NULL marks a missing value, so it can't be inserted and false is returned for it.
+bool hashmap_clp_insert(struct hashmap_clp *self, uint64_t key, void *value);
+
+// The map doesn't guard the returned value, so if value_free is set, another thread that replaces
+// or deletes the key may free it while it is in use.
+void *hashmap_clp_find(struct hashmap_clp *self, uint64_t key);
+
+bool hashmap_clp_delete(struct hashmap_clp *self, uint64_t key);
+
+// Entries count at some moment during the call.
+size_t hashmap_clp_size(struct hashmap_clp *self);
+
+// Deletes every entry one by one, so entries inserted while it runs may stay in the map.
+void hashmap_clp_clear(struct hashmap_clp *self);
+
+// Must not run concurrently with anything else on the map.
+void hashmap_clp_free(struct hashmap_clp *self);
+
+#endif // HASHMAPS_HASHMAP_CLP_H
@@ -0,0 +1,284 @@
+#include "../minunit.h"
+#include "hashmap_clp.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREADS_COUNT 8
+#define KEYS_PER_THREAD 20000
+#define CHURN_LIVE_KEYS 1000
+#define CHURN_OPS 1000000
+
+struct slot {
+    _Atomic uint64_t key;
+    _Atomic(void *) value;
+};
+
+struct table {
+    uint64_t slots_count;
+    struct slot *slots;
+    atomic_size_t claimed_count;
+    _Atomic(struct table *) next;
+    atomic_size_t chunks_claimed;
+    atomic_size_t chunks_migrated;
+    struct table *retired_next;
+};
+
+struct hashmap_clp {
+    _Atomic(struct table *) table;
+    _Atomic(struct table *) retired;
+    _Atomic(struct table *) pending;
+    atomic_size_t epoch;
+    atomic_size_t active[2];
+    atomic_flag reclaiming;
+    atomic_size_t entries_count;
+    _Atomic(void *) zero_key_value;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+static atomic_size_t allocated_bytes;
+static atomic_size_t peak_allocated_bytes;
+
+static void count_allocation(size_t size) {
+    size_t allocated = atomic_fetch_add(&allocated_bytes, size) + size;
+    size_t peak = atomic_load(&peak_allocated_bytes);
+    while (peak < allocated && !atomic_compare_exchange_weak(&peak_allocated_bytes, &peak, allocated)) {}
+}
+
+static void *counting_alloc(void *context, size_t size) {
+    count_allocation(size);
+    return malloc(size);
+}
+
+static void *counting_alloc_zeroed(void *context, size_t size) {
+    count_allocation(size);
+    return calloc(1, size);
+}
+
+static void *counting_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    count_allocation(new_size);
+    atomic_fetch_sub(&allocated_bytes, old_size);
+    return realloc(ptr, new_size);
+}
+
+static void counting_free(void *context, void *ptr, size_t size) {
+    atomic_fetch_sub(&allocated_bytes, size);
+    free(ptr);
+}
+
+static const struct hashmap_allocator counting_allocator = {
+        .alloc = counting_alloc,
+        .alloc_zeroed = counting_alloc_zeroed,
+        .realloc = counting_realloc,
+        .free = counting_free,
+};
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_clp *map = hashmap_clp_new(hasher, free);
+    mu_assert("error, map must be constructed", map != NULL);
+    mu_assert("error, new map must be empty", hashmap_clp_size(map) == 0);
+    mu_assert("error, new map must have the initial slots count", map->table->slots_count == 16);
+    hashmap_clp_free(map);
+
+    map = hashmap_clp_new_with_capacity(hasher, free, 1000);
+    mu_assert("error, capacity must fit under the load factor", map->table->slots_count == 2048);
+    hashmap_clp_free(map);
+
+    return 0;
+}
+
+static char *test_inserts_finds_deletes() {
+    struct hashmap_clp *map = hashmap_clp_new(hasher, free);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, insert must succeed", hashmap_clp_insert(map, i, make_ptr(i)));
+    }
+    mu_assert("error, entries count must be equal to 1000", hashmap_clp_size(map) == 1000);
+    mu_assert("error, map must have grown", map->table->slots_count >= 2048);
+    mu_assert("error, replaced tables must be freed when nothing runs", map->retired == NULL && map->pending == NULL);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t *value = hashmap_clp_find(map, i);
+        mu_assert("error, inserted values must be found", value != NULL && *value == i);
+    }
+    mu_assert("error, missing key mustn't be found", hashmap_clp_find(map, 1000) == NULL);
+
+    mu_assert("error, NULL value mustn't be inserted", !hashmap_clp_insert(map, 1000, NULL));
+    hashmap_clp_insert(map, 1, make_ptr(100));
+    mu_assert("error, insert must replace the value", *(uint64_t *) hashmap_clp_find(map, 1) == 100);
+    hashmap_clp_insert(map, 0, make_ptr(100));
+    mu_assert("error, insert must replace the value of key 0", *(uint64_t *) hashmap_clp_find(map, 0) == 100);
+    mu_assert("error, replacing mustn't change entries count", hashmap_clp_size(map) == 1000);
+
+    for (uint64_t i = 0; i < 500; ++i) {
+        mu_assert("error, delete must find the key", hashmap_clp_delete(map, i));
+    }
+    mu_assert("error, deleted key mustn't be deleted twice", !hashmap_clp_delete(map, 1));
+    mu_assert("error, deleted key 0 mustn't be deleted twice", !hashmap_clp_delete(map, 0));
+    mu_assert("error, entries count must be equal to 500", hashmap_clp_size(map) == 500);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, only the rest of the keys must be found", (hashmap_clp_find(map, i) != NULL) == (i >= 500));
+    }
+
+    // Reinserting deleted keys reuses their slots
+    for (uint64_t i = 1; i < 500; ++i) {
+        hashmap_clp_insert(map, i, make_ptr(i));
+    }
+    mu_assert("error, entries count must be equal to 999", hashmap_clp_size(map) == 999);
+
+    hashmap_clp_clear(map);
+    mu_assert("error, map must be empty after clear", hashmap_clp_size(map) == 0);
+    mu_assert("error, keys mustn't be found after clear", hashmap_clp_find(map, 600) == NULL);
+    hashmap_clp_insert(map, 600, make_ptr(600));
+    mu_assert("error, map must take keys after clear", *(uint64_t *) hashmap_clp_find(map, 600) == 600);
+    hashmap_clp_free(map);
+
+    return 0;
+}
+
+struct worker {
+    struct hashmap_clp *map;
+    uint64_t first_key;
+    size_t misses;
+};
+
+static void *insert_and_delete(void *arg) {
+    struct worker *worker = arg;
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        hashmap_clp_insert(worker->map, worker->first_key + i, (void *) (worker->first_key + i));
+    }
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        if (hashmap_clp_find(worker->map, worker->first_key + i) != (void *) (worker->first_key + i)) {
+            worker->misses++;
+        }
+    }
+    // Every other key is deleted and then replaced while the other threads still insert and resize
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; i += 2) {
+        if (!hashmap_clp_delete(worker->map, worker->first_key + i)) {
+            worker->misses++;
+        }
+        hashmap_clp_insert(worker->map, worker->first_key + i + 1, (void *) (worker->first_key + i + 1));
+    }
+    return NULL;
+}
+
+static char *test_concurrent_access() {
+    struct hashmap_clp *map = hashmap_clp_new(hasher, leak);
+    pthread_t threads[THREADS_COUNT];
+    struct worker workers[THREADS_COUNT];
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        workers[i] = (struct worker) {.map = map, .first_key = 1 + i * KEYS_PER_THREAD, .misses = 0};
+        pthread_create(threads + i, NULL, insert_and_delete, workers + i);
+    }
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+        mu_assert("error, every thread must find its keys", workers[i].misses == 0);
+    }
+
+    mu_assert("error, entries count must be equal to the keys left",
+              hashmap_clp_size(map) == THREADS_COUNT * KEYS_PER_THREAD / 2);
+    for (uint64_t key = 1; key <= THREADS_COUNT * KEYS_PER_THREAD; ++key) {
+        bool deleted = (key - 1) % KEYS_PER_THREAD % 2 == 0;
+        mu_assert("error, only the keys that were not deleted must be found",
+                  hashmap_clp_find(map, key) == (deleted ? NULL : (void *) key));
+    }
+    hashmap_clp_free(map);
+
+    return 0;
+}
+
+// New keys replace deleted ones all the time, so the claimed slots fill every table up and the map keeps
+// resizing into tables of the same size, which must be freed as it goes
+static void *churn(void *arg) {
+    struct worker *worker = arg;
+    for (uint64_t i = 0; i < CHURN_OPS; ++i) {
+        hashmap_clp_insert(worker->map, worker->first_key + i + CHURN_LIVE_KEYS, (void *) 1);
+        if (!hashmap_clp_delete(worker->map, worker->first_key + i)) {
+            worker->misses++;
+        }
+        hashmap_clp_find(worker->map, worker->first_key + i / 2);
+    }
+    return NULL;
+}
+
+static char *test_churn_frees_tables() {
+    atomic_store(&allocated_bytes, 0);
+    atomic_store(&peak_allocated_bytes, 0);
+    struct hashmap_clp *map = hashmap_clp_new_with_options(hasher, leak,
+                                                           (struct hashmap_clp_options) {.allocator = &counting_allocator});
+    struct worker worker = {.map = map, .first_key = 1, .misses = 0};
+    for (uint64_t i = 0; i < CHURN_LIVE_KEYS; ++i) {
+        hashmap_clp_insert(map, worker.first_key + i, (void *) 1);
+    }
+    churn(&worker);
+    mu_assert("error, churn must delete every key it inserted", worker.misses == 0);
+    mu_assert("error, entries count must stay the same", hashmap_clp_size(map) == CHURN_LIVE_KEYS);
+    // Two tables of 4096 slots at once, and the map itself
+    mu_assert("error, replaced tables must be freed", atomic_load(&peak_allocated_bytes) < 256 * 1024);
+
+    // Under threads the tables are freed once the operations that could probe them are over
+    pthread_t threads[THREADS_COUNT];
+    struct worker workers[THREADS_COUNT];
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        workers[i] = (struct worker) {.map = map, .first_key = (i + 1) * 2 * CHURN_OPS, .misses = 0};
+        for (uint64_t j = 0; j < CHURN_LIVE_KEYS; ++j) {
+            hashmap_clp_insert(map, workers[i].first_key + j, (void *) 1);
+        }
+    }
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        pthread_create(threads + i, NULL, churn, workers + i);
+    }
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+        mu_assert("error, every thread must delete the keys it inserted", workers[i].misses == 0);
+    }
+    hashmap_clp_find(map, 1);
+    mu_assert("error, replaced tables must be freed after the threads are done",
+              atomic_load(&allocated_bytes) < 4 * 1024 * 1024);
+    hashmap_clp_free(map);
+    mu_assert("error, free must give back everything", atomic_load(&allocated_bytes) == 0);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts_finds_deletes);
+    mu_run_test(test_concurrent_access);
+    mu_run_test(test_churn_frees_tables);
+    return 0;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
@@ -0,0 +1,344 @@
+#include "hashmap_csc.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MAX_LOAD_FACTOR 3
+#define INITIAL_BUCKETS_COUNT 10
+#define STRIPES_COUNT 64
+#define CACHE_LINE_SIZE 64
+
+// Each lock takes a cache line of its own, so threads working on neighbouring stripes don't
+// bounce the same line between cores.
+struct stripe {
+    pthread_rwlock_t lock;
+    unsigned char padding[CACHE_LINE_SIZE - sizeof(pthread_rwlock_t) % CACHE_LINE_SIZE];
+};
+
+struct hashmap_csc {
+    atomic_size_t entries_count;
+    // Changed only under every stripe lock. Operations read it before taking a stripe
+    // and check it again once the stripe is taken.
+    _Atomic uint32_t buckets_count;
+    struct bucket *buckets;
+    struct stripe *stripes;
+    // What was allocated for the stripes before aligning them to a cache line
+    void *stripes_memory;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+struct bucket {
+    uint32_t size;
+    uint32_t capacity;
+    struct entry *buffer;
+};
+
+struct entry {
+    uint64_t hash;
+    uint64_t key;
+    void *value;
+};
+
+// Returns the place for a new entry at the end of the bucket, or NULL if the bucket can't grow.
+static struct entry *bucket_push(const struct hashmap_csc *const self, struct bucket *bucket) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    if (bucket->size == bucket->capacity) {
+        uint32_t capacity = bucket->capacity == 0 ? 1 : 2 * bucket->capacity;
+        struct entry *buffer = allocator->realloc(allocator->context, bucket->buffer,
+                                                  bucket->capacity * sizeof(struct entry),
+                                                  capacity * sizeof(struct entry));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        bucket->buffer = buffer;
+        bucket->capacity = capacity;
+    }
+
+    return bucket->buffer + bucket->size++;
+}
+
+static struct entry *bucket_find(const struct bucket *const bucket, uint64_t key) {
+    for (size_t i = 0; i < bucket->size; ++i) {
+        if (bucket->buffer[i].key == key) {
+            return bucket->buffer + i;
+        }
+    }
+    return NULL;
+}
+
+// Smallest buckets count that keeps entries_count entries under the load factor,
+// but not less than the initial one.
+static uint32_t buckets_count_for(uint64_t entries_count) {
+    uint64_t buckets_count = entries_count / MAX_LOAD_FACTOR + 1;
+    return buckets_count < INITIAL_BUCKETS_COUNT ? INITIAL_BUCKETS_COUNT : buckets_count;
+}
+
+static void buckets_free(const struct hashmap_csc *const self, struct bucket *buckets, uint32_t buckets_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    for (size_t i = 0; i < buckets_count; ++i) {
+        allocator->free(allocator->context, buckets[i].buffer, buckets[i].capacity * sizeof(struct entry));
+    }
+    allocator->free(allocator->context, buckets, buckets_count * sizeof(struct bucket));
+}
+
+static void release_values(struct hashmap_csc *const self) {
+    if (self->value_free == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < self->buckets_count; ++i) {
+        struct bucket *bucket = self->buckets + i;
+        for (size_t j = 0; j < bucket->size; ++j) {
+            self->value_free(bucket->buffer[j].value);
+        }
+    }
+}
+
+static void lock_all(struct hashmap_csc *const self) {
+    // Every other operation holds at most one stripe, so taking them in order can't deadlock
+    for (size_t i = 0; i < STRIPES_COUNT; ++i) {
+        pthread_rwlock_wrlock(&self->stripes[i].lock);
+    }
+}
+
+static void unlock_all(struct hashmap_csc *const self) {
+    for (size_t i = 0; i < STRIPES_COUNT; ++i) {
+        pthread_rwlock_unlock(&self->stripes[i].lock);
+    }
+}
+
+// Takes the stripe of the bucket the hash belongs to and returns the bucket. If a resize
+// slipped in between reading buckets_count and taking the stripe, it starts over.
+static struct bucket *lock_bucket(struct hashmap_csc *const self, uint64_t hash, bool write,
+                                  struct stripe **stripe) {
+    while (1) {
+        uint32_t buckets_count = atomic_load_explicit(&self->buckets_count, memory_order_relaxed);
+        size_t index = hash % buckets_count;
+        *stripe = self->stripes + index % STRIPES_COUNT;
+        if (write) {
+            pthread_rwlock_wrlock(&(*stripe)->lock);
+        } else {
+            pthread_rwlock_rdlock(&(*stripe)->lock);
+        }
+        if (atomic_load_explicit(&self->buckets_count, memory_order_relaxed) == buckets_count) {
+            return self->buckets + index;
+        }
+        pthread_rwlock_unlock(&(*stripe)->lock);
+    }
+}
+
+// Moves the entries to a new array of buckets, each sized exactly for its entries. Everything is
+// allocated before the first entry moves, so the map stays as it was when there is no memory.
+// Must be called under every stripe lock.
+static bool resize_map(struct hashmap_csc *const self, uint32_t new_buckets_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    struct bucket *new_buckets = allocator->alloc_zeroed(allocator->context, new_buckets_count * sizeof(struct bucket));
+    if (new_buckets == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < self->buckets_count; ++i) {
+        struct bucket *bucket = self->buckets + i;
+        for (size_t j = 0; j < bucket->size; ++j) {
+            new_buckets[bucket->buffer[j].hash % new_buckets_count].capacity++;
+        }
+    }
+    for (size_t i = 0; i < new_buckets_count; ++i) {
+        struct bucket *bucket = new_buckets + i;
+        if (bucket->capacity == 0) {
+            continue;
+        }
+        bucket->buffer = allocator->alloc(allocator->context, bucket->capacity * sizeof(struct entry));
+        if (bucket->buffer == NULL) {
+            buckets_free(self, new_buckets, new_buckets_count);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < self->buckets_count; ++i) {
+        struct bucket *bucket = self->buckets + i;
+        for (size_t j = 0; j < bucket->size; ++j) {
+            struct bucket *new_bucket = new_buckets + bucket->buffer[j].hash % new_buckets_count;
+            new_bucket->buffer[new_bucket->size++] = bucket->buffer[j];
+        }
+    }
+
+    buckets_free(self, self->buckets, self->buckets_count);
+    self->buckets = new_buckets;
+    atomic_store_explicit(&self->buckets_count, new_buckets_count, memory_order_relaxed);
+    return true;
+}
+
+static void resize_if_load_factor_exceeded(struct hashmap_csc *const self) {
+    lock_all(self);
+    // Other inserts may have hit the load factor at the same time, only the first one resizes
+    uint32_t buckets_count = self->buckets_count;
+    if (atomic_load_explicit(&self->entries_count, memory_order_relaxed) >= MAX_LOAD_FACTOR * buckets_count) {
+        // A map that can't grow keeps chaining into longer buckets
+        resize_map(self, 2 * buckets_count);
+    }
+    unlock_all(self);
+}
+
+struct hashmap_csc *hashmap_csc_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_csc_new_with_options(hasher, value_free, (struct hashmap_csc_options) {0});
+}
+
+struct hashmap_csc *hashmap_csc_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                  size_t capacity) {
+    return hashmap_csc_new_with_options(hasher, value_free, (struct hashmap_csc_options) {.capacity = capacity});
+}
+
+struct hashmap_csc *hashmap_csc_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                 struct hashmap_csc_options options) {
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_csc *self = allocator->alloc(allocator->context, sizeof(struct hashmap_csc));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    uint32_t buckets_count = buckets_count_for(options.capacity);
+    self->buckets = allocator->alloc_zeroed(allocator->context, buckets_count * sizeof(struct bucket));
+    self->stripes_memory =
+            allocator->alloc(allocator->context, STRIPES_COUNT * sizeof(struct stripe) + CACHE_LINE_SIZE);
+    if (self->buckets == NULL || self->stripes_memory == NULL) {
+        allocator->free(allocator->context, self->buckets, buckets_count * sizeof(struct bucket));
+        allocator->free(allocator->context, self->stripes_memory,
+                        STRIPES_COUNT * sizeof(struct stripe) + CACHE_LINE_SIZE);
+        allocator->free(allocator->context, self, sizeof(struct hashmap_csc));
+        return NULL;
+    }
+    self->stripes = (struct stripe *) (((uintptr_t) self->stripes_memory + CACHE_LINE_SIZE - 1) &
+                                       ~(uintptr_t) (CACHE_LINE_SIZE - 1));
+    for (size_t i = 0; i < STRIPES_COUNT; ++i) {
+        pthread_rwlock_init(&self->stripes[i].lock, NULL);
+    }
+    atomic_init(&self->entries_count, 0);
+    atomic_init(&self->buckets_count, buckets_count);
+    self->hasher = hasher;
+    self->value_free = value_free;
+
+    return self;
+}
+
+bool hashmap_csc_insert(struct hashmap_csc *const self, uint64_t key, void *value) {
+    if (self == NULL) {
+        return false;
+    }
+
+    uint64_t hash = self->hasher(key);
+    struct stripe *stripe;
+    struct bucket *bucket = lock_bucket(self, hash, true, &stripe);
+    struct entry *entry = bucket_find(bucket, key);
+    if (entry != NULL) {
+        if (self->value_free != NULL) {
+            self->value_free(entry->value);
+        }
+        entry->value = value;
+        pthread_rwlock_unlock(&stripe->lock);
+        return true;
+    }
+
+    entry = bucket_push(self, bucket);
+    if (entry == NULL) {
+        pthread_rwlock_unlock(&stripe->lock);
+        return false;
+    }
+    entry->hash = hash;
+    entry->key = key;
+    entry->value = value;
+    pthread_rwlock_unlock(&stripe->lock);
+
+    size_t entries_count = atomic_fetch_add_explicit(&self->entries_count, 1, memory_order_relaxed) + 1;
+    if (entries_count >= MAX_LOAD_FACTOR * atomic_load_explicit(&self->buckets_count, memory_order_relaxed)) {
+        resize_if_load_factor_exceeded(self);
+    }
+    return true;
+}
+
+void *hashmap_csc_find(struct hashmap_csc *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    struct stripe *stripe;
+    struct bucket *bucket = lock_bucket(self, self->hasher(key), false, &stripe);
+    struct entry *entry = bucket_find(bucket, key);
+    void *value = entry == NULL ? NULL : entry->value;
+    pthread_rwlock_unlock(&stripe->lock);
+    return value;
+}
+
+bool hashmap_csc_delete(struct hashmap_csc *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    struct stripe *stripe;
+    struct bucket *bucket = lock_bucket(self, self->hasher(key), true, &stripe);
+    struct entry *entry = bucket_find(bucket, key);
+    if (entry == NULL) {
+        pthread_rwlock_unlock(&stripe->lock);
+        return false;
+    }
+
+    if (self->value_free != NULL) {
+        self->value_free(entry->value);
+    }
+    *entry = bucket->buffer[--bucket->size];
+    pthread_rwlock_unlock(&stripe->lock);
+    atomic_fetch_sub_explicit(&self->entries_count, 1, memory_order_relaxed);
+    return true;
+}
+
+bool hashmap_csc_reserve(struct hashmap_csc *const self, size_t capacity) {
+    if (self == NULL) {
+        return false;
+    }
+
+    lock_all(self);
+    uint32_t buckets_count = buckets_count_for(capacity);
+    bool reserved = buckets_count <= self->buckets_count || resize_map(self, buckets_count);
+    unlock_all(self);
+    return reserved;
+}
+
+size_t hashmap_csc_size(struct hashmap_csc *const self) {
+    if (self == NULL) {
+        return 0;
+    }
+
+    return atomic_load_explicit(&self->entries_count, memory_order_relaxed);
+}
+
+void hashmap_csc_clear(struct hashmap_csc *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    lock_all(self);
+    release_values(self);
+    for (size_t i = 0; i < self->buckets_count; ++i) {
+        self->buckets[i].size = 0;
+    }
+    atomic_store_explicit(&self->entries_count, 0, memory_order_relaxed);
+    unlock_all(self);
+}
+
+void hashmap_csc_free(struct hashmap_csc *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    release_values(self);
+    buckets_free(self, self->buckets, self->buckets_count);
+    for (size_t i = 0; i < STRIPES_COUNT; ++i) {
+        pthread_rwlock_destroy(&self->stripes[i].lock);
+    }
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self->stripes_memory, STRIPES_COUNT * sizeof(struct stripe) + CACHE_LINE_SIZE);
+    allocator.free(allocator.context, self, sizeof(struct hashmap_csc));
+}
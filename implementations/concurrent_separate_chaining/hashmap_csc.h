@@ -0,0 +1,52 @@
+#ifndef HASHMAPS_HASHMAP_CSC_H
+#define HASHMAPS_HASHMAP_CSC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+// Separate chaining map that can be shared between threads. Buckets are guarded by a fixed array
+// of reader-writer locks, bucket i by lock i % stripes count, so operations on different stripes
+// run in parallel and finds on the same stripe don't block each other. A resize takes every lock.
+struct hashmap_csc;
+
+struct hashmap_csc_options {
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Where the buckets and the map itself are allocated. NULL means malloc and free.
+    // The allocator is called under the map locks, so it must be thread-safe.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map, and inserts return false when a bucket can't grow.
+struct hashmap_csc *hashmap_csc_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
+
+struct hashmap_csc *hashmap_csc_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                  size_t capacity);
+
+struct hashmap_csc *hashmap_csc_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                 struct hashmap_csc_options options);
+
+bool hashmap_csc_insert(struct hashmap_csc *self, uint64_t key, void *value);
+
+// The map doesn't guard the returned value, so if value_free is set, another thread that replaces
+// or deletes the key may free it while it is in use.
+void *hashmap_csc_find(struct hashmap_csc *self, uint64_t key);
+
+bool hashmap_csc_delete(struct hashmap_csc *self, uint64_t key);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger array of buckets.
+bool hashmap_csc_reserve(struct hashmap_csc *self, size_t capacity);
+
+// Entries count at some moment during the call.
+size_t hashmap_csc_size(struct hashmap_csc *self);
+
+void hashmap_csc_clear(struct hashmap_csc *self);
+
+// Must not run concurrently with anything else on the map.
+void hashmap_csc_free(struct hashmap_csc *self);
+
+#endif // HASHMAPS_HASHMAP_CSC_H
@@ -0,0 +1,162 @@
+#include "../minunit.h"
+#include "hashmap_csc.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREADS_COUNT 8
+#define KEYS_PER_THREAD 20000
+
+struct hashmap_csc {
+    atomic_size_t entries_count;
+    _Atomic uint32_t buckets_count;
+    struct bucket *buckets;
+    struct stripe *stripes;
+    void *stripes_memory;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_csc *map = hashmap_csc_new(hasher, free);
+    mu_assert("error, map must be constructed", map != NULL);
+    mu_assert("error, new map must be empty", hashmap_csc_size(map) == 0);
+    mu_assert("error, new map must have the initial buckets count", map->buckets_count == 10);
+    hashmap_csc_free(map);
+
+    map = hashmap_csc_new_with_capacity(hasher, free, 1000);
+    struct hashmap_csc *reserved = hashmap_csc_new(hasher, free);
+    mu_assert("error, reserve must succeed", hashmap_csc_reserve(reserved, 1000));
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->buckets_count == map->buckets_count);
+    hashmap_csc_free(reserved);
+    hashmap_csc_free(map);
+
+    return 0;
+}
+
+static char *test_inserts_finds_deletes() {
+    struct hashmap_csc *map = hashmap_csc_new(hasher, free);
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, insert must succeed", hashmap_csc_insert(map, i, make_ptr(i)));
+    }
+    mu_assert("error, entries count must be equal to 1000", hashmap_csc_size(map) == 1000);
+    mu_assert("error, map must have grown", 3 * map->buckets_count > 1000);
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        uint64_t *value = hashmap_csc_find(map, i);
+        mu_assert("error, inserted values must be found", value != NULL && *value == i);
+    }
+    mu_assert("error, missing key mustn't be found", hashmap_csc_find(map, 1001) == NULL);
+
+    hashmap_csc_insert(map, 1, make_ptr(100));
+    mu_assert("error, insert must replace the value", *(uint64_t *) hashmap_csc_find(map, 1) == 100);
+    mu_assert("error, replacing mustn't change entries count", hashmap_csc_size(map) == 1000);
+
+    for (uint64_t i = 1; i <= 500; ++i) {
+        mu_assert("error, delete must find the key", hashmap_csc_delete(map, i));
+    }
+    mu_assert("error, deleted key mustn't be deleted twice", !hashmap_csc_delete(map, 1));
+    mu_assert("error, entries count must be equal to 500", hashmap_csc_size(map) == 500);
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, only the rest of the keys must be found", (hashmap_csc_find(map, i) != NULL) == (i > 500));
+    }
+
+    hashmap_csc_clear(map);
+    mu_assert("error, map must be empty after clear", hashmap_csc_size(map) == 0);
+    mu_assert("error, keys mustn't be found after clear", hashmap_csc_find(map, 600) == NULL);
+    hashmap_csc_free(map);
+
+    return 0;
+}
+
+struct worker {
+    struct hashmap_csc *map;
+    uint64_t first_key;
+    size_t misses;
+};
+
+static void *insert_and_delete(void *arg) {
+    struct worker *worker = arg;
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        hashmap_csc_insert(worker->map, worker->first_key + i, (void *) (worker->first_key + i));
+    }
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        if (hashmap_csc_find(worker->map, worker->first_key + i) != (void *) (worker->first_key + i)) {
+            worker->misses++;
+        }
+    }
+    // Every other key is deleted while the other threads still insert and resize
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; i += 2) {
+        if (!hashmap_csc_delete(worker->map, worker->first_key + i)) {
+            worker->misses++;
+        }
+    }
+    return NULL;
+}
+
+static char *test_concurrent_access() {
+    struct hashmap_csc *map = hashmap_csc_new(hasher, leak);
+    pthread_t threads[THREADS_COUNT];
+    struct worker workers[THREADS_COUNT];
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        workers[i] = (struct worker) {.map = map, .first_key = 1 + i * KEYS_PER_THREAD, .misses = 0};
+        pthread_create(threads + i, NULL, insert_and_delete, workers + i);
+    }
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+        mu_assert("error, every thread must find its keys", workers[i].misses == 0);
+    }
+
+    mu_assert("error, entries count must be equal to the keys left",
+              hashmap_csc_size(map) == THREADS_COUNT * KEYS_PER_THREAD / 2);
+    for (uint64_t key = 1; key <= THREADS_COUNT * KEYS_PER_THREAD; ++key) {
+        bool deleted = (key - 1) % KEYS_PER_THREAD % 2 == 0;
+        mu_assert("error, only the keys that were not deleted must be found",
+                  hashmap_csc_find(map, key) == (deleted ? NULL : (void *) key));
+    }
+    hashmap_csc_free(map);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts_finds_deletes);
+    mu_run_test(test_concurrent_access);
+    return 0;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
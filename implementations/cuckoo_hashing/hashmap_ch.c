@@ -0,0 +1,495 @@
+#include "hashmap_ch.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LOAD_FACTOR 90
+#define BUCKET_SIZE 4
+#define STASH_SIZE 4
+#define INITIAL_BUCKETS_COUNT 4
+// Evictions an insert makes before it gives up on the buckets and takes the stash
+#define MAX_KICKS 256
+// Doublings an insert tries before it blames the hashers
+#define MAX_REHASHES 4
+#define BATCH_WIDTH 16
+#define CACHE_LINE_SIZE 64
+
+// Keys and values are kept apart, so the keys of a bucket are compared with one pass over
+// its first half. Key 0 marks a vacant slot.
+struct bucket {
+    uint64_t keys[BUCKET_SIZE];
+    void *values[BUCKET_SIZE];
+};
+
+struct entry {
+    uint64_t key;
+    void *value;
+};
+
+struct table {
+    // Each bucket takes a cache line of its own
+    struct bucket *buckets;
+    // What was allocated for the buckets before aligning them to a cache line
+    void *memory;
+    uint64_t buckets_count;
+    struct entry stash[STASH_SIZE];
+    size_t stash_count;
+};
+
+struct hashmap_ch {
+    uint64_t entries_count;
+    struct table table;
+    // Key 0 can't be put into a slot, so its entry is kept aside
+    bool zero_key_present;
+    void *zero_key_value;
+    // State of the xorshift generator that picks the entries to evict
+    uint64_t random;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher1)(uint64_t);
+
+    uint64_t (*hasher2)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static inline uint64_t first_bucket(const struct hashmap_ch *const self, uint64_t key, uint64_t buckets_count) {
+    return self->hasher1(key) & (buckets_count - 1);
+}
+
+// The second bucket always differs from the first one, so every key has two buckets to choose from.
+static inline uint64_t second_bucket(const struct hashmap_ch *const self, uint64_t key, uint64_t first,
+                                     uint64_t buckets_count) {
+    uint64_t second = self->hasher2(key) & (buckets_count - 1);
+    return second != first ? second : first ^ 1;
+}
+
+// Index of the key in the bucket or -1. Looking for key 0 finds a vacant slot.
+static inline int slot_of(const struct bucket *const bucket, uint64_t key) {
+    for (int i = 0; i < BUCKET_SIZE; ++i) {
+        if (bucket->keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline uint64_t next_random(struct hashmap_ch *const self) {
+    self->random ^= self->random << 13;
+    self->random ^= self->random >> 7;
+    self->random ^= self->random << 17;
+    return self->random;
+}
+
+static inline void value_release(const struct hashmap_ch *const self, void *value) {
+    if (self->value_free != NULL) {
+        self->value_free(value);
+    }
+}
+
+// Smallest power of two buckets count that keeps entries_count entries under the load factor,
+// but not less than the initial one.
+static uint64_t buckets_count_for(uint64_t entries_count) {
+    uint64_t buckets_count = INITIAL_BUCKETS_COUNT;
+    while (100 * entries_count > MAX_LOAD_FACTOR * BUCKET_SIZE * buckets_count) {
+        buckets_count *= 2;
+    }
+    return buckets_count;
+}
+
+static void table_free(const struct hashmap_ch *const self, struct table *const table) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    allocator->free(allocator->context, table->memory, table->buckets_count * sizeof(struct bucket) + CACHE_LINE_SIZE);
+}
+
+static bool table_new(const struct hashmap_ch *const self, struct table *const table, uint64_t buckets_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    table->memory =
+            allocator->alloc_zeroed(allocator->context, buckets_count * sizeof(struct bucket) + CACHE_LINE_SIZE);
+    if (table->memory == NULL) {
+        return false;
+    }
+    table->buckets = (struct bucket *) (((uintptr_t) table->memory + CACHE_LINE_SIZE - 1) &
+                                        ~(uintptr_t) (CACHE_LINE_SIZE - 1));
+    table->buckets_count = buckets_count;
+    table->stash_count = 0;
+    return true;
+}
+
+static inline void slot_swap(struct bucket *const bucket, int slot, struct entry *const entry) {
+    struct entry previous = {.key = bucket->keys[slot], .value = bucket->values[slot]};
+    bucket->keys[slot] = entry->key;
+    bucket->values[slot] = entry->value;
+    *entry = previous;
+}
+
+// Puts an entry of an absent key into one of its buckets, evicting other entries into their other
+// buckets on the way, or into the stash. When neither works out, every evicted entry is put back
+// and false is returned.
+static bool place(struct hashmap_ch *const self, struct table *const table, struct entry entry) {
+    uint64_t buckets_count = table->buckets_count;
+    uint64_t first = first_bucket(self, entry.key, buckets_count);
+    uint64_t bucket = second_bucket(self, entry.key, first, buckets_count);
+    int slot = slot_of(table->buckets + first, 0);
+    if (slot >= 0) {
+        slot_swap(table->buckets + first, slot, &entry);
+        return true;
+    }
+
+    uint64_t path[MAX_KICKS];
+    for (size_t kicks = 0; kicks < MAX_KICKS; ++kicks) {
+        slot = slot_of(table->buckets + bucket, 0);
+        if (slot >= 0) {
+            slot_swap(table->buckets + bucket, slot, &entry);
+            return true;
+        }
+
+        // The evicted entry goes to the other one of its buckets
+        slot = (int) (next_random(self) % BUCKET_SIZE);
+        path[kicks] = bucket * BUCKET_SIZE + slot;
+        slot_swap(table->buckets + bucket, slot, &entry);
+        uint64_t evicted_first = first_bucket(self, entry.key, buckets_count);
+        bucket = bucket != evicted_first ? evicted_first
+                                         : second_bucket(self, entry.key, evicted_first, buckets_count);
+    }
+    if (table->stash_count < STASH_SIZE) {
+        table->stash[table->stash_count++] = entry;
+        return true;
+    }
+
+    // Swapping back in reverse order returns every evicted entry to its slot and the passed one to entry
+    for (size_t kicks = MAX_KICKS; kicks-- > 0;) {
+        slot_swap(table->buckets + path[kicks] / BUCKET_SIZE, (int) (path[kicks] % BUCKET_SIZE), &entry);
+    }
+    return false;
+}
+
+// Returns false when some entry found no place in the new table.
+static bool rehash_into(struct hashmap_ch *const self, struct table *const table) {
+    const struct table *old_table = &self->table;
+    for (size_t i = 0; i < old_table->buckets_count; ++i) {
+        const struct bucket *bucket = old_table->buckets + i;
+        for (int j = 0; j < BUCKET_SIZE; ++j) {
+            struct entry entry = {.key = bucket->keys[j], .value = bucket->values[j]};
+            if (entry.key != 0 && !place(self, table, entry)) {
+                return false;
+            }
+        }
+    }
+    for (size_t i = 0; i < old_table->stash_count; ++i) {
+        if (!place(self, table, old_table->stash[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rehashes the entries into a table of buckets_count buckets, doubling it while some entry doesn't fit.
+// Leaves the map as it was when there is no memory or the hashers keep too many keys together.
+static bool resize_map(struct hashmap_ch *const self, uint64_t buckets_count) {
+    for (size_t i = 0; i < MAX_REHASHES; ++i, buckets_count *= 2) {
+        struct table table;
+        if (!table_new(self, &table, buckets_count)) {
+            return false;
+        }
+        if (rehash_into(self, &table)) {
+            table_free(self, &self->table);
+            self->table = table;
+            return true;
+        }
+        table_free(self, &table);
+    }
+    return false;
+}
+
+// Moves stashed entries that belong to the bucket back into it while it has vacant slots.
+static void unstash(struct hashmap_ch *const self, uint64_t bucket_index) {
+    struct table *table = &self->table;
+    struct bucket *bucket = table->buckets + bucket_index;
+    for (size_t i = 0; i < table->stash_count;) {
+        uint64_t key = table->stash[i].key;
+        uint64_t first = first_bucket(self, key, table->buckets_count);
+        int slot = slot_of(bucket, 0);
+        if (slot < 0) {
+            return;
+        }
+        if (first != bucket_index && second_bucket(self, key, first, table->buckets_count) != bucket_index) {
+            ++i;
+            continue;
+        }
+        bucket->keys[slot] = key;
+        bucket->values[slot] = table->stash[i].value;
+        table->stash[i] = table->stash[--table->stash_count];
+    }
+}
+
+// Returns where the value of the key is kept. Only the two buckets of the key are read,
+// and the stash when it isn't empty.
+static void **find_in(struct hashmap_ch *const self, uint64_t key, uint64_t first, uint64_t second) {
+    if (key == 0) {
+        return self->zero_key_present ? &self->zero_key_value : NULL;
+    }
+
+    struct bucket *buckets = self->table.buckets;
+    int slot = slot_of(buckets + first, key);
+    if (slot >= 0) {
+        return buckets[first].values + slot;
+    }
+    slot = slot_of(buckets + second, key);
+    if (slot >= 0) {
+        return buckets[second].values + slot;
+    }
+    for (size_t i = 0; i < self->table.stash_count; ++i) {
+        if (self->table.stash[i].key == key) {
+            return &self->table.stash[i].value;
+        }
+    }
+    return NULL;
+}
+
+static void **find_value(struct hashmap_ch *const self, uint64_t key) {
+    uint64_t buckets_count = self->table.buckets_count;
+    uint64_t first = first_bucket(self, key, buckets_count);
+    uint64_t second = second_bucket(self, key, first, buckets_count);
+    // The second bucket is on its way from memory while the first one is searched
+    __builtin_prefetch(self->table.buckets + second);
+    return find_in(self, key, first, second);
+}
+
+static void release_values(struct hashmap_ch *const self) {
+    if (self->value_free == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < self->table.buckets_count; ++i) {
+        const struct bucket *bucket = self->table.buckets + i;
+        for (int j = 0; j < BUCKET_SIZE; ++j) {
+            if (bucket->keys[j] != 0) {
+                self->value_free(bucket->values[j]);
+            }
+        }
+    }
+    for (size_t i = 0; i < self->table.stash_count; ++i) {
+        self->value_free(self->table.stash[i].value);
+    }
+    if (self->zero_key_present) {
+        self->value_free(self->zero_key_value);
+    }
+}
+
+struct hashmap_ch *
+hashmap_ch_new(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_ch_new_with_options(hasher1, hasher2, value_free, (struct hashmap_ch_options) {0});
+}
+
+struct hashmap_ch *hashmap_ch_new_with_capacity(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                                void (*value_free)(void *), size_t capacity) {
+    return hashmap_ch_new_with_options(hasher1, hasher2, value_free,
+                                       (struct hashmap_ch_options) {.capacity = capacity});
+}
+
+struct hashmap_ch *hashmap_ch_new_with_options(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                               void (*value_free)(void *), struct hashmap_ch_options options) {
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_ch *self = allocator->alloc(allocator->context, sizeof(struct hashmap_ch));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    if (!table_new(self, &self->table, buckets_count_for(options.capacity))) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_ch));
+        return NULL;
+    }
+    self->entries_count = 0;
+    self->zero_key_present = false;
+    self->random = UINT64_C(0x9e3779b97f4a7c15);
+    self->hasher1 = hasher1;
+    self->hasher2 = hasher2;
+    self->value_free = value_free;
+
+    return self;
+}
+
+struct hashmap_ch *hashmap_ch_new_from_arrays(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                              void (*value_free)(void *), const uint64_t *keys, void *const *values,
+                                              size_t n) {
+    struct hashmap_ch *self = hashmap_ch_new_with_capacity(hasher1, hasher2, value_free, n);
+    if (!hashmap_ch_insert_batch(self, keys, values, n)) {
+        hashmap_ch_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+bool hashmap_ch_insert(struct hashmap_ch *const self, uint64_t key, void *value) {
+    if (self == NULL) {
+        return false;
+    }
+
+    void **found = find_value(self, key);
+    if (found != NULL) {
+        value_release(self, *found);
+        *found = value;
+        return true;
+    }
+    if (key == 0) {
+        self->zero_key_present = true;
+        self->zero_key_value = value;
+        self->entries_count++;
+        return true;
+    }
+
+    // Without memory to grow the entry may still find a vacant slot
+    if (100 * (self->entries_count + 1) > MAX_LOAD_FACTOR * BUCKET_SIZE * self->table.buckets_count) {
+        resize_map(self, 2 * self->table.buckets_count);
+    }
+    struct entry entry = {.key = key, .value = value};
+    for (size_t i = 0; !place(self, &self->table, entry); ++i) {
+        if (i == MAX_REHASHES || !resize_map(self, 2 * self->table.buckets_count)) {
+            return false;
+        }
+    }
+    self->entries_count++;
+    return true;
+}
+
+bool hashmap_ch_insert_batch(struct hashmap_ch *const self, const uint64_t *keys, void *const *values, size_t n) {
+    if (self == NULL) {
+        return false;
+    }
+
+    // One resize up front instead of a doubling every time the load factor is hit
+    if (!hashmap_ch_reserve(self, self->entries_count + n)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!hashmap_ch_insert(self, keys[i], values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void *hashmap_ch_find(struct hashmap_ch *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    void **found = find_value(self, key);
+    return found == NULL ? NULL : *found;
+}
+
+// Keys are resolved in groups of BATCH_WIDTH: the whole group is hashed and both buckets of every key
+// are prefetched before the first lookup, so the cache misses of the group overlap.
+void hashmap_ch_find_batch(struct hashmap_ch *const self, const uint64_t *keys, size_t n, void **out) {
+    if (self == NULL) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = NULL;
+        }
+        return;
+    }
+
+    uint64_t firsts[BATCH_WIDTH];
+    uint64_t seconds[BATCH_WIDTH];
+    uint64_t buckets_count = self->table.buckets_count;
+    for (size_t start = 0; start < n; start += BATCH_WIDTH) {
+        size_t width = n - start < BATCH_WIDTH ? n - start : BATCH_WIDTH;
+        for (size_t i = 0; i < width; ++i) {
+            firsts[i] = first_bucket(self, keys[start + i], buckets_count);
+            seconds[i] = second_bucket(self, keys[start + i], firsts[i], buckets_count);
+            __builtin_prefetch(self->table.buckets + firsts[i]);
+            __builtin_prefetch(self->table.buckets + seconds[i]);
+        }
+        for (size_t i = 0; i < width; ++i) {
+            void **found = find_in(self, keys[start + i], firsts[i], seconds[i]);
+            out[start + i] = found == NULL ? NULL : *found;
+        }
+    }
+}
+
+bool hashmap_ch_delete(struct hashmap_ch *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    if (key == 0) {
+        if (!self->zero_key_present) {
+            return false;
+        }
+        value_release(self, self->zero_key_value);
+        self->zero_key_present = false;
+        self->entries_count--;
+        return true;
+    }
+
+    struct table *table = &self->table;
+    uint64_t first = first_bucket(self, key, table->buckets_count);
+    uint64_t buckets[] = {first, second_bucket(self, key, first, table->buckets_count)};
+    for (size_t i = 0; i < 2; ++i) {
+        struct bucket *bucket = table->buckets + buckets[i];
+        int slot = slot_of(bucket, key);
+        if (slot >= 0) {
+            value_release(self, bucket->values[slot]);
+            bucket->keys[slot] = 0;
+            self->entries_count--;
+            if (table->stash_count != 0) {
+                unstash(self, buckets[i]);
+            }
+            return true;
+        }
+    }
+    for (size_t i = 0; i < table->stash_count; ++i) {
+        if (table->stash[i].key == key) {
+            value_release(self, table->stash[i].value);
+            table->stash[i] = table->stash[--table->stash_count];
+            self->entries_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool hashmap_ch_reserve(struct hashmap_ch *const self, size_t capacity) {
+    if (self == NULL) {
+        return false;
+    }
+
+    uint64_t buckets_count = buckets_count_for(capacity);
+    return buckets_count <= self->table.buckets_count || resize_map(self, buckets_count);
+}
+
+void hashmap_ch_shrink_to_fit(struct hashmap_ch *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    // A rehash empties the stash, so it is worth doing even at the same size.
+    // If there is no memory for the rehash, the map just stays as it is.
+    uint64_t buckets_count = buckets_count_for(self->entries_count);
+    if (buckets_count < self->table.buckets_count || self->table.stash_count != 0) {
+        resize_map(self, buckets_count);
+    }
+}
+
+void hashmap_ch_clear(struct hashmap_ch *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    release_values(self);
+    hashmap_allocator_zero(&self->allocator, self->table.buckets, self->table.buckets_count * sizeof(struct bucket));
+    self->table.stash_count = 0;
+    self->zero_key_present = false;
+    self->entries_count = 0;
+}
+
+void hashmap_ch_free(struct hashmap_ch *const self) {
+    if (self == NULL) {
+        return;
+    }
+    release_values(self);
+    table_free(self, &self->table);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_ch));
+}
@@ -0,0 +1,63 @@
+#ifndef HASHMAPS_HASHMAP_CH_H
+#define HASHMAPS_HASHMAP_CH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+// Cuckoo hashing map. Every key has one bucket of four slots picked by hasher1 and another one picked
+// by hasher2, and is always kept in one of them, so a lookup reads two buckets, one cache line each.
+// Keys that don't fit into their buckets even after moving other entries around go to a small stash,
+// which is read only while it isn't empty.
+struct hashmap_ch;
+
+struct hashmap_ch_options {
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Where the buckets and the map itself are allocated. NULL means malloc and free.
+    const struct hashmap_allocator *allocator;
+};
+
+// hasher1 and hasher2 must be independent of each other. value_free may be NULL when the map does
+// not own the values. Constructors return NULL when there is no memory for the map, and inserts return
+// false when there is no memory to grow it or the hashers keep putting too many keys into the same buckets.
+struct hashmap_ch *
+hashmap_ch_new(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t), void (*value_free)(void *));
+
+struct hashmap_ch *hashmap_ch_new_with_capacity(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                                void (*value_free)(void *), size_t capacity);
+
+struct hashmap_ch *hashmap_ch_new_with_options(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                               void (*value_free)(void *), struct hashmap_ch_options options);
+
+// Builds a map from n entries, sized for all of them up front.
+struct hashmap_ch *hashmap_ch_new_from_arrays(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                              void (*value_free)(void *), const uint64_t *keys, void *const *values,
+                                              size_t n);
+
+// Takes amortized constant time, but an insert that triggers a resize rehashes every entry.
+bool hashmap_ch_insert(struct hashmap_ch *self, uint64_t key, void *value);
+
+// Inserts n entries into a map sized for all of them up front, values[i] is passed as to hashmap_ch_insert.
+bool hashmap_ch_insert_batch(struct hashmap_ch *self, const uint64_t *keys, void *const *values, size_t n);
+
+void *hashmap_ch_find(struct hashmap_ch *self, uint64_t key);
+
+// Looks up n keys at once, out[i] gets what hashmap_ch_find would return for keys[i].
+void hashmap_ch_find_batch(struct hashmap_ch *self, const uint64_t *keys, size_t n, void **out);
+
+bool hashmap_ch_delete(struct hashmap_ch *self, uint64_t key);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger table.
+bool hashmap_ch_reserve(struct hashmap_ch *self, size_t capacity);
+
+// Rehashes the entries into the smallest table that holds them, emptying the stash.
+void hashmap_ch_shrink_to_fit(struct hashmap_ch *self);
+
+void hashmap_ch_clear(struct hashmap_ch *self);
+
+void hashmap_ch_free(struct hashmap_ch *self);
+
+#endif // HASHMAPS_HASHMAP_CH_H
@@ -0,0 +1,441 @@
+#include "../minunit.h"
+#include "hashmap_ch.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BUCKET_SIZE 4
+#define STASH_SIZE 4
+
+struct bucket {
+    uint64_t keys[BUCKET_SIZE];
+    void *values[BUCKET_SIZE];
+};
+
+struct entry {
+    uint64_t key;
+    void *value;
+};
+
+struct table {
+    struct bucket *buckets;
+    void *memory;
+    uint64_t buckets_count;
+    struct entry stash[STASH_SIZE];
+    size_t stash_count;
+};
+
+struct hashmap_ch {
+    uint64_t entries_count;
+    struct table table;
+    bool zero_key_present;
+    void *zero_key_value;
+    uint64_t random;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher1)(uint64_t);
+
+    uint64_t (*hasher2)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static uint64_t hasher2(uint64_t x) {
+    x = (x ^ (x >> 33)) * UINT64_C(0xff51afd7ed558ccd);
+    x = (x ^ (x >> 33)) * UINT64_C(0xc4ceb9fe1a85ec53);
+    x = x ^ (x >> 33);
+    return x;
+}
+
+static uint64_t fake_hasher(uint64_t _) {
+    return 1;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, free);
+    mu_assert("error, hashmap constructor returned null", map != NULL);
+    mu_assert("error, initial buckets count must be equal to 4", map->table.buckets_count == 4);
+    mu_assert("error, initial entries count must be equal to 0", map->entries_count == 0);
+    mu_assert("error, buckets must be aligned to a cache line", (uintptr_t) map->table.buckets % 64 == 0);
+    mu_assert("error, bucket must take one cache line", sizeof(struct bucket) == 64);
+    mu_assert("error, stash must be empty", map->table.stash_count == 0);
+    for (size_t i = 0; i < map->table.buckets_count; ++i) {
+        for (size_t j = 0; j < BUCKET_SIZE; ++j) {
+            mu_assert("error, all slots must be vacant", map->table.buckets[i].keys[j] == 0);
+        }
+    }
+    hashmap_ch_free(map);
+
+    map = hashmap_ch_new_with_capacity(hasher, hasher2, free, 1000);
+    mu_assert("error, capacity must fit under the load factor", map->table.buckets_count == 512);
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_inserts() {
+    struct hashmap_ch *map = hashmap_ch_new(fake_hasher, fake_hasher, free);
+
+    hashmap_ch_insert(map, 999, make_ptr(5));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+    mu_assert("error, key must be saved in its first bucket", map->table.buckets[1].keys[0] == 999);
+    mu_assert("error, saved incorrect value", *(uint64_t *) map->table.buckets[1].values[0] == 5);
+
+    hashmap_ch_insert(map, 999, make_ptr(10));
+    mu_assert("error, entries count shouldn't change when saving existent key", map->entries_count == 1);
+    mu_assert("error, value should be changed", *(uint64_t *) map->table.buckets[1].values[0] == 10);
+
+    for (uint64_t key = 1; key <= 4; ++key) {
+        hashmap_ch_insert(map, key, make_ptr(key));
+    }
+    mu_assert("error, key must go to its second bucket when the first one is full",
+              map->table.buckets[0].keys[0] == 4);
+
+    hashmap_ch_insert(map, 0, make_ptr(15));
+    mu_assert("error, key 0 must be kept aside", map->zero_key_present);
+    mu_assert("error, key 0 must be found", *(uint64_t *) hashmap_ch_find(map, 0) == 15);
+    mu_assert("error, entries count must be equal to 6", map->entries_count == 6);
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_finds() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, free);
+    hashmap_ch_insert(map, 666, make_ptr(5));
+    hashmap_ch_insert(map, 777, make_ptr(10));
+
+    mu_assert("error, map must contain value with key 666", *(uint64_t *) hashmap_ch_find(map, 666) == 5);
+    mu_assert("error, map must contain value with key 777", *(uint64_t *) hashmap_ch_find(map, 777) == 10);
+    mu_assert("error, map shouldn't contain value with key 6666", hashmap_ch_find(map, 6666) == NULL);
+    mu_assert("error, map shouldn't contain value with key 0", hashmap_ch_find(map, 0) == NULL);
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_deletes() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, leak);
+
+    hashmap_ch_insert(map, 555, NULL);
+    hashmap_ch_insert(map, 777, NULL);
+    hashmap_ch_insert(map, 0, NULL);
+    mu_assert("error, key 777 must be deleted", hashmap_ch_delete(map, 777));
+    mu_assert("error, key 777 already must be deleted", !hashmap_ch_delete(map, 777));
+    mu_assert("error, key 888 can't be deleted because the map doesn't contain it", !hashmap_ch_delete(map, 888));
+    mu_assert("error, key 0 must be deleted", hashmap_ch_delete(map, 0));
+    mu_assert("error, key 0 already must be deleted", !hashmap_ch_delete(map, 0));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_stash() {
+    // Every key gets buckets 1 and 0, which hold 8 entries, and the rest go to the stash
+    struct hashmap_ch *map = hashmap_ch_new(fake_hasher, fake_hasher, leak);
+    for (uint64_t key = 1; key <= 2 * BUCKET_SIZE + STASH_SIZE; ++key) {
+        mu_assert("error, key must fit into its buckets or the stash", hashmap_ch_insert(map, key, (void *) key));
+    }
+    mu_assert("error, stash must be full", map->table.stash_count == STASH_SIZE);
+    for (uint64_t key = 1; key <= 2 * BUCKET_SIZE + STASH_SIZE; ++key) {
+        mu_assert("error, stashed and evicted keys must be found", hashmap_ch_find(map, key) == (void *) key);
+    }
+
+    // Growing doesn't spread keys that always hash the same, so the map gives up
+    mu_assert("error, key must be rejected when there is no place for it", !hashmap_ch_insert(map, 100, (void *) 100));
+    mu_assert("error, entries count mustn't change", map->entries_count == 2 * BUCKET_SIZE + STASH_SIZE);
+    mu_assert("error, rejected key mustn't be found", hashmap_ch_find(map, 100) == NULL);
+    for (uint64_t key = 1; key <= 2 * BUCKET_SIZE + STASH_SIZE; ++key) {
+        mu_assert("error, keys must stay in place after a rejected insert", hashmap_ch_find(map, key) == (void *) key);
+    }
+    mu_assert("error, existing key must be replaced", hashmap_ch_insert(map, 1, (void *) 1));
+
+    // A slot freed in a bucket takes back a stashed entry of that bucket
+    uint64_t key = map->table.buckets[0].keys[0];
+    mu_assert("error, key must be deleted", hashmap_ch_delete(map, key));
+    mu_assert("error, stashed entry must move into the freed slot", map->table.stash_count == STASH_SIZE - 1);
+    for (uint64_t k = 1; k <= 2 * BUCKET_SIZE + STASH_SIZE; ++k) {
+        mu_assert("error, only the deleted key must be gone", (hashmap_ch_find(map, k) == NULL) == (k == key));
+    }
+
+    // Deleting a stashed key keeps the rest of the stash
+    uint64_t stashed = map->table.stash[0].key;
+    mu_assert("error, stashed key must be deleted", hashmap_ch_delete(map, stashed));
+    mu_assert("error, stash must shrink", map->table.stash_count == STASH_SIZE - 2);
+    mu_assert("error, deleted stashed key mustn't be found", hashmap_ch_find(map, stashed) == NULL);
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_resizes() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, leak);
+
+    for (size_t i = 1; i <= 14; ++i) {
+        hashmap_ch_insert(map, i, (void *) i);
+        mu_assert("error, buckets count must be equal to 4", map->table.buckets_count == 4);
+    }
+
+    hashmap_ch_insert(map, 15, (void *) 15);
+    mu_assert("error, entries count must be equal to 15", map->entries_count == 15);
+    mu_assert("error, buckets count must be equal to 8", map->table.buckets_count == 8);
+
+    for (size_t i = 1; i <= 15; ++i) {
+        mu_assert("error, all previously inserted values must be found", hashmap_ch_find(map, i) == (void *) i);
+    }
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_many_keys() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, leak);
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, insert must succeed", hashmap_ch_insert(map, i, (void *) i));
+    }
+    mu_assert("error, entries count must be equal to 200000", map->entries_count == 200000);
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, all inserted values must be found", hashmap_ch_find(map, i) == (void *) i);
+    }
+    for (size_t i = 1; i <= 200000; i += 2) {
+        mu_assert("error, delete must find the key", hashmap_ch_delete(map, i));
+    }
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, only the rest of the keys must be found",
+                  hashmap_ch_find(map, i) == (i % 2 == 0 ? (void *) i : NULL));
+    }
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_find_batch() {
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, leak);
+    for (size_t i = 1; i <= 100; ++i) {
+        hashmap_ch_insert(map, i, (void *) i);
+    }
+
+    // The batch size is not a multiple of the internal group width
+    uint64_t keys[110];
+    void *values[110];
+    for (size_t i = 0; i < 110; ++i) {
+        keys[i] = i + 1;
+    }
+    hashmap_ch_find_batch(map, keys, 110, values);
+    for (size_t i = 0; i < 100; ++i) {
+        mu_assert("error, batch must find all inserted keys", values[i] == (void *) keys[i]);
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        mu_assert("error, batch mustn't find absent keys", values[i] == NULL);
+    }
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_insert_batch() {
+    uint64_t keys[1000];
+    void *values[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        keys[i] = i + 1;
+        values[i] = (void *) (i + 1);
+    }
+
+    struct hashmap_ch *map = hashmap_ch_new(hasher, hasher2, leak);
+    hashmap_ch_insert_batch(map, keys, values, 1000);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all batch inserted values must be found", hashmap_ch_find(map, i) == (void *) i);
+    }
+    uint64_t buckets_count = map->table.buckets_count;
+    hashmap_ch_free(map);
+
+    map = hashmap_ch_new_from_arrays(hasher, hasher2, leak, keys, values, 1000);
+    mu_assert("error, bulk built map must have the same size", map->table.buckets_count == buckets_count);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all bulk inserted values must be found", hashmap_ch_find(map, i) == (void *) i);
+    }
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_reserve_and_shrink() {
+    struct hashmap_ch *map = hashmap_ch_new_with_capacity(hasher, hasher2, leak, 1000);
+    struct hashmap_ch *reserved = hashmap_ch_new(hasher, hasher2, leak);
+    hashmap_ch_reserve(reserved, 1000);
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->table.buckets_count == map->table.buckets_count);
+    hashmap_ch_reserve(reserved, 10);
+    mu_assert("error, reserve mustn't shrink the map", reserved->table.buckets_count == map->table.buckets_count);
+    hashmap_ch_free(reserved);
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_ch_insert(map, i, (void *) i);
+    }
+    for (size_t i = 6; i <= 1000; ++i) {
+        hashmap_ch_delete(map, i);
+    }
+    hashmap_ch_shrink_to_fit(map);
+    mu_assert("error, map must shrink to the initial size", map->table.buckets_count == 4);
+    for (size_t i = 1; i <= 5; ++i) {
+        mu_assert("error, remaining values must be found after shrinking", hashmap_ch_find(map, i) == (void *) i);
+    }
+    mu_assert("error, deleted values mustn't be found after shrinking", hashmap_ch_find(map, 6) == NULL);
+
+    hashmap_ch_clear(map);
+    mu_assert("error, map must be empty after clear", map->entries_count == 0);
+    mu_assert("error, keys mustn't be found after clear", hashmap_ch_find(map, 1) == NULL);
+    hashmap_ch_insert(map, 1, (void *) 1);
+    mu_assert("error, map must take keys after clear", hashmap_ch_find(map, 1) == (void *) 1);
+
+    hashmap_ch_free(map);
+
+    return 0;
+}
+
+static char *test_allocators() {
+    struct hashmap_ch_options options = {.allocator = &failing_allocator};
+    allocations_left = 0;
+    mu_assert("error, constructor must fail without memory",
+              hashmap_ch_new_with_options(hasher, hasher2, leak, options) == NULL);
+    allocations_left = 1;
+    mu_assert("error, constructor must fail without memory for the buckets",
+              hashmap_ch_new_with_options(hasher, hasher2, leak, options) == NULL);
+
+    allocations_left = SIZE_MAX;
+    struct hashmap_ch *map = hashmap_ch_new_with_options(hasher, hasher2, leak, options);
+    size_t inserted = 0;
+    for (; inserted < 10; ++inserted) {
+        hashmap_ch_insert(map, inserted + 1, (void *) (inserted + 1));
+    }
+    // Without memory the map can't grow, but it still takes entries while they fit
+    allocations_left = 0;
+    while (hashmap_ch_insert(map, inserted + 1, (void *) (inserted + 1))) {
+        inserted++;
+    }
+    mu_assert("error, map must be filled up without memory",
+              inserted >= 14 && inserted <= 4 * BUCKET_SIZE + STASH_SIZE && map->table.buckets_count == 4);
+    mu_assert("error, reserve must fail when the map can't grow", !hashmap_ch_reserve(map, 1000));
+    for (size_t i = 1; i <= inserted; ++i) {
+        mu_assert("error, values must be found after a failed insert", hashmap_ch_find(map, i) == (void *) i);
+    }
+    mu_assert("error, failed key mustn't be found", hashmap_ch_find(map, inserted + 1) == NULL);
+    mu_assert("error, existing key must be replaced without memory", hashmap_ch_insert(map, 1, (void *) 1));
+    allocations_left = SIZE_MAX;
+    mu_assert("error, insert must succeed when memory is back",
+              hashmap_ch_insert(map, inserted + 1, (void *) (inserted + 1)));
+    hashmap_ch_free(map);
+
+    struct hashmap_arena *arena = hashmap_arena_new(4096);
+    struct hashmap_allocator arena_allocator = hashmap_arena_allocator(arena);
+    const struct hashmap_allocator *allocators[] = {&hashmap_huge_page_allocator, &arena_allocator};
+    for (size_t a = 0; a < 2; ++a) {
+        options.allocator = allocators[a];
+        map = hashmap_ch_new_with_options(hasher, hasher2, leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_ch_insert(map, i, (void *) i);
+        }
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found in a map with a custom allocator",
+                      hashmap_ch_find(map, i) == (void *) i);
+        }
+        hashmap_ch_free(map);
+    }
+    hashmap_arena_free(arena);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts);
+    mu_run_test(test_finds);
+    mu_run_test(test_deletes);
+    mu_run_test(test_stash);
+    mu_run_test(test_resizes);
+    mu_run_test(test_many_keys);
+    mu_run_test(test_find_batch);
+    mu_run_test(test_insert_batch);
+    mu_run_test(test_reserve_and_shrink);
+    mu_run_test(test_allocators);
+
+    return NULL;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
@@ -2,18 +2,120 @@
 #define HASHMAPS_HASHMAP_DH_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "../hashmap_allocator.h"
 
 struct hashmap_dh;
 
+struct hashmap_dh_options {
+    // Keep the slots count a power of two, so a slot index is taken with a mask instead of a division
+    // and the probe step is forced to be odd.
+    bool power_of_two;
+    // Store values of this size right in the slots instead of the passed pointers. Insert then copies
+    // value_size bytes from the passed pointer, and find returns a pointer into the slots, which stays
+    // valid until the next insert or delete. Zero keeps the passed pointers.
+    size_t value_size;
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Percent of the slots that may be taken before the table grows, below 100. Zero keeps 70.
+    unsigned max_load_factor;
+    // Percent the slots count is multiplied by when the table grows, above 100. Power of two tables round
+    // the result up to the next power of two. Zero keeps 200.
+    unsigned growth_factor;
+    // Probes an insert makes before it grows the table even under the load factor. Zero keeps log2 of
+    // the slots count, which dense tables hit long before the load factor, so set it with max_load_factor.
+    uint64_t distance_limit;
+    // Grow by moving a few entries into the bigger table on every insert and delete instead of
+    // rehashing the whole table at once. Until the move is over, lookups check both tables.
+    bool incremental_resize;
+    // Rehash tables of at least 65536 slots with this many threads, each moving the entries of its own
+    // part of the old slots. Zero or one rehashes in the calling thread.
+    size_t resize_threads;
+    // Release the values of tables of at least 65536 slots in clear and free with this many threads,
+    // each taking its own part of the slots. value_free is then called from all of them at once,
+    // so it must be thread-safe. Zero or one releases them in the calling thread.
+    size_t clear_threads;
+    // Where the slots and the map itself are allocated. NULL means malloc and free.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map or the options are out of range, and inserts return false when
+// there is no memory to grow it.
 struct hashmap_dh *hashmap_dh_new(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t), void (*value_free)(void *));
 
+struct hashmap_dh *hashmap_dh_new_with_capacity(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                                void (*value_free)(void *), size_t capacity);
+
+struct hashmap_dh *hashmap_dh_new_with_options(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                               void (*value_free)(void *), struct hashmap_dh_options options);
+
+// Builds a map from n entries, sized for all of them up front.
+struct hashmap_dh *hashmap_dh_new_from_arrays(uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t),
+                                              void (*value_free)(void *), struct hashmap_dh_options options,
+                                              const uint64_t *keys, void *const *values, size_t n);
+
 bool hashmap_dh_insert(struct hashmap_dh * self, uint64_t key, void *value);
 
+// Inserts n entries into a map sized for all of them up front, values[i] is passed as to hashmap_dh_insert.
+bool hashmap_dh_insert_batch(struct hashmap_dh *self, const uint64_t *keys, void *const *values, size_t n);
+
 void *hashmap_dh_find(struct hashmap_dh *self, uint64_t key);
 
+// Looks up n keys at once, out[i] gets what hashmap_dh_find would return for keys[i].
+void hashmap_dh_find_batch(struct hashmap_dh *self, const uint64_t *keys, size_t n, void **out);
+
 bool hashmap_dh_delete(struct hashmap_dh *self, uint64_t key);
 
+// Position of a walk over all the entries. The fields are internal.
+struct hashmap_dh_iter {
+    uint64_t index;
+    bool old;
+};
+
+void hashmap_dh_iter_begin(struct hashmap_dh *self, struct hashmap_dh_iter *iter);
+
+// Stores the next entry into key and value, which gets what hashmap_dh_find would return for the key, and returns
+// false when no entries are left. The slots are walked in order, so the map must not change until the walk is over.
+bool hashmap_dh_iter_next(struct hashmap_dh *self, struct hashmap_dh_iter *iter, uint64_t *key, void **value);
+
+// Position of a scan, which unlike hashmap_dh_iter may be resumed after the map changed. The fields are internal.
+struct hashmap_dh_cursor {
+    uint64_t index;
+    uint64_t resizes_count;
+    bool old;
+    bool finished;
+};
+
+void hashmap_dh_cursor_begin(struct hashmap_dh *self, struct hashmap_dh_cursor *cursor);
+
+// Calls visit for the entries of the next count slots and returns false once the last slot is scanned. Between
+// the calls the map may change: an entry that stays in it for the whole scan is visited at least once, entries
+// inserted or deleted meanwhile may be visited or not. An incremental resize keeps the scanned table as the old
+// one, so the scan goes on, but after any other resize it starts over in the new table, and so entries may be
+// visited more than once. visit itself must not change the map.
+bool hashmap_dh_scan(struct hashmap_dh *self, struct hashmap_dh_cursor *cursor, size_t count,
+                     void (*visit)(void *context, uint64_t key, void *value), void *context);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger table.
+bool hashmap_dh_reserve(struct hashmap_dh *self, size_t capacity);
+
+// Rehashes the entries into the smallest table that holds them.
+void hashmap_dh_shrink_to_fit(struct hashmap_dh *self);
+
+// Writes the slots to fd in the format hashmap_dh_open_mmap reads, finishing an incremental resize first.
+// Only maps with inline values are saved, since pointers mean nothing to another process. Returns false
+// for maps of pointers and when writing fails.
+bool hashmap_dh_save(struct hashmap_dh *self, int fd);
+
+// Maps a file written by hashmap_dh_save read-only and looks keys up right in it, so opening takes no time
+// whatever the entries count. hasher1 and hasher2 must be the ones the map was saved with. The map is read-only: inserts,
+// deletes and reserve return false, shrink_to_fit and clear do nothing, and find returns pointers into the file.
+// Returns NULL when the file can't be mapped or was not saved by a double hashing map with these hashers.
+struct hashmap_dh *hashmap_dh_open_mmap(const char *path, uint64_t (*hasher1)(uint64_t), uint64_t (*hasher2)(uint64_t));
+
 void hashmap_dh_clear(struct hashmap_dh *self);
 
 void hashmap_dh_free(struct hashmap_dh *self);
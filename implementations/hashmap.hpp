@@ -0,0 +1,539 @@
+#ifndef HASHMAPS_HASHMAP_HPP
+#define HASHMAPS_HASHMAP_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "separate_chaining/hashmap_sc.h"
+#include "linear_probing/hashmap_lp.h"
+#include "quadratic_probing/hashmap_qp.h"
+#include "double_hashing/hashmap_dh.h"
+#include "swiss_table/hashmap_sw.h"
+#include "cuckoo_hashing/hashmap_ch.h"
+#include "hopscotch/hashmap_hs.h"
+#include "concurrent_separate_chaining/hashmap_csc.h"
+#include "concurrent_linear_probing/hashmap_clp.h"
+#include "sharded/hashmap_sharded.h"
+}
+
+// C++20 wrapper over the C maps. basic_map<Traits, T> owns one map and calls its functions directly,
+// without type erasure, so every call costs what the C call costs. Values that the map can copy bytewise
+// are kept right in its slots, the others are moved into the heap and deleted by the map.
+namespace hashmaps {
+
+using hasher_type = uint64_t (*)(uint64_t);
+
+// Every C map is described by a traits struct with its types and functions. Batches, reserve and
+// shrink_to_fit are optional.
+template<typename Traits>
+concept map_traits = requires(typename Traits::map_type *map, uint64_t key, void *value) {
+    typename Traits::options_type;
+    { Traits::hashers_count } -> std::convertible_to<size_t>;
+    { Traits::thread_safe } -> std::convertible_to<bool>;
+    { Traits::insert(map, key, value) } -> std::same_as<bool>;
+    { Traits::find(map, key) } -> std::same_as<void *>;
+    { Traits::erase(map, key) } -> std::same_as<bool>;
+    Traits::clear(map);
+    Traits::free(map);
+};
+
+template<typename Traits>
+concept batched_traits = map_traits<Traits> && requires(typename Traits::map_type *map, const uint64_t *keys,
+                                                         void *const *values, void **out, size_t n) {
+    { Traits::insert_batch(map, keys, values, n) } -> std::same_as<bool>;
+    Traits::find_batch(map, keys, n, out);
+};
+
+template<typename Traits>
+concept reservable_traits = map_traits<Traits> && requires(typename Traits::map_type *map, size_t capacity) {
+    { Traits::reserve(map, capacity) } -> std::same_as<bool>;
+};
+
+template<typename Traits>
+concept shrinkable_traits = map_traits<Traits> && requires(typename Traits::map_type *map) {
+    Traits::shrink_to_fit(map);
+};
+
+// Maps that walk their entries with an iterator and scan them with a cursor resumable after changes
+template<typename Traits>
+concept iterable_traits = map_traits<Traits> && requires(typename Traits::map_type *map,
+                                                          typename Traits::iter_type *iter,
+                                                          typename Traits::cursor_type *cursor, uint64_t *key,
+                                                          void **value, void (*visit)(void *, uint64_t, void *)) {
+    Traits::iter_begin(map, iter);
+    { Traits::iter_next(map, iter, key, value) } -> std::same_as<bool>;
+    Traits::cursor_begin(map, cursor);
+    { Traits::scan(map, cursor, size_t{}, visit, nullptr) } -> std::same_as<bool>;
+};
+
+// Maps whose options take value_size keep values in their slots
+template<typename Traits>
+concept inline_traits = map_traits<Traits> && requires(typename Traits::options_type options) {
+    options.value_size = size_t{};
+};
+
+// Slots keep inline values 8-byte aligned and copy them with memcpy
+template<typename T>
+concept inline_value = std::is_trivially_copyable_v<T> && alignof(T) <= alignof(uint64_t);
+
+struct sc_traits {
+    using map_type = hashmap_sc;
+    using options_type = hashmap_sc_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_sc_new_with_options;
+    static constexpr auto insert = hashmap_sc_insert;
+    static constexpr auto insert_batch = hashmap_sc_insert_batch;
+    static constexpr auto find = hashmap_sc_find;
+    static constexpr auto find_batch = hashmap_sc_find_batch;
+    static constexpr auto erase = hashmap_sc_delete;
+    static constexpr auto reserve = hashmap_sc_reserve;
+    static constexpr auto shrink_to_fit = hashmap_sc_shrink_to_fit;
+    static constexpr auto clear = hashmap_sc_clear;
+    static constexpr auto free = hashmap_sc_free;
+    using iter_type = hashmap_sc_iter;
+    using cursor_type = hashmap_sc_cursor;
+    static constexpr auto iter_begin = hashmap_sc_iter_begin;
+    static constexpr auto iter_next = hashmap_sc_iter_next;
+    static constexpr auto cursor_begin = hashmap_sc_cursor_begin;
+    static constexpr auto scan = hashmap_sc_scan;
+};
+
+struct lp_traits {
+    using map_type = hashmap_lp;
+    using options_type = hashmap_lp_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_lp_new_with_options;
+    static constexpr auto insert = hashmap_lp_insert;
+    static constexpr auto insert_batch = hashmap_lp_insert_batch;
+    static constexpr auto find = hashmap_lp_find;
+    static constexpr auto find_batch = hashmap_lp_find_batch;
+    static constexpr auto erase = hashmap_lp_delete;
+    static constexpr auto reserve = hashmap_lp_reserve;
+    static constexpr auto shrink_to_fit = hashmap_lp_shrink_to_fit;
+    static constexpr auto clear = hashmap_lp_clear;
+    static constexpr auto free = hashmap_lp_free;
+    using iter_type = hashmap_lp_iter;
+    using cursor_type = hashmap_lp_cursor;
+    static constexpr auto iter_begin = hashmap_lp_iter_begin;
+    static constexpr auto iter_next = hashmap_lp_iter_next;
+    static constexpr auto cursor_begin = hashmap_lp_cursor_begin;
+    static constexpr auto scan = hashmap_lp_scan;
+    static constexpr auto save = hashmap_lp_save;
+    static constexpr auto open_mmap = hashmap_lp_open_mmap;
+};
+
+struct qp_traits {
+    using map_type = hashmap_qp;
+    using options_type = hashmap_qp_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_qp_new_with_options;
+    static constexpr auto insert = hashmap_qp_insert;
+    static constexpr auto insert_batch = hashmap_qp_insert_batch;
+    static constexpr auto find = hashmap_qp_find;
+    static constexpr auto find_batch = hashmap_qp_find_batch;
+    static constexpr auto erase = hashmap_qp_delete;
+    static constexpr auto reserve = hashmap_qp_reserve;
+    static constexpr auto shrink_to_fit = hashmap_qp_shrink_to_fit;
+    static constexpr auto clear = hashmap_qp_clear;
+    static constexpr auto free = hashmap_qp_free;
+    using iter_type = hashmap_qp_iter;
+    using cursor_type = hashmap_qp_cursor;
+    static constexpr auto iter_begin = hashmap_qp_iter_begin;
+    static constexpr auto iter_next = hashmap_qp_iter_next;
+    static constexpr auto cursor_begin = hashmap_qp_cursor_begin;
+    static constexpr auto scan = hashmap_qp_scan;
+    static constexpr auto save = hashmap_qp_save;
+    static constexpr auto open_mmap = hashmap_qp_open_mmap;
+};
+
+struct dh_traits {
+    using map_type = hashmap_dh;
+    using options_type = hashmap_dh_options;
+    static constexpr size_t hashers_count = 2;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_dh_new_with_options;
+    static constexpr auto insert = hashmap_dh_insert;
+    static constexpr auto insert_batch = hashmap_dh_insert_batch;
+    static constexpr auto find = hashmap_dh_find;
+    static constexpr auto find_batch = hashmap_dh_find_batch;
+    static constexpr auto erase = hashmap_dh_delete;
+    static constexpr auto reserve = hashmap_dh_reserve;
+    static constexpr auto shrink_to_fit = hashmap_dh_shrink_to_fit;
+    static constexpr auto clear = hashmap_dh_clear;
+    static constexpr auto free = hashmap_dh_free;
+    using iter_type = hashmap_dh_iter;
+    using cursor_type = hashmap_dh_cursor;
+    static constexpr auto iter_begin = hashmap_dh_iter_begin;
+    static constexpr auto iter_next = hashmap_dh_iter_next;
+    static constexpr auto cursor_begin = hashmap_dh_cursor_begin;
+    static constexpr auto scan = hashmap_dh_scan;
+    static constexpr auto save = hashmap_dh_save;
+    static constexpr auto open_mmap = hashmap_dh_open_mmap;
+};
+
+struct sw_traits {
+    using map_type = hashmap_sw;
+    using options_type = hashmap_sw_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_sw_new_with_options;
+    static constexpr auto insert = hashmap_sw_insert;
+    static constexpr auto insert_batch = hashmap_sw_insert_batch;
+    static constexpr auto find = hashmap_sw_find;
+    static constexpr auto find_batch = hashmap_sw_find_batch;
+    static constexpr auto erase = hashmap_sw_delete;
+    static constexpr auto reserve = hashmap_sw_reserve;
+    static constexpr auto shrink_to_fit = hashmap_sw_shrink_to_fit;
+    static constexpr auto clear = hashmap_sw_clear;
+    static constexpr auto free = hashmap_sw_free;
+};
+
+struct ch_traits {
+    using map_type = hashmap_ch;
+    using options_type = hashmap_ch_options;
+    static constexpr size_t hashers_count = 2;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_ch_new_with_options;
+    static constexpr auto insert = hashmap_ch_insert;
+    static constexpr auto insert_batch = hashmap_ch_insert_batch;
+    static constexpr auto find = hashmap_ch_find;
+    static constexpr auto find_batch = hashmap_ch_find_batch;
+    static constexpr auto erase = hashmap_ch_delete;
+    static constexpr auto reserve = hashmap_ch_reserve;
+    static constexpr auto shrink_to_fit = hashmap_ch_shrink_to_fit;
+    static constexpr auto clear = hashmap_ch_clear;
+    static constexpr auto free = hashmap_ch_free;
+};
+
+struct hs_traits {
+    using map_type = hashmap_hs;
+    using options_type = hashmap_hs_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = false;
+    static constexpr auto make = hashmap_hs_new_with_options;
+    static constexpr auto insert = hashmap_hs_insert;
+    static constexpr auto insert_batch = hashmap_hs_insert_batch;
+    static constexpr auto find = hashmap_hs_find;
+    static constexpr auto find_batch = hashmap_hs_find_batch;
+    static constexpr auto erase = hashmap_hs_delete;
+    static constexpr auto reserve = hashmap_hs_reserve;
+    static constexpr auto shrink_to_fit = hashmap_hs_shrink_to_fit;
+    static constexpr auto clear = hashmap_hs_clear;
+    static constexpr auto free = hashmap_hs_free;
+};
+
+struct csc_traits {
+    using map_type = hashmap_csc;
+    using options_type = hashmap_csc_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = true;
+    static constexpr auto make = hashmap_csc_new_with_options;
+    static constexpr auto insert = hashmap_csc_insert;
+    static constexpr auto find = hashmap_csc_find;
+    static constexpr auto erase = hashmap_csc_delete;
+    static constexpr auto reserve = hashmap_csc_reserve;
+    static constexpr auto clear = hashmap_csc_clear;
+    static constexpr auto free = hashmap_csc_free;
+};
+
+// The map is sized only at construction
+struct clp_traits {
+    using map_type = hashmap_clp;
+    using options_type = hashmap_clp_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = true;
+    static constexpr auto make = hashmap_clp_new_with_options;
+    static constexpr auto insert = hashmap_clp_insert;
+    static constexpr auto find = hashmap_clp_find;
+    static constexpr auto erase = hashmap_clp_delete;
+    static constexpr auto clear = hashmap_clp_clear;
+    static constexpr auto free = hashmap_clp_free;
+};
+
+// The second hasher of double hashing shards goes in the options
+struct sharded_traits {
+    using map_type = hashmap_sharded;
+    using options_type = hashmap_sharded_options;
+    static constexpr size_t hashers_count = 1;
+    static constexpr bool thread_safe = true;
+    static constexpr auto make = hashmap_sharded_new_with_options;
+    static constexpr auto insert = hashmap_sharded_insert;
+    static constexpr auto find = hashmap_sharded_find;
+    static constexpr auto erase = hashmap_sharded_delete;
+    static constexpr auto reserve = hashmap_sharded_reserve;
+    static constexpr auto clear = hashmap_sharded_clear;
+    static constexpr auto free = hashmap_sharded_free;
+};
+
+// Inline keeps values in the slots, which is the default wherever both the map and T allow it.
+// Constructors throw std::bad_alloc when the C constructor returns NULL, that is when there is no
+// memory for the map or the options are out of range. Inserts replace the value of an existing key
+// and return false when there is no memory to grow the map. Pointers returned by find stay valid
+// until the next insert or delete when values are inline, and until the key is deleted otherwise.
+template<map_traits Traits, typename T, bool Inline = inline_traits<Traits> && inline_value<T>>
+    requires std::destructible<T> && (!Inline || (inline_traits<Traits> && inline_value<T>))
+class basic_map {
+    typename Traits::map_type *map;
+
+    static void delete_value(void *value) {
+        delete static_cast<T *>(value);
+    }
+
+    static typename Traits::options_type with_value_size(typename Traits::options_type options) {
+        if constexpr (Inline) {
+            options.value_size = sizeof(T);
+        }
+        return options;
+    }
+
+    static constexpr void (*value_free)(void *) = Inline ? nullptr : delete_value;
+
+    static typename Traits::map_type *checked(typename Traits::map_type *map) {
+        if (map == nullptr) {
+            throw std::bad_alloc();
+        }
+        return map;
+    }
+
+    template<typename Visit>
+    static void visit_entry(void *context, uint64_t key, void *value) {
+        (*static_cast<Visit *>(context))(key, *static_cast<T *>(value));
+    }
+
+public:
+    using traits_type = Traits;
+    using options_type = typename Traits::options_type;
+    using value_type = T;
+
+    static constexpr bool thread_safe = Traits::thread_safe;
+    static constexpr bool inline_values = Inline;
+
+    explicit basic_map(hasher_type hasher, options_type options = {}) requires (Traits::hashers_count == 1)
+            : map(checked(Traits::make(hasher, value_free, with_value_size(options)))) {}
+
+    basic_map(hasher_type hasher1, hasher_type hasher2, options_type options = {})
+    requires (Traits::hashers_count == 2)
+            : map(checked(Traits::make(hasher1, hasher2, value_free, with_value_size(options)))) {}
+
+    basic_map(const basic_map &) = delete;
+
+    basic_map &operator=(const basic_map &) = delete;
+
+    basic_map(basic_map &&other) noexcept: map(std::exchange(other.map, nullptr)) {}
+
+    basic_map &operator=(basic_map &&other) noexcept {
+        if (this != &other) {
+            if (map != nullptr) {
+                Traits::free(map);
+            }
+            map = std::exchange(other.map, nullptr);
+        }
+        return *this;
+    }
+
+    ~basic_map() {
+        if (map != nullptr) {
+            Traits::free(map);
+        }
+    }
+
+    // Constructs the value in place for inline maps, and in the heap for the others
+    template<typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace(uint64_t key, Args &&... args) {
+        if constexpr (Inline) {
+            T value(std::forward<Args>(args)...);
+            return Traits::insert(map, key, &value);
+        } else {
+            auto value = std::make_unique<T>(std::forward<Args>(args)...);
+            if (!Traits::insert(map, key, value.get())) {
+                return false;
+            }
+            value.release();
+            return true;
+        }
+    }
+
+    bool insert(uint64_t key, const T &value) requires std::copy_constructible<T> {
+        return emplace(key, value);
+    }
+
+    bool insert(uint64_t key, T &&value) requires std::move_constructible<T> {
+        return emplace(key, std::move(value));
+    }
+
+    // Inline values go to the C batch insert as they are. Heap values are inserted one by one,
+    // so that each of them is either owned by the map or deleted here when there is no memory.
+    bool insert_batch(const uint64_t *keys, const T *values, size_t n) requires std::copy_constructible<T> {
+        if constexpr (Inline && batched_traits<Traits>) {
+            std::vector<void *> pointers(n);
+            for (size_t i = 0; i < n; ++i) {
+                pointers[i] = const_cast<T *>(values + i);
+            }
+            return Traits::insert_batch(map, keys, pointers.data(), n);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                if (!emplace(keys[i], values[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    T *find(uint64_t key) {
+        return static_cast<T *>(Traits::find(map, key));
+    }
+
+    const T *find(uint64_t key) const {
+        return static_cast<const T *>(Traits::find(map, key));
+    }
+
+    // out[i] gets what find would return for keys[i]
+    void find_batch(const uint64_t *keys, size_t n, T **out) {
+        if constexpr (batched_traits<Traits>) {
+            Traits::find_batch(map, keys, n, reinterpret_cast<void **>(out));
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = find(keys[i]);
+            }
+        }
+    }
+
+    bool contains(uint64_t key) const {
+        return find(key) != nullptr;
+    }
+
+    bool erase(uint64_t key) {
+        return Traits::erase(map, key);
+    }
+
+    bool reserve(size_t capacity) requires reservable_traits<Traits> {
+        return Traits::reserve(map, capacity);
+    }
+
+    void shrink_to_fit() requires shrinkable_traits<Traits> {
+        Traits::shrink_to_fit(map);
+    }
+
+    void clear() {
+        Traits::clear(map);
+    }
+
+    // Walks the entries in the order of the slots, so the map must not change until the walk is over.
+    // Dereferencing gives the key and a reference to the value.
+    class iterator {
+        basic_map *owner;
+        typename Traits::iter_type state;
+        uint64_t key;
+        T *value;
+
+        void advance() {
+            void *found;
+            if (Traits::iter_next(owner->map, &state, &key, &found)) {
+                value = static_cast<T *>(found);
+            } else {
+                owner = nullptr;
+            }
+        }
+
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::pair<uint64_t, T &>;
+
+        explicit iterator(basic_map *owner) : owner(owner) {
+            Traits::iter_begin(owner->map, &state);
+            advance();
+        }
+
+        std::pair<uint64_t, T &> operator*() const {
+            return {key, *value};
+        }
+
+        iterator &operator++() {
+            advance();
+            return *this;
+        }
+
+        void operator++(int) {
+            advance();
+        }
+
+        bool operator==(std::default_sentinel_t) const {
+            return owner == nullptr;
+        }
+    };
+
+    iterator begin() requires iterable_traits<Traits> {
+        return iterator(this);
+    }
+
+    std::default_sentinel_t end() const requires iterable_traits<Traits> {
+        return {};
+    }
+
+    // Cursor for scan, which unlike iterator may be resumed after the map changed
+    auto scan_cursor() requires iterable_traits<Traits> {
+        typename Traits::cursor_type cursor;
+        Traits::cursor_begin(map, &cursor);
+        return cursor;
+    }
+
+    // Calls visit(key, value) for the entries of the next count slots or buckets and returns false once the
+    // scan is over. Entries that stay in the map for the whole scan are visited at least once, some may be
+    // visited again after a resize. visit must not change the map.
+    template<typename Visit>
+    bool scan(auto &cursor, size_t count, Visit &&visit) requires iterable_traits<Traits> {
+        void *context = const_cast<void *>(static_cast<const void *>(std::addressof(visit)));
+        return Traits::scan(map, &cursor, count, visit_entry<std::remove_reference_t<Visit>>, context);
+    }
+
+    typename Traits::map_type *native_handle() const {
+        return map;
+    }
+};
+
+template<typename T>
+using sc_map = basic_map<sc_traits, T>;
+
+template<typename T>
+using lp_map = basic_map<lp_traits, T>;
+
+template<typename T>
+using qp_map = basic_map<qp_traits, T>;
+
+template<typename T>
+using dh_map = basic_map<dh_traits, T>;
+
+template<typename T>
+using sw_map = basic_map<sw_traits, T>;
+
+template<typename T>
+using ch_map = basic_map<ch_traits, T>;
+
+template<typename T>
+using hs_map = basic_map<hs_traits, T>;
+
+template<typename T>
+using csc_map = basic_map<csc_traits, T>;
+
+template<typename T>
+using clp_map = basic_map<clp_traits, T>;
+
+template<typename T>
+using sharded_map = basic_map<sharded_traits, T>;
+
+} // namespace hashmaps
+
+#endif // HASHMAPS_HASHMAP_HPP
@@ -0,0 +1,236 @@
+#include "hashmap_allocator.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+#define ARENA_ALIGNMENT 16
+// Below this writing zeros is cheaper than returning the pages and faulting them back in
+#define RELEASE_PAGES_MIN_SIZE ((size_t) 4 * 1024 * 1024)
+
+static void *libc_alloc(void *context, size_t size) {
+    return malloc(size);
+}
+
+static void *libc_alloc_zeroed(void *context, size_t size) {
+    return calloc(1, size);
+}
+
+static void *libc_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    return realloc(ptr, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    free(ptr);
+}
+
+const struct hashmap_allocator hashmap_libc_allocator = {
+        .alloc = libc_alloc,
+        .alloc_zeroed = libc_alloc_zeroed,
+        .realloc = libc_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
+static inline size_t huge_pages_size(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+// Anonymous mappings are zeroed by the kernel.
+static void *huge_page_map(size_t size) {
+    size_t mapped_size = huge_pages_size(size);
+    // One more huge page is mapped to cut an aligned range out of it
+    unsigned char *ptr = mmap(NULL, mapped_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+
+    size_t head = (HUGE_PAGE_SIZE - (uintptr_t) ptr % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (head != 0) {
+        munmap(ptr, head);
+    }
+    munmap(ptr + head + mapped_size, HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(ptr + head, mapped_size, MADV_HUGEPAGE);
+#endif
+    return ptr + head;
+}
+
+static void *huge_page_alloc(void *context, size_t size) {
+    return size < HUGE_PAGE_SIZE ? malloc(size) : huge_page_map(size);
+}
+
+static void *huge_page_alloc_zeroed(void *context, size_t size) {
+    return size < HUGE_PAGE_SIZE ? calloc(1, size) : huge_page_map(size);
+}
+
+static void huge_page_free(void *context, void *ptr, size_t size) {
+    if (size < HUGE_PAGE_SIZE) {
+        free(ptr);
+    } else if (ptr != NULL) {
+        munmap(ptr, huge_pages_size(size));
+    }
+}
+
+static void *huge_page_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (old_size < HUGE_PAGE_SIZE && new_size < HUGE_PAGE_SIZE) {
+        return realloc(ptr, new_size);
+    }
+    // A block shrunk under a huge page is freed by its new size, so it must move to malloc
+    if (old_size >= HUGE_PAGE_SIZE && new_size >= HUGE_PAGE_SIZE &&
+        huge_pages_size(old_size) == huge_pages_size(new_size)) {
+        return ptr;
+    }
+
+    void *new_ptr = huge_page_alloc(context, new_size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    huge_page_free(context, ptr, old_size);
+    return new_ptr;
+}
+
+const struct hashmap_allocator hashmap_huge_page_allocator = {
+        .alloc = huge_page_alloc,
+        .alloc_zeroed = huge_page_alloc_zeroed,
+        .realloc = huge_page_realloc,
+        .free = huge_page_free,
+        .context = NULL
+};
+
+void hashmap_allocator_zero(const struct hashmap_allocator *const allocator, void *ptr, size_t size) {
+    // Only the memory of these two is known to be private anonymous pages, which read as zeros
+    // after MADV_DONTNEED. A file or shared mapping behind another allocator would keep its data.
+    bool anonymous = allocator->alloc == libc_alloc || allocator->alloc == huge_page_alloc;
+    if (!anonymous || size < RELEASE_PAGES_MIN_SIZE) {
+        memset(ptr, 0, size);
+        return;
+    }
+
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    unsigned char *begin = ptr;
+    unsigned char *end = begin + size;
+    unsigned char *pages_begin = (unsigned char *) (((uintptr_t) begin + page_size - 1) & ~(uintptr_t) (page_size - 1));
+    unsigned char *pages_end = (unsigned char *) ((uintptr_t) end & ~(uintptr_t) (page_size - 1));
+    memset(begin, 0, pages_begin - begin);
+    if (madvise(pages_begin, pages_end - pages_begin, MADV_DONTNEED) != 0) {
+        memset(pages_begin, 0, pages_end - pages_begin);
+    }
+    memset(pages_end, 0, end - pages_end);
+}
+
+struct chunk {
+    struct chunk *previous;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) unsigned char memory[];
+};
+
+struct hashmap_arena {
+    size_t chunk_size;
+    struct chunk *chunk;
+    // The latest allocation can grow and shrink in place
+    void *last;
+};
+
+static inline size_t arena_aligned(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+static void *arena_alloc(void *context, size_t size) {
+    struct hashmap_arena *arena = context;
+    size = arena_aligned(size);
+    struct chunk *chunk = arena->chunk;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        chunk = malloc(sizeof(struct chunk) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->previous = arena->chunk;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->chunk = chunk;
+    }
+
+    arena->last = chunk->memory + chunk->used;
+    chunk->used += size;
+    return arena->last;
+}
+
+static void *arena_alloc_zeroed(void *context, size_t size) {
+    void *ptr = arena_alloc(context, size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void *arena_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    struct hashmap_arena *arena = context;
+    struct chunk *chunk = arena->chunk;
+    if (ptr != NULL && ptr == arena->last) {
+        size_t offset = (unsigned char *) ptr - chunk->memory;
+        if (chunk->size - offset >= arena_aligned(new_size)) {
+            chunk->used = offset + arena_aligned(new_size);
+            return ptr;
+        }
+    }
+
+    void *new_ptr = arena_alloc(context, new_size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    if (ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+static void arena_free(void *context, void *ptr, size_t size) {
+    struct hashmap_arena *arena = context;
+    if (ptr != NULL && ptr == arena->last) {
+        arena->chunk->used = (unsigned char *) ptr - arena->chunk->memory;
+        arena->last = NULL;
+    }
+}
+
+struct hashmap_arena *hashmap_arena_new(size_t chunk_size) {
+    struct hashmap_arena *arena = malloc(sizeof(struct hashmap_arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->chunk_size = chunk_size;
+    arena->chunk = NULL;
+    arena->last = NULL;
+
+    return arena;
+}
+
+struct hashmap_allocator hashmap_arena_allocator(struct hashmap_arena *arena) {
+    return (struct hashmap_allocator) {
+            .alloc = arena_alloc,
+            .alloc_zeroed = arena_alloc_zeroed,
+            .realloc = arena_realloc,
+            .free = arena_free,
+            .context = arena
+    };
+}
+
+void hashmap_arena_free(struct hashmap_arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    while (arena->chunk != NULL) {
+        struct chunk *previous = arena->chunk->previous;
+        free(arena->chunk);
+        arena->chunk = previous;
+    }
+    free(arena);
+}
@@ -0,0 +1,44 @@
+#ifndef HASHMAPS_HASHMAP_ALLOCATOR_H
+#define HASHMAPS_HASHMAP_ALLOCATOR_H
+
+#include <stddef.h>
+
+// Memory source of a map. Every call gets the context back, and free and realloc also get
+// the size the memory was allocated with. Allocation failures are reported with NULL.
+struct hashmap_allocator {
+    void *(*alloc)(void *context, size_t size);
+
+    // Same as alloc, but the memory is zeroed.
+    void *(*alloc_zeroed)(void *context, size_t size);
+
+    void *(*realloc)(void *context, void *ptr, size_t old_size, size_t new_size);
+
+    void (*free)(void *context, void *ptr, size_t size);
+
+    void *context;
+};
+
+// malloc and friends. Maps use it when no allocator is given.
+extern const struct hashmap_allocator hashmap_libc_allocator;
+
+// Allocations of 2 MiB and more are mapped on their own, aligned to 2 MiB and advised to be backed
+// by transparent huge pages, which cuts TLB misses on big slot arrays. Smaller ones go to malloc.
+extern const struct hashmap_allocator hashmap_huge_page_allocator;
+
+// Zeroes size bytes at ptr that came from allocator. Whole pages of big blocks from the libc and
+// huge page allocators are given back to the kernel instead, and read as zeros when touched again.
+void hashmap_allocator_zero(const struct hashmap_allocator *allocator, void *ptr, size_t size);
+
+struct hashmap_arena;
+
+// Bump allocator that hands out memory from chunks of chunk_size bytes or more and returns it
+// all at once in hashmap_arena_free. Freed memory is not reused, so it suits maps that are
+// filled once and then mostly read, like the bucket buffers of a separate chaining map.
+struct hashmap_arena *hashmap_arena_new(size_t chunk_size);
+
+// The arena must outlive every map that uses the returned allocator.
+struct hashmap_allocator hashmap_arena_allocator(struct hashmap_arena *arena);
+
+void hashmap_arena_free(struct hashmap_arena *arena);
+
+#endif // HASHMAPS_HASHMAP_ALLOCATOR_H
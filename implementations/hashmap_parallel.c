@@ -0,0 +1,51 @@
+#include "hashmap_parallel.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define RANGE_ALIGNMENT 64
+
+struct range {
+    void (*body)(void *context, uint64_t begin, uint64_t end);
+    void *context;
+    uint64_t begin;
+    uint64_t end;
+    pthread_t thread;
+    bool started;
+};
+
+static void *range_run(void *arg) {
+    struct range *range = arg;
+    range->body(range->context, range->begin, range->end);
+    return NULL;
+}
+
+void hashmap_parallel_for(size_t threads_count, uint64_t count,
+                          void (*body)(void *context, uint64_t begin, uint64_t end), void *context) {
+    uint64_t step = threads_count <= 1 ? count : (count / threads_count + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT *
+                                                 RANGE_ALIGNMENT;
+    size_t ranges_count = step == 0 ? 0 : (count + step - 1) / step;
+    // The bookkeeping is a few bytes per thread, so it doesn't go through the allocator of the map
+    struct range *ranges = ranges_count > 1 ? malloc(ranges_count * sizeof(struct range)) : NULL;
+    if (ranges == NULL) {
+        body(context, 0, count);
+        return;
+    }
+
+    for (size_t i = 0; i < ranges_count; ++i) {
+        ranges[i] = (struct range) {.body = body, .context = context, .begin = i * step,
+                                    .end = (i + 1) * step < count ? (i + 1) * step : count};
+        if (i > 0) {
+            ranges[i].started = pthread_create(&ranges[i].thread, NULL, range_run, ranges + i) == 0;
+        }
+    }
+    range_run(ranges);
+    for (size_t i = 1; i < ranges_count; ++i) {
+        if (ranges[i].started) {
+            pthread_join(ranges[i].thread, NULL);
+        } else {
+            range_run(ranges + i);
+        }
+    }
+    free(ranges);
+}
@@ -0,0 +1,14 @@
+#ifndef HASHMAPS_HASHMAP_PARALLEL_H
+#define HASHMAPS_HASHMAP_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Splits [0, count) into up to threads_count ranges of about the same size and calls body on each
+// of them, one range in the calling thread and the others in threads started for the call. Returns
+// once every range is done. Ranges start at multiples of 64, so threads that write byte arrays
+// don't share cache lines. A range whose thread can't be started runs in the calling thread.
+void hashmap_parallel_for(size_t threads_count, uint64_t count,
+                          void (*body)(void *context, uint64_t begin, uint64_t end), void *context);
+
+#endif // HASHMAPS_HASHMAP_PARALLEL_H
@@ -0,0 +1,91 @@
+#include "hashmap_snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARRAY_ALIGNMENT 8
+
+static bool write_all(int fd, const void *data, uint64_t size) {
+    const unsigned char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= (uint64_t) written;
+    }
+    return true;
+}
+
+bool hashmap_snapshot_write(int fd, struct hashmap_snapshot_header *header, const void *const *arrays,
+                            const uint64_t *sizes) {
+    static const unsigned char padding[ARRAY_ALIGNMENT] = {0};
+
+    header->magic = HASHMAP_SNAPSHOT_MAGIC;
+    header->version = HASHMAP_SNAPSHOT_VERSION;
+    uint64_t offset = sizeof(struct hashmap_snapshot_header);
+    for (size_t i = 0; i < header->arrays_count; ++i) {
+        header->arrays[i].offset = offset;
+        header->arrays[i].size = sizes[i];
+        offset = (offset + sizes[i] + ARRAY_ALIGNMENT - 1) & ~(uint64_t) (ARRAY_ALIGNMENT - 1);
+    }
+
+    if (!write_all(fd, header, sizeof(struct hashmap_snapshot_header))) {
+        return false;
+    }
+    for (size_t i = 0; i < header->arrays_count; ++i) {
+        uint64_t padded = (sizes[i] + ARRAY_ALIGNMENT - 1) & ~(uint64_t) (ARRAY_ALIGNMENT - 1);
+        if (!write_all(fd, arrays[i], sizes[i]) || !write_all(fd, padding, padded - sizes[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool header_valid(const struct hashmap_snapshot_header *header, uint64_t kind, uint64_t size) {
+    if (header->magic != HASHMAP_SNAPSHOT_MAGIC || header->version != HASHMAP_SNAPSHOT_VERSION ||
+        header->kind != kind || header->arrays_count > HASHMAP_SNAPSHOT_MAX_ARRAYS) {
+        return false;
+    }
+    for (size_t i = 0; i < header->arrays_count; ++i) {
+        const struct hashmap_snapshot_array *array = header->arrays + i;
+        if (array->offset % ARRAY_ALIGNMENT != 0 || array->offset > size || array->size > size - array->offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const struct hashmap_snapshot_header *hashmap_snapshot_map(const char *path, uint64_t kind, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (uint64_t) status.st_size < sizeof(struct hashmap_snapshot_header)) {
+        close(fd);
+        return NULL;
+    }
+    // The mapping outlives the descriptor
+    void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    if (!header_valid(mapping, kind, status.st_size)) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+    *size = status.st_size;
+    return mapping;
+}
+
+void hashmap_snapshot_unmap(const struct hashmap_snapshot_header *header, size_t size) {
+    munmap((void *) header, size);
+}
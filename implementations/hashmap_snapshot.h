@@ -0,0 +1,62 @@
+#ifndef HASHMAPS_HASHMAP_SNAPSHOT_H
+#define HASHMAPS_HASHMAP_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// "hashsnap" read as a little-endian number, so a file of the other byte order doesn't match
+#define HASHMAP_SNAPSHOT_MAGIC UINT64_C(0x70616e7368736168)
+#define HASHMAP_SNAPSHOT_VERSION 1
+#define HASHMAP_SNAPSHOT_MAX_ARRAYS 3
+// Saved maps keep what their hashers return for this key, so a file opened with other hashers is rejected
+#define HASHMAP_SNAPSHOT_PROBE_KEY UINT64_C(0x9e3779b97f4a7c15)
+
+enum hashmap_snapshot_kind {
+    hashmap_snapshot_lp = 1,
+    hashmap_snapshot_qp,
+    hashmap_snapshot_dh
+};
+
+struct hashmap_snapshot_array {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// A snapshot file is this header followed by the arrays it points to. Every field is 64 bits wide and
+// every array starts at a multiple of 8 bytes from the start of the file, so the file is mapped into
+// memory and read in place, wherever it lands.
+struct hashmap_snapshot_header {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t kind;
+    uint64_t hasher_checks[2];
+    uint64_t entries_count;
+    uint64_t slots_count;
+    uint64_t distance_limit;
+    uint64_t value_size;
+    uint64_t value_stride;
+    uint64_t flags;
+    // Status bytes of the generation the slots were saved in
+    uint64_t occupied;
+    uint64_t released;
+    uint64_t arrays_count;
+    struct hashmap_snapshot_array arrays[HASHMAP_SNAPSHOT_MAX_ARRAYS];
+};
+
+// Fills in magic, version and the arrays of the header, then writes it and header->arrays_count arrays of the
+// given sizes to fd. Returns false when writing fails.
+bool hashmap_snapshot_write(int fd, struct hashmap_snapshot_header *header, const void *const *arrays,
+                            const uint64_t *sizes);
+
+// Maps the file at path read-only and checks that it is a snapshot of this kind whose arrays lie within it.
+// Returns the header at the start of the mapping and stores the mapping size, or returns NULL.
+const struct hashmap_snapshot_header *hashmap_snapshot_map(const char *path, uint64_t kind, size_t *size);
+
+static inline const void *hashmap_snapshot_array(const struct hashmap_snapshot_header *header, size_t i) {
+    return (const unsigned char *) header + header->arrays[i].offset;
+}
+
+void hashmap_snapshot_unmap(const struct hashmap_snapshot_header *header, size_t size);
+
+#endif // HASHMAPS_HASHMAP_SNAPSHOT_H
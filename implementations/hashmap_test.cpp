@@ -0,0 +1,214 @@
+#include "minunit.h"
+#include "hashmap.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+int tests_run = 0;
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static uint64_t hasher2(uint64_t x) {
+    return (hasher(x) << 2) + 1;
+}
+
+struct point {
+    int32_t x;
+    int32_t y;
+
+    point(int32_t x, int32_t y) : x(x), y(y) {}
+};
+
+// Counts live instances, so values the map drops or replaces are checked to be destroyed
+struct tracked {
+    static inline int alive = 0;
+    uint64_t value;
+
+    explicit tracked(uint64_t value) : value(value) {
+        alive++;
+    }
+
+    tracked(tracked &&other) noexcept: value(other.value) {
+        alive++;
+    }
+
+    tracked(const tracked &) = delete;
+
+    ~tracked() {
+        alive--;
+    }
+};
+
+static const char *test_inline_values() {
+    static_assert(hashmaps::lp_map<point>::inline_values);
+    static_assert(!hashmaps::sw_map<point>::inline_values);
+
+    hashmaps::lp_map<point> map(hasher);
+    for (int32_t i = 0; i < 10000; ++i) {
+        mu_assert("error, inline map must take new keys", map.emplace(i, i, -i));
+    }
+    for (int32_t i = 0; i < 10000; ++i) {
+        point *found = map.find(i);
+        mu_assert("error, all inserted values must be found", found != nullptr && found->x == i && found->y == -i);
+    }
+    mu_assert("error, insert must replace the value", map.insert(5, point(0, 0)) && map.find(5)->x == 0);
+    mu_assert("error, deleted key mustn't be found", map.erase(5) && !map.contains(5));
+    mu_assert("error, absent key mustn't be deleted", !map.erase(5));
+
+    return nullptr;
+}
+
+static const char *test_move_only() {
+    {
+        hashmaps::sc_map<std::unique_ptr<tracked>> map(hasher);
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map.insert(i, std::make_unique<tracked>(i));
+        }
+        mu_assert("error, every value must be alive", tracked::alive == 1000);
+        map.insert(7, std::make_unique<tracked>(70));
+        mu_assert("error, replaced value must be destroyed", tracked::alive == 1000 && (*map.find(7))->value == 70);
+        map.erase(8);
+        mu_assert("error, deleted value must be destroyed", tracked::alive == 999);
+    }
+    mu_assert("error, map must destroy its values", tracked::alive == 0);
+
+    {
+        hashmaps::hs_map<tracked> map(hasher);
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map.emplace(i, i);
+        }
+        mu_assert("error, emplaced values must be found", map.find(999)->value == 999);
+        map.clear();
+        mu_assert("error, clear must destroy the values", tracked::alive == 0 && map.find(999) == nullptr);
+    }
+
+    return nullptr;
+}
+
+static const char *test_emplace() {
+    hashmaps::dh_map<std::string> map(hasher, hasher2);
+    map.emplace(1, 5, 'x');
+    map.emplace(2, "two");
+    std::string three = "three";
+    map.insert(3, three);
+    mu_assert("error, values must be constructed from the arguments",
+              *map.find(1) == "xxxxx" && *map.find(2) == "two" && *map.find(3) == "three");
+
+    return nullptr;
+}
+
+static const char *test_batches() {
+    std::vector<uint64_t> keys(1000), values(1000);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        keys[i] = i;
+        values[i] = i + 1;
+    }
+    std::vector<uint64_t *> out(1000);
+
+    hashmaps::qp_map<uint64_t> map(hasher);
+    mu_assert("error, batch must be inserted", map.insert_batch(keys.data(), values.data(), keys.size()));
+    map.find_batch(keys.data(), keys.size(), out.data());
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, batch must find every key", out[i] != nullptr && *out[i] == i + 1);
+    }
+
+    // The concurrent maps have no batches, so they are looped over
+    hashmaps::csc_map<uint64_t> concurrent(hasher);
+    mu_assert("error, batch must be inserted", concurrent.insert_batch(keys.data(), values.data(), keys.size()));
+    concurrent.find_batch(keys.data(), keys.size(), out.data());
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, batch must find every key", out[i] != nullptr && *out[i] == i + 1);
+    }
+
+    return nullptr;
+}
+
+static const char *test_ownership() {
+    hashmaps::ch_map<tracked> map(hasher, hasher2);
+    map.emplace(1, 1);
+    hashmaps::ch_map<tracked> moved(std::move(map));
+    mu_assert("error, moved map must keep the entries", moved.find(1)->value == 1 && map.native_handle() == nullptr);
+    hashmaps::ch_map<tracked> assigned(hasher, hasher2);
+    assigned.emplace(2, 2);
+    assigned = std::move(moved);
+    mu_assert("error, assigned map must drop its own entries", tracked::alive == 1 && assigned.find(1) != nullptr);
+
+    bool thrown = false;
+    try {
+        hashmaps::lp_map<uint64_t> invalid(hasher, {.max_load_factor = 100});
+    } catch (const std::bad_alloc &) {
+        thrown = true;
+    }
+    mu_assert("error, map with options out of range mustn't be constructed", thrown);
+
+    return nullptr;
+}
+
+static const char *test_iteration() {
+    hashmaps::lp_map<point> map(hasher);
+    for (int32_t i = 0; i < 1000; ++i) {
+        map.emplace(i, i, -i);
+    }
+    std::vector<int> visits(1000);
+    for (auto [key, value]: map) {
+        mu_assert("error, iteration must return the inserted entries", key < 1000 && value.y == -value.x);
+        value.x = 0;
+        visits[key]++;
+    }
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, iteration must return every entry once", visits[i] == 1 && map.find(i)->x == 0);
+    }
+
+    // Keys below 1000 stay while the scan grows the table
+    hashmaps::sc_map<std::string> strings(hasher);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        strings.emplace(i, std::to_string(i));
+    }
+    std::vector<int> scanned(5000);
+    auto cursor = strings.scan_cursor();
+    uint64_t inserted = 1000;
+    while (strings.scan(cursor, 4, [&](uint64_t key, std::string &value) {
+        if (value == std::to_string(key)) {
+            scanned[key]++;
+        }
+    })) {
+        for (int i = 0; i < 5 && inserted < 5000; ++i, ++inserted) {
+            strings.emplace(inserted, std::to_string(inserted));
+        }
+    }
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, scan must visit every entry kept during it", scanned[i] >= 1);
+    }
+
+    return nullptr;
+}
+
+static const char *all_tests() {
+    mu_run_test(test_inline_values);
+    mu_run_test(test_move_only);
+    mu_run_test(test_emplace);
+    mu_run_test(test_batches);
+    mu_run_test(test_ownership);
+    mu_run_test(test_iteration);
+
+    return nullptr;
+}
+
+int main() {
+    const char *result = all_tests();
+    if (result != nullptr) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != nullptr;
+}
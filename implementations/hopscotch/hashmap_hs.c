@@ -0,0 +1,378 @@
+#include "hashmap_hs.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LOAD_FACTOR 90
+// Slots from the home one a key may be kept in, one bit of the hop bitmap each
+#define NEIGHBOURHOOD 32
+// Not less than a neighbourhood, so neighbourhoods never wrap onto themselves
+#define INITIAL_SLOTS_COUNT 32
+// Doublings an insert tries before it blames the hasher
+#define MAX_REHASHES 4
+#define BATCH_WIDTH 16
+
+// Key 0 marks a vacant slot. The hop bitmap is kept next to the entry, so a lookup reads it from the line of
+// the home slot, which also holds the key that is most often looked for, and the slots it points to come after.
+struct slot {
+    uint64_t key;
+    void *value;
+    // Bit i is set when the slot i places further keeps a key whose home slot is this one
+    uint32_t hops;
+};
+
+struct table {
+    struct slot *slots;
+    uint64_t slots_count;
+};
+
+struct hashmap_hs {
+    uint64_t entries_count;
+    struct table table;
+    // Key 0 can't be put into a slot, so its entry is kept aside
+    bool zero_key_present;
+    void *zero_key_value;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static inline uint64_t home_slot(const struct hashmap_hs *const self, uint64_t key, uint64_t slots_count) {
+    return self->hasher(key) & (slots_count - 1);
+}
+
+static inline void value_release(const struct hashmap_hs *const self, void *value) {
+    if (self->value_free != NULL) {
+        self->value_free(value);
+    }
+}
+
+// Smallest power of two slots count that keeps entries_count entries under the load factor,
+// but not less than the initial one.
+static uint64_t slots_count_for(uint64_t entries_count) {
+    uint64_t slots_count = INITIAL_SLOTS_COUNT;
+    while (100 * entries_count > MAX_LOAD_FACTOR * slots_count) {
+        slots_count *= 2;
+    }
+    return slots_count;
+}
+
+static void table_free(const struct hashmap_hs *const self, struct table *const table) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    allocator->free(allocator->context, table->slots, table->slots_count * sizeof(struct slot));
+}
+
+static bool table_new(const struct hashmap_hs *const self, struct table *const table, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    table->slots = allocator->alloc_zeroed(allocator->context, slots_count * sizeof(struct slot));
+    if (table->slots == NULL) {
+        return false;
+    }
+    table->slots_count = slots_count;
+    return true;
+}
+
+// Puts the key and value of an entry of an absent key into the neighbourhood of its home slot. The nearest vacant slot
+// is hopped back towards the home one by moving entries that stay in their own neighbourhoods into it.
+// Returns false when the vacant slot can't get into the neighbourhood, the moves made are valid anyway.
+static bool place(const struct hashmap_hs *const self, struct table *const table, struct slot entry) {
+    uint64_t mask = table->slots_count - 1;
+    uint64_t home = home_slot(self, entry.key, table->slots_count);
+    uint64_t distance = 0;
+    while (table->slots[(home + distance) & mask].key != 0) {
+        if (++distance == table->slots_count) {
+            return false;
+        }
+    }
+
+    while (distance >= NEIGHBOURHOOD) {
+        uint64_t vacant = (home + distance) & mask;
+        uint64_t hopped = 0;
+        // The farthest home slot goes first, as its entries move the vacant slot back the most
+        for (uint64_t back = NEIGHBOURHOOD - 1; back > 0 && hopped == 0; --back) {
+            uint64_t owner = (vacant - back) & mask;
+            uint32_t before_vacant = table->slots[owner].hops & (((uint32_t) 1 << back) - 1);
+            if (before_vacant != 0) {
+                uint64_t offset = __builtin_ctz(before_vacant);
+                uint64_t moved = (owner + offset) & mask;
+                table->slots[vacant].key = table->slots[moved].key;
+                table->slots[vacant].value = table->slots[moved].value;
+                table->slots[moved].key = 0;
+                table->slots[owner].hops ^= ((uint32_t) 1 << offset) | ((uint32_t) 1 << back);
+                hopped = back - offset;
+            }
+        }
+        if (hopped == 0) {
+            return false;
+        }
+        distance -= hopped;
+    }
+
+    table->slots[(home + distance) & mask].key = entry.key;
+    table->slots[(home + distance) & mask].value = entry.value;
+    table->slots[home].hops |= (uint32_t) 1 << distance;
+    return true;
+}
+
+// Returns false when some entry found no place in the new table.
+static bool rehash_into(const struct hashmap_hs *const self, struct table *const table) {
+    const struct table *old_table = &self->table;
+    for (size_t i = 0; i < old_table->slots_count; ++i) {
+        if (old_table->slots[i].key != 0 && !place(self, table, old_table->slots[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rehashes the entries into a table of slots_count slots, doubling it while some entry doesn't fit.
+// Leaves the map as it was when there is no memory or the hasher keeps too many keys together.
+static bool resize_map(struct hashmap_hs *const self, uint64_t slots_count) {
+    for (size_t i = 0; i < MAX_REHASHES; ++i, slots_count *= 2) {
+        struct table table;
+        if (!table_new(self, &table, slots_count)) {
+            return false;
+        }
+        if (rehash_into(self, &table)) {
+            table_free(self, &self->table);
+            self->table = table;
+            return true;
+        }
+        table_free(self, &table);
+    }
+    return false;
+}
+
+// Returns the slot of the key. Only the slots the hop bitmap of the home slot points to are read.
+static struct slot *find_in(struct hashmap_hs *const self, uint64_t key, uint64_t home) {
+    uint64_t mask = self->table.slots_count - 1;
+    for (uint32_t hops = self->table.slots[home].hops; hops != 0; hops &= hops - 1) {
+        struct slot *slot = self->table.slots + ((home + __builtin_ctz(hops)) & mask);
+        if (slot->key == key) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void **find_value(struct hashmap_hs *const self, uint64_t key) {
+    if (key == 0) {
+        return self->zero_key_present ? &self->zero_key_value : NULL;
+    }
+    struct slot *slot = find_in(self, key, home_slot(self, key, self->table.slots_count));
+    return slot == NULL ? NULL : &slot->value;
+}
+
+static void release_values(struct hashmap_hs *const self) {
+    if (self->value_free == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < self->table.slots_count; ++i) {
+        if (self->table.slots[i].key != 0) {
+            self->value_free(self->table.slots[i].value);
+        }
+    }
+    if (self->zero_key_present) {
+        self->value_free(self->zero_key_value);
+    }
+}
+
+struct hashmap_hs *hashmap_hs_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_hs_new_with_options(hasher, value_free, (struct hashmap_hs_options) {0});
+}
+
+struct hashmap_hs *hashmap_hs_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity) {
+    return hashmap_hs_new_with_options(hasher, value_free, (struct hashmap_hs_options) {.capacity = capacity});
+}
+
+struct hashmap_hs *hashmap_hs_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_hs_options options) {
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_hs *self = allocator->alloc(allocator->context, sizeof(struct hashmap_hs));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    if (!table_new(self, &self->table, slots_count_for(options.capacity))) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_hs));
+        return NULL;
+    }
+    self->entries_count = 0;
+    self->zero_key_present = false;
+    self->hasher = hasher;
+    self->value_free = value_free;
+
+    return self;
+}
+
+struct hashmap_hs *hashmap_hs_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              const uint64_t *keys, void *const *values, size_t n) {
+    struct hashmap_hs *self = hashmap_hs_new_with_capacity(hasher, value_free, n);
+    if (!hashmap_hs_insert_batch(self, keys, values, n)) {
+        hashmap_hs_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+bool hashmap_hs_insert(struct hashmap_hs *const self, uint64_t key, void *value) {
+    if (self == NULL) {
+        return false;
+    }
+
+    void **found = find_value(self, key);
+    if (found != NULL) {
+        value_release(self, *found);
+        *found = value;
+        return true;
+    }
+    if (key == 0) {
+        self->zero_key_present = true;
+        self->zero_key_value = value;
+        self->entries_count++;
+        return true;
+    }
+
+    // Without memory to grow the entry may still find a vacant slot
+    if (100 * (self->entries_count + 1) > MAX_LOAD_FACTOR * self->table.slots_count) {
+        resize_map(self, 2 * self->table.slots_count);
+    }
+    struct slot entry = {.key = key, .value = value};
+    for (size_t i = 0; !place(self, &self->table, entry); ++i) {
+        if (i == MAX_REHASHES || !resize_map(self, 2 * self->table.slots_count)) {
+            return false;
+        }
+    }
+    self->entries_count++;
+    return true;
+}
+
+bool hashmap_hs_insert_batch(struct hashmap_hs *const self, const uint64_t *keys, void *const *values, size_t n) {
+    if (self == NULL) {
+        return false;
+    }
+
+    // One resize up front instead of a doubling every time the load factor is hit
+    if (!hashmap_hs_reserve(self, self->entries_count + n)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!hashmap_hs_insert(self, keys[i], values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void *hashmap_hs_find(struct hashmap_hs *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    void **found = find_value(self, key);
+    return found == NULL ? NULL : *found;
+}
+
+// Keys are resolved in groups of BATCH_WIDTH: the whole group is hashed and the home slot of every key,
+// with its hop bitmap, is prefetched before the first lookup, so the cache misses of the group overlap.
+void hashmap_hs_find_batch(struct hashmap_hs *const self, const uint64_t *keys, size_t n, void **out) {
+    if (self == NULL) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = NULL;
+        }
+        return;
+    }
+
+    uint64_t homes[BATCH_WIDTH];
+    uint64_t slots_count = self->table.slots_count;
+    for (size_t start = 0; start < n; start += BATCH_WIDTH) {
+        size_t width = n - start < BATCH_WIDTH ? n - start : BATCH_WIDTH;
+        for (size_t i = 0; i < width; ++i) {
+            homes[i] = home_slot(self, keys[start + i], slots_count);
+            __builtin_prefetch(self->table.slots + homes[i]);
+        }
+        for (size_t i = 0; i < width; ++i) {
+            if (keys[start + i] == 0) {
+                out[start + i] = self->zero_key_present ? self->zero_key_value : NULL;
+                continue;
+            }
+            struct slot *slot = find_in(self, keys[start + i], homes[i]);
+            out[start + i] = slot == NULL ? NULL : slot->value;
+        }
+    }
+}
+
+bool hashmap_hs_delete(struct hashmap_hs *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    if (key == 0) {
+        if (!self->zero_key_present) {
+            return false;
+        }
+        value_release(self, self->zero_key_value);
+        self->zero_key_present = false;
+        self->entries_count--;
+        return true;
+    }
+
+    uint64_t home = home_slot(self, key, self->table.slots_count);
+    struct slot *slot = find_in(self, key, home);
+    if (slot == NULL) {
+        return false;
+    }
+    value_release(self, slot->value);
+    slot->key = 0;
+    uint64_t distance = ((uint64_t) (slot - self->table.slots) - home) & (self->table.slots_count - 1);
+    self->table.slots[home].hops &= ~((uint32_t) 1 << distance);
+    self->entries_count--;
+    return true;
+}
+
+bool hashmap_hs_reserve(struct hashmap_hs *const self, size_t capacity) {
+    if (self == NULL) {
+        return false;
+    }
+
+    uint64_t slots_count = slots_count_for(capacity);
+    return slots_count <= self->table.slots_count || resize_map(self, slots_count);
+}
+
+void hashmap_hs_shrink_to_fit(struct hashmap_hs *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    // If there is no memory for the rehash, the map just stays as it is
+    uint64_t slots_count = slots_count_for(self->entries_count);
+    if (slots_count < self->table.slots_count) {
+        resize_map(self, slots_count);
+    }
+}
+
+void hashmap_hs_clear(struct hashmap_hs *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    release_values(self);
+    hashmap_allocator_zero(&self->allocator, self->table.slots, self->table.slots_count * sizeof(struct slot));
+    self->zero_key_present = false;
+    self->entries_count = 0;
+}
+
+void hashmap_hs_free(struct hashmap_hs *const self) {
+    if (self == NULL) {
+        return;
+    }
+    release_values(self);
+    table_free(self, &self->table);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_hs));
+}
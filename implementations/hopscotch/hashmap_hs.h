@@ -0,0 +1,60 @@
+#ifndef HASHMAPS_HASHMAP_HS_H
+#define HASHMAPS_HASHMAP_HS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+// Hopscotch hashing map. Every key is kept within 32 slots from its home slot, and the home slot has
+// a bitmap of which of them hold its keys. A lookup reads the bitmap and only the slots it points to,
+// which are usually on the same one or two cache lines, so the table stays fast filled up to 90%.
+struct hashmap_hs;
+
+struct hashmap_hs_options {
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Where the slots and the map itself are allocated. NULL means malloc and free.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map, and inserts return false when there is no memory to grow it
+// or the hasher puts more than 32 keys into the same home slot.
+struct hashmap_hs *hashmap_hs_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
+
+// The map takes capacity entries without resizing.
+struct hashmap_hs *hashmap_hs_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity);
+
+struct hashmap_hs *hashmap_hs_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_hs_options options);
+
+// Builds a map from n entries, sized for all of them up front.
+struct hashmap_hs *hashmap_hs_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              const uint64_t *keys, void *const *values, size_t n);
+
+bool hashmap_hs_insert(struct hashmap_hs *self, uint64_t key, void *value);
+
+// Inserts n entries into a map sized for all of them up front, values[i] is passed as to hashmap_hs_insert.
+bool hashmap_hs_insert_batch(struct hashmap_hs *self, const uint64_t *keys, void *const *values, size_t n);
+
+void *hashmap_hs_find(struct hashmap_hs *self, uint64_t key);
+
+// Looks up n keys at once, out[i] gets what hashmap_hs_find would return for keys[i].
+void hashmap_hs_find_batch(struct hashmap_hs *self, const uint64_t *keys, size_t n, void **out);
+
+bool hashmap_hs_delete(struct hashmap_hs *self, uint64_t key);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger table.
+bool hashmap_hs_reserve(struct hashmap_hs *self, size_t capacity);
+
+// Rehashes the entries into the smallest table that holds them.
+void hashmap_hs_shrink_to_fit(struct hashmap_hs *self);
+
+void hashmap_hs_clear(struct hashmap_hs *self);
+
+void hashmap_hs_free(struct hashmap_hs *self);
+
+#endif // HASHMAPS_HASHMAP_HS_H
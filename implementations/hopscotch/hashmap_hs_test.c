@@ -0,0 +1,441 @@
+#include "../minunit.h"
+#include "hashmap_hs.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NEIGHBOURHOOD 32
+
+struct slot {
+    uint64_t key;
+    void *value;
+    uint32_t hops;
+};
+
+struct table {
+    struct slot *slots;
+    uint64_t slots_count;
+};
+
+struct hashmap_hs {
+    uint64_t entries_count;
+    struct table table;
+    bool zero_key_present;
+    void *zero_key_value;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static uint64_t identity_hasher(uint64_t x) {
+    return x;
+}
+
+static uint64_t fake_hasher(uint64_t _) {
+    return 1;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_hs *map = hashmap_hs_new(hasher, free);
+    mu_assert("error, hashmap constructor returned null", map != NULL);
+    mu_assert("error, initial slots count must be equal to 32", map->table.slots_count == 32);
+    mu_assert("error, initial entries count must be equal to 0", map->entries_count == 0);
+    for (size_t i = 0; i < map->table.slots_count; ++i) {
+        mu_assert("error, all slots must be vacant", map->table.slots[i].key == 0 && map->table.slots[i].hops == 0);
+    }
+    hashmap_hs_free(map);
+
+    map = hashmap_hs_new_with_capacity(hasher, free, 1000);
+    mu_assert("error, capacity must fit under the load factor", map->table.slots_count == 2048);
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_inserts() {
+    struct hashmap_hs *map = hashmap_hs_new(fake_hasher, free);
+
+    hashmap_hs_insert(map, 999, make_ptr(5));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+    mu_assert("error, key must be saved in its home slot", map->table.slots[1].key == 999);
+    mu_assert("error, saved incorrect value", *(uint64_t *) map->table.slots[1].value == 5);
+    mu_assert("error, home slot must point to the key", map->table.slots[1].hops == 1);
+
+    hashmap_hs_insert(map, 999, make_ptr(10));
+    mu_assert("error, entries count shouldn't change when saving existent key", map->entries_count == 1);
+    mu_assert("error, value should be changed", *(uint64_t *) map->table.slots[1].value == 10);
+
+    hashmap_hs_insert(map, 1, make_ptr(1));
+    mu_assert("error, key must go to the next vacant slot", map->table.slots[2].key == 1);
+    mu_assert("error, home slot must point to both keys", map->table.slots[1].hops == 3);
+
+    hashmap_hs_insert(map, 0, make_ptr(15));
+    mu_assert("error, key 0 must be kept aside", map->zero_key_present);
+    mu_assert("error, key 0 must be found", *(uint64_t *) hashmap_hs_find(map, 0) == 15);
+    mu_assert("error, entries count must be equal to 3", map->entries_count == 3);
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_finds() {
+    struct hashmap_hs *map = hashmap_hs_new(hasher, free);
+    hashmap_hs_insert(map, 666, make_ptr(5));
+    hashmap_hs_insert(map, 777, make_ptr(10));
+
+    mu_assert("error, map must contain value with key 666", *(uint64_t *) hashmap_hs_find(map, 666) == 5);
+    mu_assert("error, map must contain value with key 777", *(uint64_t *) hashmap_hs_find(map, 777) == 10);
+    mu_assert("error, map shouldn't contain value with key 6666", hashmap_hs_find(map, 6666) == NULL);
+    mu_assert("error, map shouldn't contain value with key 0", hashmap_hs_find(map, 0) == NULL);
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_deletes() {
+    struct hashmap_hs *map = hashmap_hs_new(fake_hasher, leak);
+
+    hashmap_hs_insert(map, 555, NULL);
+    hashmap_hs_insert(map, 777, NULL);
+    hashmap_hs_insert(map, 0, NULL);
+    mu_assert("error, key 555 must be deleted", hashmap_hs_delete(map, 555));
+    mu_assert("error, key 555 already must be deleted", !hashmap_hs_delete(map, 555));
+    mu_assert("error, home slot must point only to the rest key", map->table.slots[1].hops == 2);
+    mu_assert("error, key 888 can't be deleted because the map doesn't contain it", !hashmap_hs_delete(map, 888));
+    mu_assert("error, key 0 must be deleted", hashmap_hs_delete(map, 0));
+    mu_assert("error, key 0 already must be deleted", !hashmap_hs_delete(map, 0));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+    mu_assert("error, rest key must stay in its slot", map->table.slots[2].key == 777);
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_hops() {
+    // With the identity hasher and 2048 slots key k has its home slot at k % 2048
+    struct hashmap_hs *map = hashmap_hs_new_with_capacity(identity_hasher, leak, 1000);
+    for (uint64_t i = 1; i <= 20; ++i) {
+        hashmap_hs_insert(map, 2048 * i, (void *) i);
+    }
+    for (uint64_t key = 20; key <= 50; ++key) {
+        hashmap_hs_insert(map, key, (void *) key);
+    }
+
+    // Slot 51 is too far from slot 0, so key 20 hops there from its home slot and gives up slot 20
+    hashmap_hs_insert(map, 2048 * 21, (void *) 21);
+    mu_assert("error, key must hop to the end of its neighbourhood", map->table.slots[51].key == 20);
+    mu_assert("error, hop bitmap must follow the hopped key", map->table.slots[20].hops == (uint32_t) 1 << 31);
+    mu_assert("error, new key must take the freed slot", map->table.slots[20].key == 2048 * 21);
+    mu_assert("error, hop bitmap must point to all keys of the home slot", map->table.slots[0].hops == 0x1fffff);
+    for (uint64_t i = 1; i <= 21; ++i) {
+        mu_assert("error, keys of slot 0 must be found", hashmap_hs_find(map, 2048 * i) == (void *) i);
+    }
+    for (uint64_t key = 20; key <= 50; ++key) {
+        mu_assert("error, keys of their own home slots must be found", hashmap_hs_find(map, key) == (void *) key);
+    }
+    mu_assert("error, map mustn't grow to place the key", map->table.slots_count == 2048);
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_full_neighbourhood() {
+    struct hashmap_hs *map = hashmap_hs_new(fake_hasher, leak);
+    for (uint64_t key = 1; key <= NEIGHBOURHOOD; ++key) {
+        mu_assert("error, key must fit into the neighbourhood", hashmap_hs_insert(map, key, (void *) key));
+    }
+    mu_assert("error, neighbourhood must be full", map->table.slots[1].hops == UINT32_MAX);
+
+    // Growing doesn't spread keys that always hash the same, so the map gives up
+    mu_assert("error, key must be rejected when there is no place for it", !hashmap_hs_insert(map, 100, (void *) 100));
+    mu_assert("error, entries count mustn't change", map->entries_count == NEIGHBOURHOOD);
+    mu_assert("error, rejected key mustn't be found", hashmap_hs_find(map, 100) == NULL);
+    for (uint64_t key = 1; key <= NEIGHBOURHOOD; ++key) {
+        mu_assert("error, keys must stay in place after a rejected insert", hashmap_hs_find(map, key) == (void *) key);
+    }
+    mu_assert("error, existing key must be replaced", hashmap_hs_insert(map, 1, (void *) 1));
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_resizes() {
+    struct hashmap_hs *map = hashmap_hs_new(hasher, leak);
+
+    for (size_t i = 1; i <= 28; ++i) {
+        hashmap_hs_insert(map, i, (void *) i);
+        mu_assert("error, slots count must be equal to 32", map->table.slots_count == 32);
+    }
+
+    hashmap_hs_insert(map, 29, (void *) 29);
+    mu_assert("error, entries count must be equal to 29", map->entries_count == 29);
+    mu_assert("error, slots count must be equal to 64", map->table.slots_count == 64);
+
+    for (size_t i = 1; i <= 29; ++i) {
+        mu_assert("error, all previously inserted values must be found", hashmap_hs_find(map, i) == (void *) i);
+    }
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_many_keys() {
+    struct hashmap_hs *map = hashmap_hs_new(hasher, leak);
+    uint64_t densest = 0;
+    for (size_t i = 1; i <= 200000; ++i) {
+        uint64_t slots_count = map->table.slots_count;
+        mu_assert("error, insert must succeed", hashmap_hs_insert(map, i, (void *) i));
+        if (map->table.slots_count != slots_count && 100 * (i - 1) / slots_count > densest) {
+            densest = 100 * (i - 1) / slots_count;
+        }
+    }
+    mu_assert("error, map must fill its table up to the load factor before growing", densest >= 89);
+    mu_assert("error, entries count must be equal to 200000", map->entries_count == 200000);
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, all inserted values must be found", hashmap_hs_find(map, i) == (void *) i);
+    }
+    for (size_t i = 1; i <= 200000; i += 2) {
+        mu_assert("error, delete must find the key", hashmap_hs_delete(map, i));
+    }
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, only the rest of the keys must be found",
+                  hashmap_hs_find(map, i) == (i % 2 == 0 ? (void *) i : NULL));
+    }
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_find_batch() {
+    struct hashmap_hs *map = hashmap_hs_new(hasher, leak);
+    for (size_t i = 0; i < 100; ++i) {
+        hashmap_hs_insert(map, i, (void *) (i + 1));
+    }
+
+    // The batch size is not a multiple of the internal group width, and key 0 is among the keys
+    uint64_t keys[110];
+    void *values[110];
+    for (size_t i = 0; i < 110; ++i) {
+        keys[i] = i;
+    }
+    hashmap_hs_find_batch(map, keys, 110, values);
+    for (size_t i = 0; i < 100; ++i) {
+        mu_assert("error, batch must find all inserted keys", values[i] == (void *) (keys[i] + 1));
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        mu_assert("error, batch mustn't find absent keys", values[i] == NULL);
+    }
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_insert_batch() {
+    uint64_t keys[1000];
+    void *values[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        keys[i] = i + 1;
+        values[i] = (void *) (i + 1);
+    }
+
+    struct hashmap_hs *map = hashmap_hs_new(hasher, leak);
+    hashmap_hs_insert_batch(map, keys, values, 1000);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all batch inserted values must be found", hashmap_hs_find(map, i) == (void *) i);
+    }
+    uint64_t slots_count = map->table.slots_count;
+    hashmap_hs_free(map);
+
+    map = hashmap_hs_new_from_arrays(hasher, leak, keys, values, 1000);
+    mu_assert("error, bulk built map must have the same size", map->table.slots_count == slots_count);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all bulk inserted values must be found", hashmap_hs_find(map, i) == (void *) i);
+    }
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_reserve_and_shrink() {
+    struct hashmap_hs *map = hashmap_hs_new_with_capacity(hasher, leak, 1000);
+    struct hashmap_hs *reserved = hashmap_hs_new(hasher, leak);
+    hashmap_hs_reserve(reserved, 1000);
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->table.slots_count == map->table.slots_count);
+    hashmap_hs_reserve(reserved, 10);
+    mu_assert("error, reserve mustn't shrink the map", reserved->table.slots_count == map->table.slots_count);
+    hashmap_hs_free(reserved);
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_hs_insert(map, i, (void *) i);
+    }
+    for (size_t i = 6; i <= 1000; ++i) {
+        hashmap_hs_delete(map, i);
+    }
+    hashmap_hs_shrink_to_fit(map);
+    mu_assert("error, map must shrink to the initial size", map->table.slots_count == 32);
+    for (size_t i = 1; i <= 5; ++i) {
+        mu_assert("error, remaining values must be found after shrinking", hashmap_hs_find(map, i) == (void *) i);
+    }
+    mu_assert("error, deleted values mustn't be found after shrinking", hashmap_hs_find(map, 6) == NULL);
+
+    hashmap_hs_clear(map);
+    mu_assert("error, map must be empty after clear", map->entries_count == 0);
+    mu_assert("error, keys mustn't be found after clear", hashmap_hs_find(map, 1) == NULL);
+    hashmap_hs_insert(map, 1, (void *) 1);
+    mu_assert("error, map must take keys after clear", hashmap_hs_find(map, 1) == (void *) 1);
+
+    hashmap_hs_free(map);
+
+    return 0;
+}
+
+static char *test_allocators() {
+    struct hashmap_hs_options options = {.allocator = &failing_allocator};
+    allocations_left = 0;
+    mu_assert("error, constructor must fail without memory",
+              hashmap_hs_new_with_options(hasher, leak, options) == NULL);
+    allocations_left = 1;
+    mu_assert("error, constructor must fail without memory for the slots",
+              hashmap_hs_new_with_options(hasher, leak, options) == NULL);
+
+    allocations_left = SIZE_MAX;
+    struct hashmap_hs *map = hashmap_hs_new_with_options(hasher, leak, options);
+    size_t inserted = 0;
+    for (; inserted < 10; ++inserted) {
+        hashmap_hs_insert(map, inserted + 1, (void *) (inserted + 1));
+    }
+    // Without memory the map can't grow, but it still takes entries while they fit
+    allocations_left = 0;
+    while (hashmap_hs_insert(map, inserted + 1, (void *) (inserted + 1))) {
+        inserted++;
+    }
+    mu_assert("error, map must be filled up without memory",
+              inserted >= 28 && inserted <= 32 && map->table.slots_count == 32);
+    mu_assert("error, reserve must fail when the map can't grow", !hashmap_hs_reserve(map, 1000));
+    for (size_t i = 1; i <= inserted; ++i) {
+        mu_assert("error, values must be found after a failed insert", hashmap_hs_find(map, i) == (void *) i);
+    }
+    mu_assert("error, failed key mustn't be found", hashmap_hs_find(map, inserted + 1) == NULL);
+    mu_assert("error, existing key must be replaced without memory", hashmap_hs_insert(map, 1, (void *) 1));
+    allocations_left = SIZE_MAX;
+    mu_assert("error, insert must succeed when memory is back",
+              hashmap_hs_insert(map, inserted + 1, (void *) (inserted + 1)));
+    hashmap_hs_free(map);
+
+    struct hashmap_arena *arena = hashmap_arena_new(4096);
+    struct hashmap_allocator arena_allocator = hashmap_arena_allocator(arena);
+    const struct hashmap_allocator *allocators[] = {&hashmap_huge_page_allocator, &arena_allocator};
+    for (size_t a = 0; a < 2; ++a) {
+        options.allocator = allocators[a];
+        map = hashmap_hs_new_with_options(hasher, leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_hs_insert(map, i, (void *) i);
+        }
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found in a map with a custom allocator",
+                      hashmap_hs_find(map, i) == (void *) i);
+        }
+        hashmap_hs_free(map);
+    }
+    hashmap_arena_free(arena);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts);
+    mu_run_test(test_finds);
+    mu_run_test(test_deletes);
+    mu_run_test(test_hops);
+    mu_run_test(test_full_neighbourhood);
+    mu_run_test(test_resizes);
+    mu_run_test(test_many_keys);
+    mu_run_test(test_find_batch);
+    mu_run_test(test_insert_batch);
+    mu_run_test(test_reserve_and_shrink);
+    mu_run_test(test_allocators);
+
+    return NULL;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
@@ -0,0 +1,213 @@
+#ifndef HASHMAPS_HASHMAP_LP_DEFINE_H
+#define HASHMAPS_HASHMAP_LP_DEFINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// HASHMAP_LP_DEFINE(name, hash_fn, value_type) generates a linear probing map specialized for one hasher
+// and one value type. hash_fn is called directly, so it is inlined into every probe, and values are kept
+// right in the slots. Everything is static inline, so the same map may be defined in several files:
+//
+//     HASHMAP_LP_DEFINE(points, hash_u64, struct point)
+//
+// defines struct points and points_new, points_new_with_capacity, points_insert, points_find,
+// points_delete, points_reserve, points_clear and points_free. The table keeps a power of two slots count
+// and grows at the load factor and the distance limit of hashmap_lp. find returns a pointer into the slots,
+// which stays valid until the next insert or delete. Constructors return NULL and inserts return false
+// when there is no memory.
+
+#define HASHMAP_LP_DEFINE_MAX_LOAD_FACTOR 70
+#define HASHMAP_LP_DEFINE_INITIAL_SLOTS_COUNT 16
+
+enum hashmap_lp_define_status {
+    hashmap_lp_define_vacant = 0,
+    hashmap_lp_define_occupied,
+    hashmap_lp_define_released
+};
+
+#define HASHMAP_LP_DEFINE(name, hash_fn, value_type)                                                            \
+    struct name {                                                                                               \
+        uint64_t entries_count;                                                                                 \
+        uint64_t slots_count;                                                                                   \
+        uint64_t distance_limit;                                                                                \
+        uint8_t *statuses;                                                                                      \
+        uint64_t *keys;                                                                                         \
+        value_type *values;                                                                                     \
+    };                                                                                                          \
+                                                                                                                \
+    static inline uint64_t name##_slots_count_for(uint64_t entries_count) {                                    \
+        uint64_t slots_count = HASHMAP_LP_DEFINE_INITIAL_SLOTS_COUNT;                                           \
+        while (100 * entries_count >= HASHMAP_LP_DEFINE_MAX_LOAD_FACTOR * slots_count) {                       \
+            slots_count *= 2;                                                                                   \
+        }                                                                                                       \
+        return slots_count;                                                                                     \
+    }                                                                                                           \
+                                                                                                                \
+    /* Allocates the arrays of slots_count slots into self, leaving self as it was when there is no memory */ \
+    static inline bool name##_slots_new(struct name *self, uint64_t slots_count) {                             \
+        uint8_t *statuses = (uint8_t *) calloc(slots_count, sizeof(uint8_t));                                   \
+        uint64_t *keys = (uint64_t *) malloc(slots_count * sizeof(uint64_t));                                   \
+        value_type *values = (value_type *) malloc(slots_count * sizeof(value_type));                           \
+        if (statuses == NULL || keys == NULL || values == NULL) {                                               \
+            free(statuses);                                                                                     \
+            free(keys);                                                                                         \
+            free(values);                                                                                       \
+            return false;                                                                                       \
+        }                                                                                                       \
+        self->statuses = statuses;                                                                              \
+        self->keys = keys;                                                                                      \
+        self->values = values;                                                                                  \
+        self->slots_count = slots_count;                                                                        \
+        self->distance_limit = 63 - __builtin_clzll(slots_count);                                               \
+        return true;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    /* Rehashes the entries into slots_count slots, raising the distance limit to keep all of them in reach */ \
+    static inline bool name##_resize(struct name *self, uint64_t slots_count) {                                \
+        struct name old = *self;                                                                                \
+        if (!name##_slots_new(self, slots_count)) {                                                             \
+            return false;                                                                                       \
+        }                                                                                                       \
+        uint64_t mask = slots_count - 1;                                                                        \
+        for (uint64_t i = 0; i < old.slots_count; ++i) {                                                        \
+            if (old.statuses[i] != hashmap_lp_define_occupied) {                                                \
+                continue;                                                                                       \
+            }                                                                                                   \
+            uint64_t index = hash_fn(old.keys[i]) & mask;                                                       \
+            uint64_t distance = 0;                                                                              \
+            for (; self->statuses[index] == hashmap_lp_define_occupied; ++distance) {                           \
+                index = (index + 1) & mask;                                                                     \
+            }                                                                                                   \
+            self->statuses[index] = hashmap_lp_define_occupied;                                                 \
+            self->keys[index] = old.keys[i];                                                                    \
+            self->values[index] = old.values[i];                                                                \
+            if (distance >= self->distance_limit) {                                                             \
+                self->distance_limit = distance + 1;                                                            \
+            }                                                                                                   \
+        }                                                                                                       \
+        free(old.statuses);                                                                                     \
+        free(old.keys);                                                                                         \
+        free(old.values);                                                                                       \
+        return true;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline struct name *name##_new_with_capacity(size_t capacity) {                                     \
+        struct name *self = (struct name *) malloc(sizeof(struct name));                                        \
+        if (self == NULL) {                                                                                     \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        if (!name##_slots_new(self, name##_slots_count_for(capacity))) {                                        \
+            free(self);                                                                                         \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        self->entries_count = 0;                                                                                \
+        return self;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline struct name *name##_new(void) {                                                               \
+        return name##_new_with_capacity(0);                                                                     \
+    }                                                                                                           \
+                                                                                                                \
+    static inline value_type *name##_find(struct name *self, uint64_t key) {                                   \
+        if (self == NULL) {                                                                                     \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        uint64_t mask = self->slots_count - 1;                                                                  \
+        uint64_t index = hash_fn(key) & mask;                                                                   \
+        for (uint64_t i = 0; i < self->distance_limit; ++i) {                                                   \
+            uint8_t status = self->statuses[index];                                                             \
+            if (status == hashmap_lp_define_vacant) {                                                           \
+                return NULL;                                                                                    \
+            }                                                                                                   \
+            if (status == hashmap_lp_define_occupied && self->keys[index] == key) {                             \
+                return self->values + index;                                                                    \
+            }                                                                                                   \
+            index = (index + 1) & mask;                                                                         \
+        }                                                                                                       \
+        return NULL;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    /* The key is looked for up to a vacant slot, and a new one takes the first tombstone on the way */       \
+    static inline bool name##_insert(struct name *self, uint64_t key, value_type value) {                      \
+        if (self == NULL) {                                                                                     \
+            return false;                                                                                       \
+        }                                                                                                       \
+        if (100 * self->entries_count >= HASHMAP_LP_DEFINE_MAX_LOAD_FACTOR * self->slots_count &&               \
+            !name##_resize(self, 2 * self->slots_count)) {                                                      \
+            /* Replacing the value of an existing key still works without memory to grow */                    \
+            value_type *found = name##_find(self, key);                                                         \
+            if (found != NULL) {                                                                                \
+                *found = value;                                                                                 \
+            }                                                                                                   \
+            return found != NULL;                                                                               \
+        }                                                                                                       \
+        while (1) {                                                                                             \
+            uint64_t mask = self->slots_count - 1;                                                              \
+            uint64_t index = hash_fn(key) & mask;                                                               \
+            uint64_t target = UINT64_MAX;                                                                       \
+            for (uint64_t i = 0; i < self->distance_limit; ++i) {                                               \
+                uint8_t status = self->statuses[index];                                                         \
+                if (status == hashmap_lp_define_vacant) {                                                       \
+                    target = target == UINT64_MAX ? index : target;                                             \
+                    break;                                                                                      \
+                }                                                                                               \
+                if (status == hashmap_lp_define_released) {                                                     \
+                    target = target == UINT64_MAX ? index : target;                                             \
+                } else if (self->keys[index] == key) {                                                          \
+                    self->values[index] = value;                                                                \
+                    return true;                                                                                \
+                }                                                                                               \
+                index = (index + 1) & mask;                                                                     \
+            }                                                                                                   \
+            if (target != UINT64_MAX) {                                                                         \
+                self->statuses[target] = hashmap_lp_define_occupied;                                            \
+                self->keys[target] = key;                                                                       \
+                self->values[target] = value;                                                                   \
+                self->entries_count++;                                                                          \
+                return true;                                                                                    \
+            }                                                                                                   \
+            if (!name##_resize(self, 2 * self->slots_count)) {                                                  \
+                return false;                                                                                   \
+            }                                                                                                   \
+        }                                                                                                       \
+    }                                                                                                           \
+                                                                                                                \
+    static inline bool name##_delete(struct name *self, uint64_t key) {                                        \
+        value_type *found = name##_find(self, key);                                                             \
+        if (found == NULL) {                                                                                    \
+            return false;                                                                                       \
+        }                                                                                                       \
+        self->statuses[found - self->values] = hashmap_lp_define_released;                                      \
+        self->entries_count--;                                                                                  \
+        return true;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline bool name##_reserve(struct name *self, size_t capacity) {                                    \
+        if (self == NULL) {                                                                                     \
+            return false;                                                                                       \
+        }                                                                                                       \
+        uint64_t slots_count = name##_slots_count_for(capacity);                                                \
+        return slots_count <= self->slots_count || name##_resize(self, slots_count);                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline void name##_clear(struct name *self) {                                                        \
+        if (self == NULL) {                                                                                     \
+            return;                                                                                             \
+        }                                                                                                       \
+        memset(self->statuses, hashmap_lp_define_vacant, self->slots_count);                                    \
+        self->entries_count = 0;                                                                                \
+    }                                                                                                           \
+                                                                                                                \
+    static inline void name##_free(struct name *self) {                                                         \
+        if (self == NULL) {                                                                                     \
+            return;                                                                                             \
+        }                                                                                                       \
+        free(self->statuses);                                                                                   \
+        free(self->keys);                                                                                       \
+        free(self->values);                                                                                     \
+        free(self);                                                                                             \
+    }
+
+#endif // HASHMAPS_HASHMAP_LP_DEFINE_H
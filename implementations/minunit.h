@@ -5,7 +5,7 @@
   } while (0)
 #define mu_run_test(test)                                                      \
   do {                                                                         \
-    char *message = test();                                                    \
+    __typeof__(test()) message = test();                                       \
     tests_run++;                                                               \
     if (message)                                                               \
       return message;                                                          \
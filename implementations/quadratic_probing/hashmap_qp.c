@@ -1,36 +1,74 @@
 #include "hashmap_qp.h"
+#include "../hashmap_parallel.h"
+#include "../hashmap_snapshot.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_LOAD_FACTOR 70
+#define DEFAULT_MAX_LOAD_FACTOR 70
+#define DEFAULT_GROWTH_FACTOR 200
 #define C1 1
 #define C2 1
+#define INITIAL_SLOTS_COUNT 10
+#define NOT_FOUND SIZE_MAX
+#define BATCH_WIDTH 16
+#define MIGRATION_STEP 16
+#define PARALLEL_RESIZE_MIN_SLOTS 65536
+#define PARALLEL_CLEAR_MIN_SLOTS 65536
+#define SNAPSHOT_POWER_OF_TWO 2
+
+// Statuses of the first generation. Clear starts the next one, whose statuses are two higher,
+// instead of rewriting every status, so the slots marked by the earlier generations read as vacant.
+enum slot_status {
+    vacant = 0,
+    occupied,
+    released
+};
+
+// Slots are split into parallel arrays, so probing streams through statuses and keys
+// and touches a value only when the key matched.
+struct slots {
+    uint8_t *statuses;
+    uint64_t *keys;
+    unsigned char *values;
+    // Statuses of the current generation
+    uint8_t occupied;
+    uint8_t released;
+};
 
 struct hashmap_qp {
     uint64_t entries_count;
     uint64_t slots_count;
-    struct slot *slots;
+    struct slots slots;
     uint64_t distance_limit;
+    // Fixed probes count to start every table with, or zero for log2 of its slots count
+    uint64_t min_distance_limit;
+    unsigned max_load_factor;
+    unsigned growth_factor;
+    bool power_of_two;
+    size_t value_size;
+    size_t value_stride;
+    bool incremental_resize;
+    size_t resize_threads;
+    size_t clear_threads;
+    // During an incremental resize old_slots_count is not zero, and every insert or delete
+    // moves the next MIGRATION_STEP of the old slots, starting from migrated_count.
+    struct slots old_slots;
+    uint64_t old_slots_count;
+    uint64_t old_distance_limit;
+    uint64_t migrated_count;
+    // Resizes so far, so a scan knows its cursor points into another table
+    uint64_t resizes_count;
+    // File the slots are mapped from by hashmap_qp_open_mmap, NULL for maps built in memory, which may change
+    const struct hashmap_snapshot_header *snapshot;
+    size_t snapshot_size;
+    struct hashmap_allocator allocator;
 
     uint64_t (*hasher)(uint64_t);
 
     void (*value_free)(void *);
 };
 
-enum slot_status {
-    vacant = 0,
-    occupied,
-    released
-};
-
-struct slot {
-    uint64_t hash;
-    uint64_t key;
-    void *value;
-    enum slot_status status;
-};
-
 static const uint64_t tab64[64] = {
         63, 0, 58, 1, 59, 47, 53, 2,
         60, 39, 48, 27, 54, 33, 42, 3,
@@ -52,129 +90,715 @@ static uint64_t log2_64(uint64_t value) {
     return tab64[((uint64_t) ((value - (value >> 1)) * 0x07EDD5E59A4E28C2)) >> 58];
 }
 
-static void resize_map(struct hashmap_qp *const self) {
-    size_t new_slots_count = 2 * self->slots_count;
-    struct slot *new_slots = calloc(new_slots_count, sizeof(struct slot));
+static inline uint64_t slot_index(uint64_t hash, uint64_t slots_count, bool power_of_two) {
+    return power_of_two ? hash & (slots_count - 1) : hash % slots_count;
+}
+
+// Triangular numbers visit every slot of a power of two sized table.
+static inline uint64_t probe_index(uint64_t hash, uint64_t i, uint64_t slots_count, bool power_of_two) {
+    uint64_t offset = power_of_two ? i * (i + 1) / 2 : C1 * i + C2 * i * i;
+    return slot_index(hash + offset, slots_count, power_of_two);
+}
+
+static void slots_free(const struct hashmap_qp *const self, struct slots *const slots, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    allocator->free(allocator->context, slots->statuses, slots_count * sizeof(uint8_t));
+    allocator->free(allocator->context, slots->keys, slots_count * sizeof(uint64_t));
+    allocator->free(allocator->context, slots->values, slots_count * self->value_stride);
+}
+
+static bool slots_new(const struct hashmap_qp *const self, struct slots *const slots, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    slots->statuses = allocator->alloc_zeroed(allocator->context, slots_count * sizeof(uint8_t));
+    slots->keys = allocator->alloc(allocator->context, slots_count * sizeof(uint64_t));
+    slots->values = allocator->alloc(allocator->context, slots_count * self->value_stride);
+    slots->occupied = occupied;
+    slots->released = released;
+    if (slots->statuses != NULL && slots->keys != NULL && slots->values != NULL) {
+        return true;
+    }
+    slots_free(self, slots, slots_count);
+    return false;
+}
+
+static inline bool slot_vacant(const struct slots *const slots, uint8_t status) {
+    return status != slots->occupied && status != slots->released;
+}
+
+// Makes every slot vacant by starting the next generation. The statuses are zeroed only when
+// the generations run out of the byte.
+static void slots_clear(const struct hashmap_qp *const self, struct slots *const slots, uint64_t slots_count) {
+    if (slots->released > UINT8_MAX - 2) {
+        hashmap_allocator_zero(&self->allocator, slots->statuses, slots_count);
+        slots->occupied = occupied;
+        slots->released = released;
+    } else {
+        slots->occupied += 2;
+        slots->released += 2;
+    }
+}
+
+static inline unsigned char *value_at(const struct hashmap_qp *const self, const struct slots *const slots,
+                                      size_t index) {
+    return slots->values + index * self->value_stride;
+}
+
+// Pointers are stored as is, inline values are copied from the pointed memory.
+static inline void value_store(const struct hashmap_qp *const self, unsigned char *dst, void *value) {
+    if (self->value_size == 0) {
+        memcpy(dst, &value, sizeof(void *));
+    } else if (value != NULL) {
+        memcpy(dst, value, self->value_size);
+    } else {
+        memset(dst, 0, self->value_size);
+    }
+}
+
+static inline void *value_load(const struct hashmap_qp *const self, unsigned char *src) {
+    if (self->value_size != 0) {
+        return src;
+    }
+    void *value;
+    memcpy(&value, src, sizeof(void *));
+    return value;
+}
+
+static inline void value_release(const struct hashmap_qp *const self, unsigned char *src) {
+    if (self->value_free != NULL) {
+        self->value_free(value_load(self, src));
+    }
+}
+
+// Rounds the slots count up to the initial one, or to a power of two when the table keeps it one.
+static uint64_t slots_count_round(const struct hashmap_qp *const self, uint64_t slots_count) {
+    if (!self->power_of_two) {
+        return slots_count < INITIAL_SLOTS_COUNT ? INITIAL_SLOTS_COUNT : slots_count;
+    }
+    uint64_t power_of_two = 16;
+    while (power_of_two < slots_count) {
+        power_of_two *= 2;
+    }
+    return power_of_two;
+}
+
+// Smallest slots count that keeps entries_count entries under the load factor,
+// but not less than the initial one.
+static uint64_t slots_count_for(const struct hashmap_qp *const self, uint64_t entries_count) {
+    return slots_count_round(self, 100 * entries_count / self->max_load_factor + 1);
+}
+
+// Slots count the table grows to, at least one slot more than it has.
+static uint64_t grown_slots_count(const struct hashmap_qp *const self) {
+    uint64_t slots_count = self->slots_count * self->growth_factor / 100;
+    return slots_count_round(self, slots_count > self->slots_count ? slots_count : self->slots_count + 1);
+}
+
+// Probes count a table of slots_count slots starts with. Resizes raise it when some entry lands farther.
+static uint64_t initial_distance_limit(const struct hashmap_qp *const self, uint64_t slots_count) {
+    return self->min_distance_limit != 0 ? self->min_distance_limit : log2_64(slots_count);
+}
+
+// Takes the slot if it is vacant. When shared, other threads take slots of the same table at once,
+// so the status is changed with CAS.
+static inline bool slot_claim(struct slots *const slots, size_t index, bool shared) {
+    if (!shared) {
+        if (slots->statuses[index] == slots->occupied) {
+            return false;
+        }
+        slots->statuses[index] = slots->occupied;
+        return true;
+    }
+    // Only new tables are shared, and their vacant slots are all zero
+    uint8_t expected = vacant;
+    return __atomic_load_n(slots->statuses + index, __ATOMIC_RELAXED) == vacant &&
+           __atomic_compare_exchange_n(slots->statuses + index, &expected, slots->occupied, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Moves the i-th entry of old_slots into slots and returns the number of probes it took.
+static uint64_t move_entry(const struct hashmap_qp *const self, struct slots *const slots, uint64_t slots_count,
+                           const struct slots *const old_slots, size_t i, bool shared) {
+    uint64_t hash = self->hasher(old_slots->keys[i]);
+    uint64_t index = slot_index(hash, slots_count, self->power_of_two);
+    size_t j = 1;
+    for (; !slot_claim(slots, index, shared); ++j) {
+        index = probe_index(hash, j, slots_count, self->power_of_two);
+    }
+    slots->keys[index] = old_slots->keys[i];
+    memcpy(value_at(self, slots, index), value_at(self, old_slots, i), self->value_stride);
+    return j;
+}
 
-    struct slot *old_slots = self->slots;
-    for (size_t i = 0; i < self->slots_count; ++i) {
-        if (old_slots[i].status != occupied) {
+struct resize_task {
+    const struct hashmap_qp *self;
+    struct slots *new_slots;
+    uint64_t new_slots_count;
+    bool shared;
+    uint64_t distance_limit;
+};
+
+// Moves the entries of the old slots from begin to end into the new ones.
+static void resize_range(void *context, uint64_t begin, uint64_t end) {
+    struct resize_task *task = context;
+    const struct slots *old_slots = &task->self->slots;
+    uint64_t distance_limit = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (old_slots->statuses[i] != old_slots->occupied) {
             continue;
         }
 
-        uint64_t hash = old_slots[i].hash;
-        uint64_t new_hash_index = hash % new_slots_count;
-        for (size_t j = 1; new_slots[new_hash_index].status == occupied; ++j) {
-            new_hash_index = (hash + C1 * j + C2 * j * j) % new_slots_count;
+        uint64_t probes = move_entry(task->self, task->new_slots, task->new_slots_count, old_slots, i, task->shared);
+        if (probes > distance_limit) {
+            distance_limit = probes;
         }
-        memcpy(new_slots + new_hash_index, old_slots + i, sizeof(struct slot));
     }
-    free(old_slots);
+
+    // Rehashing must not put an entry out of reach of find_inner
+    uint64_t limit = __atomic_load_n(&task->distance_limit, __ATOMIC_RELAXED);
+    while (distance_limit > limit && !__atomic_compare_exchange_n(&task->distance_limit, &limit, distance_limit,
+                                                                  true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// Leaves the map as it was when there is no memory for the new slots.
+static bool resize_map(struct hashmap_qp *const self, uint64_t new_slots_count) {
+    struct slots new_slots;
+    if (!slots_new(self, &new_slots, new_slots_count)) {
+        return false;
+    }
+
+    size_t threads_count = self->slots_count >= PARALLEL_RESIZE_MIN_SLOTS ? self->resize_threads : 1;
+    struct resize_task task = {.self = self, .new_slots = &new_slots, .new_slots_count = new_slots_count,
+                               .shared = threads_count > 1,
+                               .distance_limit = initial_distance_limit(self, new_slots_count)};
+    hashmap_parallel_for(threads_count, self->slots_count, resize_range, &task);
+    slots_free(self, &self->slots, self->slots_count);
     self->slots = new_slots;
-    self->slots_count *= 2;
-    self->distance_limit = log2_64(new_slots_count);
+    self->slots_count = new_slots_count;
+    self->distance_limit = task.distance_limit;
+    self->resizes_count++;
+    return true;
 }
 
-static struct slot *find_inner(struct hashmap_qp *const self, uint64_t key) {
-    uint64_t hash = self->hasher(key);
-    struct slot *slot = self->slots + hash % self->slots_count;
-    for (size_t i = 1; i <= self->distance_limit; ++i) {
-        if (slot->status == vacant) {
-            return NULL;
+// Moves up to count old slots into the current table and frees the old table once all are moved.
+static void migrate(struct hashmap_qp *const self, uint64_t count) {
+    uint64_t end = self->old_slots_count - self->migrated_count > count ? self->migrated_count + count
+                                                                         : self->old_slots_count;
+    for (; self->migrated_count < end; ++self->migrated_count) {
+        size_t i = self->migrated_count;
+        if (self->old_slots.statuses[i] != self->old_slots.occupied) {
+            continue;
         }
-        if (slot->status == occupied && slot->key == key) {
-            return slot;
+
+        uint64_t probes = move_entry(self, &self->slots, self->slots_count, &self->old_slots, i, false);
+        if (probes > self->distance_limit) {
+            self->distance_limit = probes;
         }
-        slot = self->slots + (hash + C1 * i + C2 * i * i) % self->slots_count;
+        // The moved slot becomes a tombstone, so lookups in the old table still probe past it
+        self->old_slots.statuses[i] = self->old_slots.released;
+    }
+    if (self->migrated_count == self->old_slots_count) {
+        slots_free(self, &self->old_slots, self->old_slots_count);
+        self->old_slots_count = 0;
+    }
+}
+
+static void finish_migration(struct hashmap_qp *const self) {
+    if (self->old_slots_count != 0) {
+        migrate(self, self->old_slots_count);
+    }
+}
+
+// Grows the table by the growth factor, at once or by starting an incremental resize.
+static bool grow(struct hashmap_qp *const self) {
+    if (!self->incremental_resize) {
+        return resize_map(self, grown_slots_count(self));
     }
 
+    finish_migration(self);
+    uint64_t new_slots_count = grown_slots_count(self);
+    struct slots new_slots;
+    if (!slots_new(self, &new_slots, new_slots_count)) {
+        return false;
+    }
+    self->old_slots = self->slots;
+    self->old_slots_count = self->slots_count;
+    self->old_distance_limit = self->distance_limit;
+    self->migrated_count = 0;
+    self->slots = new_slots;
+    self->slots_count = new_slots_count;
+    self->distance_limit = initial_distance_limit(self, new_slots_count);
+    self->resizes_count++;
+    return true;
+}
+
+static size_t find_in(const struct hashmap_qp *const self, const struct slots *const slots, uint64_t slots_count,
+                      uint64_t distance_limit, uint64_t key, uint64_t hash) {
+    size_t index = slot_index(hash, slots_count, self->power_of_two);
+    for (size_t i = 1; i <= distance_limit; ++i) {
+        uint8_t status = slots->statuses[index];
+        if (slot_vacant(slots, status)) {
+            return NOT_FOUND;
+        }
+        if (status == slots->occupied && slots->keys[index] == key) {
+            return index;
+        }
+        index = probe_index(hash, i, slots_count, self->power_of_two);
+    }
+
+    return NOT_FOUND;
+}
+
+static size_t find_inner(struct hashmap_qp *const self, uint64_t key, uint64_t hash) {
+    return find_in(self, &self->slots, self->slots_count, self->distance_limit, key, hash);
+}
+
+// Returns where the value of the key is kept, looking into the table being migrated as well.
+static unsigned char *find_value(struct hashmap_qp *const self, uint64_t key, uint64_t hash) {
+    size_t index = find_inner(self, key, hash);
+    if (index != NOT_FOUND) {
+        return value_at(self, &self->slots, index);
+    }
+    if (self->old_slots_count != 0) {
+        index = find_in(self, &self->old_slots, self->old_slots_count, self->old_distance_limit, key, hash);
+        if (index != NOT_FOUND) {
+            return value_at(self, &self->old_slots, index);
+        }
+    }
     return NULL;
 }
 
+struct release_task {
+    const struct hashmap_qp *self;
+    const struct slots *slots;
+};
+
+static void release_range(void *context, uint64_t begin, uint64_t end) {
+    const struct release_task *task = context;
+    const struct slots *slots = task->slots;
+    for (size_t i = begin; i < end; ++i) {
+        if (slots->statuses[i] == slots->occupied) {
+            value_release(task->self, value_at(task->self, slots, i));
+        }
+    }
+}
+
+// Releases the values of the occupied slots. Without value_free there is nothing to walk the slots for.
+static void release_values(struct hashmap_qp *const self, const struct slots *const slots, uint64_t slots_count) {
+    if (self->value_free == NULL) {
+        return;
+    }
+    struct release_task task = {.self = self, .slots = slots};
+    size_t threads_count = slots_count >= PARALLEL_CLEAR_MIN_SLOTS ? self->clear_threads : 1;
+    hashmap_parallel_for(threads_count, slots_count, release_range, &task);
+}
+
 struct hashmap_qp *hashmap_qp_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
-    struct hashmap_qp *self = malloc(sizeof(struct hashmap_qp));
+    return hashmap_qp_new_with_options(hasher, value_free, (struct hashmap_qp_options) {0});
+}
+
+struct hashmap_qp *hashmap_qp_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity) {
+    return hashmap_qp_new_with_options(hasher, value_free, (struct hashmap_qp_options) {.capacity = capacity});
+}
+
+struct hashmap_qp *hashmap_qp_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_qp_options options) {
+    // A full table has no vacant slot to end a probe, and growing must add slots
+    if (options.max_load_factor >= 100 || (options.growth_factor != 0 && options.growth_factor <= 100)) {
+        return NULL;
+    }
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_qp *self = allocator->alloc(allocator->context, sizeof(struct hashmap_qp));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
     self->entries_count = 0;
-    self->slots_count = 10;
-    self->slots = calloc(self->slots_count, sizeof(struct slot));
-    self->distance_limit = log2_64(10);
+    self->power_of_two = options.power_of_two;
+    self->max_load_factor = options.max_load_factor != 0 ? options.max_load_factor : DEFAULT_MAX_LOAD_FACTOR;
+    self->growth_factor = options.growth_factor != 0 ? options.growth_factor : DEFAULT_GROWTH_FACTOR;
+    self->min_distance_limit = options.distance_limit;
+    self->slots_count = slots_count_for(self, options.capacity);
+    self->value_size = options.value_size;
+    // Inline values are kept 8-byte aligned
+    self->value_stride = options.value_size == 0 ? sizeof(void *) : (options.value_size + 7) & ~(size_t) 7;
+    if (!slots_new(self, &self->slots, self->slots_count)) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_qp));
+        return NULL;
+    }
+    self->distance_limit = initial_distance_limit(self, self->slots_count);
+    self->incremental_resize = options.incremental_resize;
+    self->resize_threads = options.resize_threads;
+    self->clear_threads = options.clear_threads;
+    self->old_slots_count = 0;
+    self->resizes_count = 0;
+    self->snapshot = NULL;
     self->hasher = hasher;
     self->value_free = value_free;
 
     return self;
 }
 
+struct hashmap_qp *hashmap_qp_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              struct hashmap_qp_options options,
+                                              const uint64_t *keys, void *const *values, size_t n) {
+    if (options.capacity < n) {
+        options.capacity = n;
+    }
+    struct hashmap_qp *self = hashmap_qp_new_with_options(hasher, value_free, options);
+    if (!hashmap_qp_insert_batch(self, keys, values, n)) {
+        hashmap_qp_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
 bool hashmap_qp_insert(struct hashmap_qp *const self, uint64_t key, void *value) {
-    if (self == NULL) {
+    if (self == NULL || self->snapshot != NULL) {
         return false;
     }
 
-    if (100 * self->entries_count / self->slots_count >= MAX_LOAD_FACTOR) {
-        resize_map(self);
+    if (self->old_slots_count != 0) {
+        migrate(self, MIGRATION_STEP);
     }
 
     uint64_t hash = self->hasher(key);
+    if (self->old_slots_count != 0) {
+        unsigned char *found = find_value(self, key, hash);
+        if (found != NULL) {
+            value_release(self, found);
+            value_store(self, found, value);
+            return true;
+        }
+    }
+
+    if (100 * self->entries_count / self->slots_count >= self->max_load_factor && !grow(self)) {
+        // Replacing the value of an existing key still works without memory to grow
+        unsigned char *found = find_value(self, key, hash);
+        if (found == NULL) {
+            return false;
+        }
+        value_release(self, found);
+        value_store(self, found, value);
+        return true;
+    }
+
     while (1) {
-        struct slot *slot = self->slots + hash % self->slots_count;
+        size_t index = slot_index(hash, self->slots_count, self->power_of_two);
+        // The key may lie past a released slot, so the first one is only taken once the key is known to be absent
+        size_t target = SIZE_MAX;
         for (size_t i = 1; i <= self->distance_limit; ++i) {
-            if (slot->status != occupied) {
-                slot->key = key;
-                slot->value = value;
-                slot->hash = hash;
-                slot->status = occupied;
-                self->entries_count++;
-                return true;
-            }
-            if (slot->status == occupied && slot->key == key) {
-                self->value_free(slot->value);
-                slot->value = value;
-                return true;
+            uint8_t status = self->slots.statuses[index];
+            if (status == self->slots.occupied) {
+                if (self->slots.keys[index] == key) {
+                    value_release(self, value_at(self, &self->slots, index));
+                    value_store(self, value_at(self, &self->slots, index), value);
+                    return true;
+                }
+            } else {
+                target = target == SIZE_MAX ? index : target;
+                if (slot_vacant(&self->slots, status)) {
+                    break;
+                }
             }
-            slot = self->slots + (hash + C1 * i + C2 * i * i) % self->slots_count;
+            index = probe_index(hash, i, self->slots_count, self->power_of_two);
+        }
+        if (target != SIZE_MAX) {
+            self->slots.statuses[target] = self->slots.occupied;
+            self->slots.keys[target] = key;
+            value_store(self, value_at(self, &self->slots, target), value);
+            self->entries_count++;
+            return true;
+        }
+        if (!grow(self)) {
+            return false;
         }
-        resize_map(self);
     }
 }
 
+bool hashmap_qp_insert_batch(struct hashmap_qp *const self, const uint64_t *keys, void *const *values, size_t n) {
+    if (self == NULL) {
+        return false;
+    }
+
+    // One resize up front instead of a doubling every time the load factor is hit
+    if (!hashmap_qp_reserve(self, self->entries_count + n)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!hashmap_qp_insert(self, keys[i], values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void *hashmap_qp_find(struct hashmap_qp *const self, uint64_t key) {
     if (self == NULL) {
         return NULL;
     }
 
-    struct slot *slot = find_inner(self, key);
-    if (slot == NULL) {
-        return NULL;
-    } else {
-        return slot->value;
+    unsigned char *found = find_value(self, key, self->hasher(key));
+    return found == NULL ? NULL : value_load(self, found);
+}
+
+// Keys are resolved in groups of BATCH_WIDTH: the whole group is hashed and its home slots are
+// prefetched before the first probe, so the cache misses of the group overlap.
+void hashmap_qp_find_batch(struct hashmap_qp *const self, const uint64_t *keys, size_t n, void **out) {
+    if (self == NULL) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = NULL;
+        }
+        return;
+    }
+
+    uint64_t hashes[BATCH_WIDTH];
+    for (size_t start = 0; start < n; start += BATCH_WIDTH) {
+        size_t width = n - start < BATCH_WIDTH ? n - start : BATCH_WIDTH;
+        for (size_t i = 0; i < width; ++i) {
+            hashes[i] = self->hasher(keys[start + i]);
+            size_t index = slot_index(hashes[i], self->slots_count, self->power_of_two);
+            __builtin_prefetch(self->slots.statuses + index);
+            __builtin_prefetch(self->slots.keys + index);
+        }
+        for (size_t i = 0; i < width; ++i) {
+            unsigned char *found = find_value(self, keys[start + i], hashes[i]);
+            out[start + i] = found == NULL ? NULL : value_load(self, found);
+        }
     }
 }
 
 bool hashmap_qp_delete(struct hashmap_qp *const self, uint64_t key) {
-    if (self == NULL) {
+    if (self == NULL || self->snapshot != NULL) {
         return false;
     }
 
-    struct slot *slot = find_inner(self, key);
-    if (slot == NULL) {
+    if (self->old_slots_count != 0) {
+        migrate(self, MIGRATION_STEP);
+    }
+
+    uint64_t hash = self->hasher(key);
+    struct slots *slots = &self->slots;
+    size_t index = find_inner(self, key, hash);
+    if (index == NOT_FOUND && self->old_slots_count != 0) {
+        slots = &self->old_slots;
+        index = find_in(self, slots, self->old_slots_count, self->old_distance_limit, key, hash);
+    }
+    if (index == NOT_FOUND) {
         return false;
     } else {
-        self->value_free(slot->value);
-        slot->status = released;
+        value_release(self, value_at(self, slots, index));
+        slots->statuses[index] = slots->released;
         self->entries_count--;
         return true;
     }
 }
 
-void hashmap_qp_clear(struct hashmap_qp *const self) {
+// Moves index to the first occupied slot from it on and returns false if there is none.
+static bool iter_slots(const struct slots *const slots, uint64_t slots_count, uint64_t *index) {
+    while (*index < slots_count && slots->statuses[*index] != slots->occupied) {
+        ++*index;
+    }
+    return *index < slots_count;
+}
+
+void hashmap_qp_iter_begin(struct hashmap_qp *const self, struct hashmap_qp_iter *iter) {
+    iter->index = 0;
+    iter->old = self != NULL && self->old_slots_count != 0;
+}
+
+// The old table goes first, the slots already moved out of it are tombstones and so are skipped.
+bool hashmap_qp_iter_next(struct hashmap_qp *const self, struct hashmap_qp_iter *iter, uint64_t *key, void **value) {
     if (self == NULL) {
-        return;
+        return false;
     }
 
-    for (size_t i = 0; i < self->slots_count; ++i) {
-        if (self->slots[i].status == occupied) {
-            self->value_free(self->slots[i].value);
-            self->slots[i].status = vacant;
+    const struct slots *slots = &self->slots;
+    if (iter->old) {
+        if (iter_slots(&self->old_slots, self->old_slots_count, &iter->index)) {
+            slots = &self->old_slots;
+        } else {
+            iter->old = false;
+            iter->index = 0;
         }
     }
+    if (!iter->old && !iter_slots(slots, self->slots_count, &iter->index)) {
+        return false;
+    }
+    *key = slots->keys[iter->index];
+    *value = value_load(self, value_at(self, slots, iter->index));
+    iter->index++;
+    return true;
+}
+
+// Visits the entries of up to count slots from index on, moves index past them and returns how many were walked.
+static uint64_t scan_slots(const struct hashmap_qp *const self, const struct slots *const slots,
+                           uint64_t slots_count, uint64_t *index, uint64_t count,
+                           void (*visit)(void *context, uint64_t key, void *value), void *context) {
+    uint64_t end = slots_count - *index > count ? *index + count : slots_count;
+    uint64_t walked = end - *index;
+    for (; *index < end; ++*index) {
+        if (slots->statuses[*index] == slots->occupied) {
+            visit(context, slots->keys[*index], value_load(self, value_at(self, slots, *index)));
+        }
+    }
+    return walked;
+}
+
+void hashmap_qp_cursor_begin(struct hashmap_qp *const self, struct hashmap_qp_cursor *cursor) {
+    *cursor = (struct hashmap_qp_cursor) {0};
+    if (self != NULL) {
+        cursor->resizes_count = self->resizes_count;
+        cursor->old = self->old_slots_count != 0;
+    }
+}
+
+// Entries never move within a table, deletes leave tombstones, so only resizes and migration concern the cursor.
+bool hashmap_qp_scan(struct hashmap_qp *const self, struct hashmap_qp_cursor *cursor, size_t count,
+                     void (*visit)(void *context, uint64_t key, void *value), void *context) {
+    if (self == NULL || cursor->finished) {
+        return false;
+    }
+
+    if (cursor->resizes_count != self->resizes_count) {
+        // The scanned table may have just become the old one of an incremental resize, then the scan goes on in it
+        bool kept = !cursor->old && self->old_slots_count != 0 && cursor->resizes_count + 1 == self->resizes_count;
+        cursor->index = kept ? cursor->index : 0;
+        cursor->old = self->old_slots_count != 0;
+    } else if (cursor->old && self->old_slots_count == 0) {
+        // The migration is over, so the entries not scanned in the old table are somewhere in the current one
+        cursor->old = false;
+        cursor->index = 0;
+    }
+    cursor->resizes_count = self->resizes_count;
+
+    if (cursor->old) {
+        count -= scan_slots(self, &self->old_slots, self->old_slots_count, &cursor->index, count, visit, context);
+        if (cursor->index < self->old_slots_count) {
+            return true;
+        }
+        cursor->old = false;
+        cursor->index = 0;
+    }
+    scan_slots(self, &self->slots, self->slots_count, &cursor->index, count, visit, context);
+    if (cursor->index < self->slots_count) {
+        return true;
+    }
+    cursor->finished = true;
+    return false;
+}
+
+bool hashmap_qp_reserve(struct hashmap_qp *const self, size_t capacity) {
+    if (self == NULL || self->snapshot != NULL) {
+        return false;
+    }
+
+    finish_migration(self);
+    uint64_t slots_count = slots_count_for(self, capacity);
+    return slots_count <= self->slots_count || resize_map(self, slots_count);
+}
+
+void hashmap_qp_shrink_to_fit(struct hashmap_qp *const self) {
+    if (self == NULL || self->snapshot != NULL) {
+        return;
+    }
+
+    finish_migration(self);
+    // Rehashing into fewer slots recomputes distance_limit, so the rest of the entries stay reachable.
+    // If there is no memory even for the smaller table, the map just stays as it is.
+    uint64_t slots_count = slots_count_for(self, self->entries_count);
+    if (slots_count < self->slots_count) {
+        resize_map(self, slots_count);
+    }
+}
+
+bool hashmap_qp_save(struct hashmap_qp *const self, int fd) {
+    if (self == NULL || self->value_size == 0) {
+        return false;
+    }
+
+    finish_migration(self);
+    struct hashmap_snapshot_header header = {
+            .kind = hashmap_snapshot_qp,
+            .hasher_checks = {self->hasher(HASHMAP_SNAPSHOT_PROBE_KEY)},
+            .entries_count = self->entries_count,
+            .slots_count = self->slots_count,
+            .distance_limit = self->distance_limit,
+            .value_size = self->value_size,
+            .value_stride = self->value_stride,
+            .flags = self->power_of_two ? SNAPSHOT_POWER_OF_TWO : 0,
+            .occupied = self->slots.occupied,
+            .released = self->slots.released,
+            .arrays_count = 3};
+    const void *arrays[] = {self->slots.statuses, self->slots.keys, self->slots.values};
+    uint64_t sizes[] = {self->slots_count, self->slots_count * sizeof(uint64_t), self->slots_count * self->value_stride};
+    return hashmap_snapshot_write(fd, &header, arrays, sizes);
+}
+
+// The header is checked against everything lookups rely on, so a damaged file can't make them read past the arrays.
+static bool snapshot_valid(const struct hashmap_snapshot_header *header, uint64_t (*hasher)(uint64_t)) {
+    uint64_t slots_count = header->slots_count;
+    return header->hasher_checks[0] == hasher(HASHMAP_SNAPSHOT_PROBE_KEY) && header->arrays_count == 3 &&
+           slots_count != 0 && header->entries_count < slots_count && header->value_size != 0 &&
+           header->value_stride == ((header->value_size + 7) & ~(uint64_t) 7) &&
+           header->occupied <= UINT8_MAX && header->released <= UINT8_MAX &&
+           (!(header->flags & SNAPSHOT_POWER_OF_TWO) || (slots_count & (slots_count - 1)) == 0) &&
+           header->arrays[0].size == slots_count &&
+           header->arrays[1].size / sizeof(uint64_t) == slots_count &&
+           header->arrays[1].size % sizeof(uint64_t) == 0 &&
+           header->arrays[2].size / header->value_stride == slots_count &&
+           header->arrays[2].size % header->value_stride == 0;
+}
+
+struct hashmap_qp *hashmap_qp_open_mmap(const char *path, uint64_t (*hasher)(uint64_t)) {
+    size_t snapshot_size;
+    const struct hashmap_snapshot_header *header = hashmap_snapshot_map(path, hashmap_snapshot_qp, &snapshot_size);
+    if (header == NULL) {
+        return NULL;
+    }
+    const struct hashmap_allocator *allocator = &hashmap_libc_allocator;
+    struct hashmap_qp *self = NULL;
+    if (!snapshot_valid(header, hasher) ||
+        (self = allocator->alloc_zeroed(allocator->context, sizeof(struct hashmap_qp))) == NULL) {
+        hashmap_snapshot_unmap(header, snapshot_size);
+        return NULL;
+    }
+    self->allocator = *allocator;
+    self->snapshot = header;
+    self->snapshot_size = snapshot_size;
+    self->entries_count = header->entries_count;
+    self->slots_count = header->slots_count;
+    // The slots are never written, the mutating functions return before touching them
+    self->slots.statuses = (uint8_t *) hashmap_snapshot_array(header, 0);
+    self->slots.keys = (uint64_t *) hashmap_snapshot_array(header, 1);
+    self->slots.values = (unsigned char *) hashmap_snapshot_array(header, 2);
+    self->slots.occupied = header->occupied;
+    self->slots.released = header->released;
+    self->distance_limit = header->distance_limit;
+    self->max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
+    self->growth_factor = DEFAULT_GROWTH_FACTOR;
+    self->power_of_two = header->flags & SNAPSHOT_POWER_OF_TWO;
+    self->value_size = header->value_size;
+    self->value_stride = header->value_stride;
+    self->hasher = hasher;
+
+    return self;
+}
+
+void hashmap_qp_clear(struct hashmap_qp *const self) {
+    if (self == NULL || self->snapshot != NULL) {
+        return;
+    }
+
+    release_values(self, &self->slots, self->slots_count);
+    if (self->old_slots_count != 0) {
+        release_values(self, &self->old_slots, self->old_slots_count);
+        slots_free(self, &self->old_slots, self->old_slots_count);
+        self->old_slots_count = 0;
+    }
+    slots_clear(self, &self->slots, self->slots_count);
     self->entries_count = 0;
 }
 
@@ -182,11 +806,17 @@ void hashmap_qp_free(struct hashmap_qp *const self) {
     if (self == NULL) {
         return;
     }
-    for (size_t i = 0; i < self->slots_count; ++i) {
-        if (self->slots[i].status == occupied) {
-            self->value_free(self->slots[i].value);
-        }
+    if (self->snapshot != NULL) {
+        hashmap_snapshot_unmap(self->snapshot, self->snapshot_size);
+        self->allocator.free(self->allocator.context, self, sizeof(struct hashmap_qp));
+        return;
+    }
+    release_values(self, &self->slots, self->slots_count);
+    if (self->old_slots_count != 0) {
+        release_values(self, &self->old_slots, self->old_slots_count);
+        slots_free(self, &self->old_slots, self->old_slots_count);
     }
-    free(self->slots);
-    free(self);
+    slots_free(self, &self->slots, self->slots_count);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_qp));
 }
@@ -1,34 +1,56 @@
 #include "../minunit.h"
 #include "hashmap_qp.h"
+#include "hashmap_qp_define.h"
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum slot_status {
+    vacant = 0,
+    occupied,
+    released
+};
+
+struct slots {
+    uint8_t *statuses;
+    uint64_t *keys;
+    unsigned char *values;
+    uint8_t occupied;
+    uint8_t released;
+};
 
 struct hashmap_qp {
     uint64_t entries_count;
     uint64_t slots_count;
-    struct slot *slots;
+    struct slots slots;
     uint64_t distance_limit;
+    uint64_t min_distance_limit;
+    unsigned max_load_factor;
+    unsigned growth_factor;
+    bool power_of_two;
+    size_t value_size;
+    size_t value_stride;
+    bool incremental_resize;
+    size_t resize_threads;
+    size_t clear_threads;
+    struct slots old_slots;
+    uint64_t old_slots_count;
+    uint64_t old_distance_limit;
+    uint64_t migrated_count;
+    uint64_t resizes_count;
+    const struct hashmap_snapshot_header *snapshot;
+    size_t snapshot_size;
+    struct hashmap_allocator allocator;
 
     uint64_t (*hasher)(uint64_t);
 
     void (*value_free)(void *);
 };
 
-enum slot_status {
-    vacant = 0,
-    occupied,
-    released
-};
-
-struct slot {
-    uint64_t hash;
-    uint64_t key;
-    void *value;
-    enum slot_status status;
-};
-
 static uint64_t hasher(uint64_t x) {
     x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
     x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
@@ -48,6 +70,50 @@ static void *make_ptr(uint64_t value) {
 
 static void leak(void *_) {}
 
+static atomic_size_t freed_count;
+
+static void count_free(void *_) {
+    atomic_fetch_add(&freed_count, 1);
+}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
 int tests_run = 0;
 
 static char *test_constructs() {
@@ -57,11 +123,13 @@ static char *test_constructs() {
               map->slots_count == 10);
     mu_assert("error, initial entries count must be equal to 0",
               map->entries_count == 0);
-    mu_assert("error, array of slots didn't alloc", map->slots != NULL);
+    mu_assert("error, array of statuses didn't alloc", map->slots.statuses != NULL);
+    mu_assert("error, array of keys didn't alloc", map->slots.keys != NULL);
+    mu_assert("error, array of values didn't alloc", map->slots.values != NULL);
     mu_assert("error, distance limit must be equal to 3", map->distance_limit == 3);
 
     for (size_t i = 0; i < map->slots_count; ++i) {
-        mu_assert("error, all slots must be vacant", map->slots[i].status == vacant);
+        mu_assert("error, all slots must be vacant", map->slots.statuses[i] == vacant);
     }
 
     hashmap_qp_free(map);
@@ -72,27 +140,25 @@ static char *test_constructs() {
 static char *test_inserts() {
     struct hashmap_qp *map = hashmap_qp_new(fake_hasher, free);
     uint64_t hash = map->hasher(999);
-    struct slot *slot = map->slots + (hash % map->slots_count);
+    size_t index = hash % map->slots_count;
 
     hashmap_qp_insert(map, 999, make_ptr(5));
     mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
-    mu_assert("error, map must contain the value", slot != NULL);
-    mu_assert("error, saved incorrect hash", slot->hash == hash);
-    mu_assert("error, saved incorrect key", slot->key == 999);
-    mu_assert("error, saved incorrect value", *(uint64_t *) slot->value == 5);
-    mu_assert("error, slot status must be 'occupied'", slot->status == occupied);
+    mu_assert("error, saved incorrect key", map->slots.keys[index] == 999);
+    mu_assert("error, saved incorrect value", **(uint64_t **) (map->slots.values + index * map->value_stride) == 5);
+    mu_assert("error, slot status must be 'occupied'", map->slots.statuses[index] == occupied);
 
     hashmap_qp_insert(map, 999, make_ptr(10));
     mu_assert(
             "error, entries count should be incremented when saving existent key",
             map->entries_count == 1);
-    mu_assert("error, value should be changed", *(uint64_t *) slot->value == 10);
+    mu_assert("error, value should be changed", **(uint64_t **) (map->slots.values + index * map->value_stride) == 10);
 
     hashmap_qp_insert(map, 777, make_ptr(15));
     mu_assert("error, entries count must be equal to 2", map->entries_count == 2);
-    slot += 2;
-    mu_assert("error, new value must be saved at the next slot", *(uint64_t *) slot->value == 15);
-    mu_assert("error, new key must be saved at the next slot", slot->key == 777);
+    index += 2;
+    mu_assert("error, new value must be saved at the next slot", **(uint64_t **) (map->slots.values + index * map->value_stride) == 15);
+    mu_assert("error, new key must be saved at the next slot", map->slots.keys[index] == 777);
 
     hashmap_qp_free(map);
 
@@ -118,12 +184,12 @@ static char *test_finds() {
 
 static char *test_deletes() {
     struct hashmap_qp *map = hashmap_qp_new(hasher, free);
-    struct slot *slot = map->slots + (map->hasher(777) % map->slots_count);
+    size_t index = map->hasher(777) % map->slots_count;
 
     hashmap_qp_insert(map, 555, NULL);
     hashmap_qp_insert(map, 777, NULL);
     mu_assert("error, key 777 must be deleted", hashmap_qp_delete(map, 777));
-    mu_assert("error, slot status must be 'released'", slot->status == released);
+    mu_assert("error, slot status must be 'released'", map->slots.statuses[index] == released);
     mu_assert("error, key 777 already must be deleted", !hashmap_qp_delete(map, 777));
     mu_assert("error, key 888 can't be deleted because the map doesn't contain it",
               !hashmap_qp_delete(map, 888));
@@ -134,6 +200,25 @@ static char *test_deletes() {
     return 0;
 }
 
+// A key inserted again while an earlier colliding key left a released slot before it must not be duplicated
+static char *test_reinsert_past_released() {
+    struct hashmap_qp *map = hashmap_qp_new(fake_hasher, free);
+
+    hashmap_qp_insert(map, 1, make_ptr(1));
+    hashmap_qp_insert(map, 2, make_ptr(2));
+    hashmap_qp_delete(map, 1);
+    hashmap_qp_insert(map, 2, make_ptr(3));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+    mu_assert("error, key 2 must be replaced", *(uint64_t *) hashmap_qp_find(map, 2) == 3);
+    mu_assert("error, key 2 must be deleted", hashmap_qp_delete(map, 2));
+    mu_assert("error, key 2 must not be found after deletion", hashmap_qp_find(map, 2) == NULL);
+    mu_assert("error, entries count must be equal to 0", map->entries_count == 0);
+
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
 static char *test_resizes() {
     struct hashmap_qp *map = hashmap_qp_new(fake_hasher, leak);
 
@@ -160,12 +245,530 @@ static char *test_resizes() {
     return 0;
 }
 
+static char *test_power_of_two() {
+    struct hashmap_qp_options options = {.power_of_two = true};
+    struct hashmap_qp *map = hashmap_qp_new_with_options(fake_hasher, leak, options);
+    mu_assert("error, initial slots count must be equal to 16", map->slots_count == 16);
+    mu_assert("error, distance limit must be equal to 4", map->distance_limit == 4);
+
+    size_t expected_slots[] = {1, 2, 4, 7};
+    for (size_t i = 0; i < 4; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+        mu_assert("error, colliding keys must be probed by triangular numbers",
+                  map->slots.keys[expected_slots[i]] == i);
+    }
+    hashmap_qp_free(map);
+
+    map = hashmap_qp_new_with_options(hasher, leak, options);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        hashmap_qp_insert(map, i, (void *) (i + 1));
+    }
+    mu_assert("error, slots count must stay a power of two", (map->slots_count & (map->slots_count - 1)) == 0);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        mu_assert("error, all previously inserted values must be found", hashmap_qp_find(map, i) == (void *) (i + 1));
+    }
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_inline_values() {
+    struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, NULL, (struct hashmap_qp_options) {.value_size = sizeof(uint64_t)});
+    mu_assert("error, inline values must not need value_free", map->value_free == NULL);
+
+    for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t value = i + 1;
+        hashmap_qp_insert(map, i, &value);
+    }
+    for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t *value = hashmap_qp_find(map, i);
+        mu_assert("error, inline value must be found", value != NULL && *value == i + 1);
+    }
+
+    uint64_t value = 42;
+    hashmap_qp_insert(map, 7, &value);
+    value = 0;
+    mu_assert("error, inline value must be copied on insert", *(uint64_t *) hashmap_qp_find(map, 7) == 42);
+    *(uint64_t *) hashmap_qp_find(map, 7) = 43;
+    mu_assert("error, found pointer must point into the map", *(uint64_t *) hashmap_qp_find(map, 7) == 43);
+
+    hashmap_qp_insert(map, 1000, NULL);
+    mu_assert("error, inserting NULL must store zeroes", *(uint64_t *) hashmap_qp_find(map, 1000) == 0);
+
+    mu_assert("error, key 7 must be deleted", hashmap_qp_delete(map, 7));
+    mu_assert("error, deleted key must not be found", hashmap_qp_find(map, 7) == NULL);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+
+    hashmap_qp_clear(map);
+    mu_assert("error, cleared map must be empty", map->entries_count == 0 && hashmap_qp_find(map, 1) == NULL);
+
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_find_batch() {
+    struct hashmap_qp *map = hashmap_qp_new(hasher, leak);
+    for (size_t i = 1; i <= 100; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+    }
+
+    // The batch size is not a multiple of the internal group width
+    uint64_t keys[110];
+    void *values[110];
+    for (size_t i = 0; i < 110; ++i) {
+        keys[i] = i + 1;
+    }
+    hashmap_qp_find_batch(map, keys, 110, values);
+    for (size_t i = 0; i < 100; ++i) {
+        mu_assert("error, batch must find all inserted keys", values[i] == (void *) keys[i]);
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        mu_assert("error, batch mustn't find absent keys", values[i] == NULL);
+    }
+
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_insert_batch() {
+    uint64_t keys[1000];
+    void *values[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        keys[i] = i + 1;
+        values[i] = (void *) (i + 1);
+    }
+
+    struct hashmap_qp *map = hashmap_qp_new(hasher, leak);
+    hashmap_qp_insert_batch(map, keys, values, 1000);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all batch inserted values must be found", hashmap_qp_find(map, i) == (void *) i);
+    }
+    uint64_t slots_count = map->slots_count;
+    hashmap_qp_free(map);
+
+    map = hashmap_qp_new_from_arrays(hasher, leak, (struct hashmap_qp_options) {0}, keys, values, 1000);
+    mu_assert("error, bulk built map must have the same size", map->slots_count == slots_count);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all bulk inserted values must be found", hashmap_qp_find(map, i) == (void *) i);
+    }
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_reserve_and_shrink() {
+    struct hashmap_qp *map = hashmap_qp_new_with_capacity(hasher, leak, 1000);
+    struct hashmap_qp *reserved = hashmap_qp_new(hasher, leak);
+    hashmap_qp_reserve(reserved, 1000);
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->slots_count == map->slots_count);
+    hashmap_qp_reserve(reserved, 10);
+    mu_assert("error, reserve mustn't shrink the map", reserved->slots_count == map->slots_count);
+    hashmap_qp_free(reserved);
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+    }
+    for (size_t i = 6; i <= 1000; ++i) {
+        hashmap_qp_delete(map, i);
+    }
+    hashmap_qp_shrink_to_fit(map);
+    mu_assert("error, map must shrink to the initial size", map->slots_count == 10);
+    for (size_t i = 1; i <= 5; ++i) {
+        mu_assert("error, remaining values must be found after shrinking", hashmap_qp_find(map, i) == (void *) i);
+    }
+    mu_assert("error, deleted values mustn't be found after shrinking", hashmap_qp_find(map, 6) == NULL);
+
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_incremental_resize() {
+    struct hashmap_qp_options options = {.incremental_resize = true};
+    struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, leak, options);
+    size_t migrations = 0;
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+        if (map->old_slots_count == 0) {
+            continue;
+        }
+        if (map->migrated_count <= 16) {
+            // Right after the resize started most of the keys are still in the old table
+            migrations++;
+            mu_assert("error, key 1 must be deleted during migration", hashmap_qp_delete(map, 1));
+            mu_assert("error, deleted key mustn't be found during migration", hashmap_qp_find(map, 1) == NULL);
+            hashmap_qp_insert(map, 1, (void *) 1);
+        }
+        for (size_t j = 1; j <= i; ++j) {
+            mu_assert("error, all keys must be found during migration", hashmap_qp_find(map, j) == (void *) j);
+        }
+    }
+    mu_assert("error, map must have been resized incrementally", migrations > 0);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_allocators() {
+    struct hashmap_qp_options options = {.allocator = &failing_allocator};
+    allocations_left = 0;
+    mu_assert("error, constructor must fail without memory",
+              hashmap_qp_new_with_options(hasher, leak, options) == NULL);
+    allocations_left = 3;
+    mu_assert("error, constructor must fail without memory for the slots",
+              hashmap_qp_new_with_options(hasher, leak, options) == NULL);
+
+    allocations_left = SIZE_MAX;
+    struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, leak, options);
+    // Without memory the map can't grow, so inserts fail once the load factor or a probe sequence runs out
+    allocations_left = 0;
+    uint64_t slots_count = map->slots_count;
+    size_t inserted = 0;
+    while (hashmap_qp_insert(map, inserted + 1, (void *) (inserted + 1))) {
+        inserted++;
+    }
+    mu_assert("error, map mustn't grow without memory", map->slots_count == slots_count);
+    mu_assert("error, failed insert mustn't change entries count", map->entries_count == inserted);
+    mu_assert("error, reserve must fail when the map can't grow", !hashmap_qp_reserve(map, 100));
+    for (size_t i = 1; i <= inserted; ++i) {
+        mu_assert("error, values must be found after a failed insert", hashmap_qp_find(map, i) == (void *) i);
+    }
+    mu_assert("error, existing key must be replaced without memory", hashmap_qp_insert(map, 1, (void *) 1));
+    allocations_left = SIZE_MAX;
+    mu_assert("error, insert must succeed when memory is back",
+              hashmap_qp_insert(map, inserted + 1, (void *) (inserted + 1)));
+    hashmap_qp_free(map);
+
+    struct hashmap_arena *arena = hashmap_arena_new(4096);
+    struct hashmap_allocator arena_allocator = hashmap_arena_allocator(arena);
+    const struct hashmap_allocator *allocators[] = {&hashmap_huge_page_allocator, &arena_allocator};
+    for (size_t a = 0; a < 2; ++a) {
+        options.allocator = allocators[a];
+        map = hashmap_qp_new_with_options(hasher, leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_qp_insert(map, i, (void *) i);
+        }
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found in a map with a custom allocator",
+                      hashmap_qp_find(map, i) == (void *) i);
+        }
+        hashmap_qp_free(map);
+    }
+    hashmap_arena_free(arena);
+
+    return 0;
+}
+
+static char *test_parallel_resize() {
+    for (int variant = 0; variant < 2; ++variant) {
+        struct hashmap_qp_options options = {.power_of_two = variant, .resize_threads = 4};
+        struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_qp_insert(map, i, (void *) i);
+        }
+        mu_assert("error, entries count must be equal to 200000", map->entries_count == 200000);
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found after a parallel resize", hashmap_qp_find(map, i) == (void *) i);
+        }
+
+        // Reserve rehashes all of the entries at once
+        mu_assert("error, reserve must succeed", hashmap_qp_reserve(map, 1000000));
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found after a parallel reserve", hashmap_qp_find(map, i) == (void *) i);
+        }
+        mu_assert("error, missing key mustn't be found", hashmap_qp_find(map, 200001) == NULL);
+        hashmap_qp_free(map);
+    }
+
+    return 0;
+}
+
+static char *test_parallel_clear() {
+    struct hashmap_qp *map =
+            hashmap_qp_new_with_options(hasher, count_free, (struct hashmap_qp_options) {.clear_threads = 4});
+    for (size_t i = 1; i <= 200000; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+    }
+    freed_count = 0;
+    hashmap_qp_clear(map);
+    mu_assert("error, clear must release every value", freed_count == 200000);
+    mu_assert("error, map must be empty after clear", map->entries_count == 0);
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, keys mustn't be found after clear", hashmap_qp_find(map, i) == NULL);
+    }
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_qp_insert(map, i, (void *) i);
+    }
+    mu_assert("error, map must take keys after clear", hashmap_qp_find(map, 1000) == (void *) 1000);
+    hashmap_qp_free(map);
+    mu_assert("error, free must release every value", freed_count == 201000);
+
+    return 0;
+}
+
+static char *test_clear_generations() {
+    // Resizing would start the generations over in a new table
+    struct hashmap_qp *map = hashmap_qp_new_with_capacity(hasher, NULL, 100);
+    for (uint64_t round = 0; round < 300; ++round) {
+        for (uint64_t i = 1; i <= 10; ++i) {
+            hashmap_qp_insert(map, round * 10 + i, (void *) i);
+        }
+        hashmap_qp_delete(map, round * 10 + 1);
+        mu_assert("error, slots must be marked by the current generation",
+                  map->slots.occupied == occupied + 2 * (round % 127));
+        hashmap_qp_clear(map);
+        mu_assert("error, map must be empty after clear", map->entries_count == 0);
+        for (uint64_t i = 1; i <= 10; ++i) {
+            mu_assert("error, keys of the earlier generations mustn't be found",
+                      hashmap_qp_find(map, round * 10 + i) == NULL);
+        }
+    }
+    hashmap_qp_insert(map, 5, (void *) 5);
+    mu_assert("error, map must take keys after clear", hashmap_qp_find(map, 5) == (void *) 5);
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static char *test_tuning() {
+    mu_assert("error, map that fills up its table mustn't be constructed",
+              hashmap_qp_new_with_options(hasher, leak, (struct hashmap_qp_options) {.max_load_factor = 100}) == NULL);
+    mu_assert("error, map that doesn't grow mustn't be constructed",
+              hashmap_qp_new_with_options(hasher, leak, (struct hashmap_qp_options) {.growth_factor = 100}) == NULL);
+
+    struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, leak, (struct hashmap_qp_options) {
+            .max_load_factor = 50, .capacity = 100});
+    mu_assert("error, capacity must fit under the load factor", map->slots_count == 201);
+    hashmap_qp_free(map);
+
+    // A dense table grown by half needs a longer distance limit than log2 of its size
+    map = hashmap_qp_new_with_options(hasher, leak, (struct hashmap_qp_options) {
+            .max_load_factor = 90, .growth_factor = 150, .distance_limit = 64});
+    mu_assert("error, distance limit must be taken from the options", map->distance_limit == 64);
+    uint64_t densest = 0;
+    for (size_t i = 1; i <= 100000; ++i) {
+        uint64_t slots_count = map->slots_count;
+        hashmap_qp_insert(map, i, (void *) i);
+        if (map->slots_count != slots_count) {
+            mu_assert("error, table must grow by the growth factor", map->slots_count == slots_count * 150 / 100);
+            densest = 100 * (i - 1) / slots_count > densest ? 100 * (i - 1) / slots_count : densest;
+        }
+    }
+    mu_assert("error, table must be filled up to the load factor before growing", densest >= 89);
+    for (size_t i = 1; i <= 100000; ++i) {
+        mu_assert("error, all inserted values must be found", hashmap_qp_find(map, i) == (void *) i);
+    }
+    hashmap_qp_free(map);
+
+    return 0;
+}
+
+static void count_visit(void *context, uint64_t key, void *value) {
+    uint8_t *visits = context;
+    if (value == (void *) key && visits[key] < UINT8_MAX) {
+        visits[key]++;
+    }
+}
+
+static char *test_iteration() {
+    uint8_t *visits = malloc(20000);
+    for (int variant = 0; variant < 2; ++variant) {
+        struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, leak, (struct hashmap_qp_options) {
+                .incremental_resize = variant == 1, .distance_limit = 64});
+        // The table grows at 7168 entries, so the incremental variant is walked in the middle of a migration
+        uint64_t count = 7500;
+        for (uint64_t i = 0; i < count; ++i) {
+            hashmap_qp_insert(map, i, (void *) i);
+        }
+        if (variant == 1) {
+            mu_assert("error, incremental resize must be in progress", map->old_slots_count != 0);
+        }
+
+        memset(visits, 0, 20000);
+        struct hashmap_qp_iter iter;
+        uint64_t key;
+        void *value;
+        hashmap_qp_iter_begin(map, &iter);
+        while (hashmap_qp_iter_next(map, &iter, &key, &value)) {
+            mu_assert("error, iteration must return the inserted entries", key < count && value == (void *) key);
+            visits[key]++;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            mu_assert("error, iteration must return every entry once", visits[i] == 1);
+        }
+
+        memset(visits, 0, 20000);
+        struct hashmap_qp_cursor cursor;
+        hashmap_qp_cursor_begin(map, &cursor);
+        while (hashmap_qp_scan(map, &cursor, 7, count_visit, visits)) {
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            mu_assert("error, scan of an unchanged map must visit every entry once", visits[i] == 1);
+        }
+        mu_assert("error, finished scan mustn't go on", !hashmap_qp_scan(map, &cursor, 7, count_visit, visits));
+
+        // Keys below count / 2 stay, the rest are deleted while the new keys make the table grow mid-scan
+        memset(visits, 0, 20000);
+        uint64_t resizes_count = map->resizes_count;
+        uint64_t inserted = count, deleted = count / 2;
+        hashmap_qp_cursor_begin(map, &cursor);
+        while (hashmap_qp_scan(map, &cursor, 7, count_visit, visits)) {
+            for (int i = 0; i < 5 && inserted < 20000; ++i, ++inserted) {
+                hashmap_qp_insert(map, inserted, (void *) inserted);
+            }
+            if (deleted < count) {
+                hashmap_qp_delete(map, deleted++);
+            }
+        }
+        mu_assert("error, table must grow during the scan", map->resizes_count != resizes_count);
+        for (uint64_t i = 0; i < count / 2; ++i) {
+            mu_assert("error, scan must visit every entry kept during it", visits[i] >= 1);
+        }
+        hashmap_qp_free(map);
+    }
+
+    free(visits);
+
+    return 0;
+}
+
+static char *test_snapshot() {
+    char path[] = "/tmp/hashmap_qp_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    mu_assert("error, temporary file must be created", fd >= 0);
+
+    struct hashmap_qp *pointers = hashmap_qp_new(hasher, leak);
+    mu_assert("error, map of pointers mustn't be saved", !hashmap_qp_save(pointers, fd));
+    hashmap_qp_free(pointers);
+
+    for (int variant = 0; variant < 2; ++variant) {
+        struct hashmap_qp *map = hashmap_qp_new_with_options(hasher, NULL, (struct hashmap_qp_options) {
+                .power_of_two = variant == 1, .incremental_resize = variant == 0, .value_size = sizeof(uint64_t)});
+        for (uint64_t i = 0; i < 10000; ++i) {
+            uint64_t value = i * 3;
+            hashmap_qp_insert(map, i, &value);
+        }
+        for (uint64_t i = 0; i < 10000; i += 3) {
+            hashmap_qp_delete(map, i);
+        }
+        mu_assert("error, map must be saved",
+                  ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0 && hashmap_qp_save(map, fd));
+        hashmap_qp_free(map);
+
+        struct hashmap_qp *mapped = hashmap_qp_open_mmap(path, hasher);
+        mu_assert("error, saved map must be opened", mapped != NULL && mapped->entries_count == 6666);
+        for (uint64_t i = 0; i < 10001; ++i) {
+            uint64_t *found = hashmap_qp_find(mapped, i);
+            if (i % 3 == 0 || i == 10000) {
+                mu_assert("error, deleted or absent key mustn't be found in the file", found == NULL);
+            } else {
+                mu_assert("error, saved value must be found in the file", found != NULL && *found == i * 3);
+            }
+        }
+        uint64_t value = 0;
+        mu_assert("error, mapped map mustn't take inserts", !hashmap_qp_insert(mapped, 1, &value));
+        mu_assert("error, mapped map mustn't take deletes", !hashmap_qp_delete(mapped, 1));
+        mu_assert("error, mapped map mustn't grow", !hashmap_qp_reserve(mapped, 100000));
+        hashmap_qp_clear(mapped);
+        mu_assert("error, mapped map mustn't be cleared", *(uint64_t *) hashmap_qp_find(mapped, 1) == 3);
+        hashmap_qp_free(mapped);
+    }
+
+    mu_assert("error, file saved with another hasher mustn't be opened",
+              hashmap_qp_open_mmap(path, fake_hasher) == NULL);
+    uint64_t garbage[4] = {1, 2, 3, 4};
+    mu_assert("error, garbage must be written", pwrite(fd, garbage, sizeof(garbage), 0) == sizeof(garbage));
+    mu_assert("error, garbage mustn't be opened", hashmap_qp_open_mmap(path, hasher) == NULL);
+    mu_assert("error, missing file mustn't be opened", hashmap_qp_open_mmap("/nonexistent", hasher) == NULL);
+    close(fd);
+    unlink(path);
+
+    return 0;
+}
+
+struct point {
+    int32_t x;
+    int32_t y;
+};
+
+HASHMAP_QP_DEFINE(points, hasher, struct point)
+HASHMAP_QP_DEFINE(colliding_points, fake_hasher, struct point)
+
+static char *test_specialized() {
+    struct points *map = points_new();
+    for (int32_t i = 0; i < 100000; ++i) {
+        mu_assert("error, specialized map must take new keys", points_insert(map, i, (struct point) {i, -i}));
+    }
+    mu_assert("error, entries count must be 100000", map->entries_count == 100000);
+    for (int32_t i = 0; i < 100000; ++i) {
+        struct point *found = points_find(map, i);
+        mu_assert("error, all inserted values must be found", found != NULL && found->x == i && found->y == -i);
+    }
+    mu_assert("error, absent key mustn't be found", points_find(map, 100000) == NULL);
+    for (int32_t i = 0; i < 100000; i += 2) {
+        mu_assert("error, present key must be deleted", points_delete(map, i));
+        mu_assert("error, deleted key mustn't be deleted again", !points_delete(map, i));
+    }
+    for (int32_t i = 0; i < 100000; ++i) {
+        mu_assert("error, only deleted keys must be gone", (points_find(map, i) == NULL) == (i % 2 == 0));
+    }
+    mu_assert("error, reserve must keep the entries", points_reserve(map, 1000000) && points_find(map, 1) != NULL);
+    points_clear(map);
+    mu_assert("error, clear must drop the entries", map->entries_count == 0 && points_find(map, 1) == NULL);
+    points_insert(map, 1, (struct point) {1, 1});
+    mu_assert("error, map must take keys after clear", points_find(map, 1)->x == 1);
+    points_free(map);
+
+    // Keys deleted ahead of an existing one mustn't let it in for the second time
+    struct colliding_points *colliding = colliding_points_new();
+    for (int32_t i = 1; i <= 6; ++i) {
+        colliding_points_insert(colliding, i, (struct point) {i, i});
+    }
+    for (int32_t i = 1; i <= 3; ++i) {
+        colliding_points_delete(colliding, i);
+    }
+    for (int32_t i = 4; i <= 6; ++i) {
+        colliding_points_insert(colliding, i, (struct point) {-i, -i});
+    }
+    mu_assert("error, existing keys must be replaced", colliding->entries_count == 3);
+    for (int32_t i = 4; i <= 6; ++i) {
+        colliding_points_delete(colliding, i);
+        mu_assert("error, replaced key must be deleted at once", colliding_points_find(colliding, i) == NULL);
+    }
+    colliding_points_free(colliding);
+
+    return 0;
+}
+
 static char *all_tests() {
     mu_run_test(test_constructs);
     mu_run_test(test_inserts);
     mu_run_test(test_finds);
     mu_run_test(test_deletes);
+    mu_run_test(test_reinsert_past_released);
     mu_run_test(test_resizes);
+    mu_run_test(test_power_of_two);
+    mu_run_test(test_inline_values);
+    mu_run_test(test_find_batch);
+    mu_run_test(test_insert_batch);
+    mu_run_test(test_reserve_and_shrink);
+    mu_run_test(test_incremental_resize);
+    mu_run_test(test_allocators);
+    mu_run_test(test_parallel_resize);
+    mu_run_test(test_parallel_clear);
+    mu_run_test(test_clear_generations);
+    mu_run_test(test_tuning);
+    mu_run_test(test_iteration);
+    mu_run_test(test_snapshot);
+    mu_run_test(test_specialized);
 
     return NULL;
 }
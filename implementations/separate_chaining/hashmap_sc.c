@@ -1,14 +1,40 @@
 #include "hashmap_sc.h"
+#include "../hashmap_parallel.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_LOAD_FACTOR 3
+#define DEFAULT_MAX_LOAD_FACTOR 300
+#define DEFAULT_GROWTH_FACTOR 200
+#define INITIAL_BUCKETS_COUNT 10
+#define BATCH_WIDTH 16
+#define MIGRATION_STEP 4
+#define PARALLEL_RESIZE_MIN_BUCKETS 65536
+#define PARALLEL_CLEAR_MIN_BUCKETS 65536
 
 struct hashmap_sc {
     uint32_t entries_count;
     uint32_t buckets_count;
     struct bucket *buckets;
+    // In percent: average entries per bucket the array grows at, and how much it grows by
+    unsigned max_load_factor;
+    unsigned growth_factor;
+    size_t value_size;
+    // Size of an entry together with its value, inline values are kept 8-byte aligned
+    size_t entry_size;
+    bool incremental_resize;
+    size_t resize_threads;
+    size_t clear_threads;
+    // During an incremental resize old_buckets_count is not zero, and every insert or delete
+    // empties the next MIGRATION_STEP of the old buckets, starting from migrated_count.
+    struct bucket *old_buckets;
+    uint32_t old_buckets_count;
+    uint32_t migrated_count;
+    // Resizes so far, so a scan knows its cursor points into other buckets
+    uint64_t resizes_count;
+    // The map and its arrays of buckets come from allocator, the entries from bucket_allocator
+    struct hashmap_allocator allocator;
+    struct hashmap_allocator bucket_allocator;
 
     uint64_t (*hasher)(uint64_t);
 
@@ -24,161 +50,619 @@ struct bucket {
 struct entry {
     uint64_t hash;
     uint64_t key;
-    void *value;
+    // Either the passed pointer or value_size bytes of the value itself
+    unsigned char value[];
 };
 
-static void resize_if_load_factor_exceeded(struct hashmap_sc *const self) {
-    if (1. * self->entries_count / self->buckets_count < MAX_LOAD_FACTOR) {
-        return;
+static inline struct entry *entry_at(const struct hashmap_sc *const self, const struct bucket *const bucket,
+                                     size_t index) {
+    return (struct entry *) ((unsigned char *) bucket->buffer + index * self->entry_size);
+}
+
+// Pointers are stored as is, inline values are copied from the pointed memory.
+static inline void value_store(const struct hashmap_sc *const self, struct entry *entry, void *value) {
+    if (self->value_size == 0) {
+        memcpy(entry->value, &value, sizeof(void *));
+    } else if (value != NULL) {
+        memcpy(entry->value, value, self->value_size);
+    } else {
+        memset(entry->value, 0, self->value_size);
     }
+}
 
-    uint32_t new_buckets_count = 2 * self->buckets_count;
-    struct bucket *new_buckets =
-            calloc(new_buckets_count, sizeof(struct bucket));
-    memcpy(new_buckets, self->buckets, self->buckets_count * sizeof(struct bucket));
-    for (size_t i = 0; i < self->buckets_count; ++i) {
-        struct bucket *iter = new_buckets + i;
-        for (size_t j = 0; j < iter->size; ++j) {
-            size_t new_hash_index = iter->buffer[j].hash % new_buckets_count;
-            if (new_hash_index == i) {
-                continue;
-            }
+static inline void *value_load(const struct hashmap_sc *const self, struct entry *entry) {
+    if (self->value_size != 0) {
+        return entry->value;
+    }
+    void *value;
+    memcpy(&value, entry->value, sizeof(void *));
+    return value;
+}
 
-            struct entry current = iter->buffer[j];
-            if (iter->size - 1 != j) {
-                iter->buffer[j] = iter->buffer[iter->size - 1];
-            }
-            iter->size--;
-            j--;
-
-            struct bucket *bucket = new_buckets + new_hash_index;
-            if (bucket->buffer == NULL) {
-                bucket->size = 0;
-                bucket->capacity = 1;
-                bucket->buffer = malloc(sizeof(struct entry));
-            } else if (bucket->size == bucket->capacity) {
-                bucket->capacity *= 2;
-                bucket->buffer = reallocarray(bucket->buffer, bucket->capacity, sizeof(struct entry));
+static inline void value_release(const struct hashmap_sc *const self, struct entry *entry) {
+    if (self->value_free != NULL) {
+        self->value_free(value_load(self, entry));
+    }
+}
+
+// Returns the place for a new entry at the end of the bucket, or NULL if the bucket can't grow.
+static struct entry *bucket_push(const struct hashmap_sc *const self, struct bucket *bucket) {
+    const struct hashmap_allocator *allocator = &self->bucket_allocator;
+    if (bucket->buffer == NULL) {
+        bucket->buffer = allocator->alloc(allocator->context, self->entry_size);
+        if (bucket->buffer == NULL) {
+            return NULL;
+        }
+        bucket->size = 0;
+        bucket->capacity = 1;
+    } else if (bucket->size == bucket->capacity) {
+        struct entry *buffer = allocator->realloc(allocator->context, bucket->buffer,
+                                                  bucket->capacity * self->entry_size,
+                                                  2 * bucket->capacity * self->entry_size);
+        if (buffer == NULL) {
+            return NULL;
+        }
+        bucket->buffer = buffer;
+        bucket->capacity *= 2;
+    }
+
+    bucket->size++;
+    return entry_at(self, bucket, bucket->size - 1);
+}
+
+static void bucket_remove(const struct hashmap_sc *const self, struct bucket *bucket, size_t index) {
+    if (bucket->size - 1 != index) {
+        memcpy(entry_at(self, bucket, index), entry_at(self, bucket, bucket->size - 1), self->entry_size);
+    }
+    bucket->size--;
+}
+
+// Smallest buckets count that keeps entries_count entries under the load factor,
+// but not less than the initial one.
+static uint32_t buckets_count_for(const struct hashmap_sc *const self, uint64_t entries_count) {
+    uint64_t buckets_count = 100 * entries_count / self->max_load_factor + 1;
+    return buckets_count < INITIAL_BUCKETS_COUNT ? INITIAL_BUCKETS_COUNT : buckets_count;
+}
+
+// Buckets count the array grows to, at least one bucket more than it has.
+static uint32_t grown_buckets_count(const struct hashmap_sc *const self) {
+    uint64_t buckets_count = (uint64_t) self->buckets_count * self->growth_factor / 100;
+    return buckets_count > self->buckets_count ? buckets_count : self->buckets_count + 1;
+}
+
+static void buckets_free(const struct hashmap_sc *const self, struct bucket *buckets, uint32_t buckets_count) {
+    for (size_t i = 0; i < buckets_count; ++i) {
+        self->bucket_allocator.free(self->bucket_allocator.context, buckets[i].buffer,
+                                    buckets[i].capacity * self->entry_size);
+    }
+    self->allocator.free(self->allocator.context, buckets, buckets_count * sizeof(struct bucket));
+}
+
+struct resize_task {
+    const struct hashmap_sc *self;
+    struct bucket *new_buckets;
+    uint32_t new_buckets_count;
+    // Other threads count and fill the same new buckets at once
+    bool shared;
+};
+
+// Counts the entries of the old buckets from begin to end into the capacities of the new ones.
+static void count_range(void *context, uint64_t begin, uint64_t end) {
+    struct resize_task *task = context;
+    for (size_t i = begin; i < end; ++i) {
+        struct bucket *bucket = task->self->buckets + i;
+        for (size_t j = 0; j < bucket->size; ++j) {
+            uint64_t hash = entry_at(task->self, bucket, j)->hash;
+            struct bucket *new_bucket = task->new_buckets + hash % task->new_buckets_count;
+            if (task->shared) {
+                __atomic_fetch_add(&new_bucket->capacity, 1, __ATOMIC_RELAXED);
+            } else {
+                new_bucket->capacity++;
             }
+        }
+    }
+}
+
+// Copies the entries of the old buckets from begin to end into the new ones, which are already sized for them.
+static void fill_range(void *context, uint64_t begin, uint64_t end) {
+    struct resize_task *task = context;
+    for (size_t i = begin; i < end; ++i) {
+        struct bucket *bucket = task->self->buckets + i;
+        for (size_t j = 0; j < bucket->size; ++j) {
+            struct entry *entry = entry_at(task->self, bucket, j);
+            struct bucket *new_bucket = task->new_buckets + entry->hash % task->new_buckets_count;
+            uint32_t index = task->shared ? __atomic_fetch_add(&new_bucket->size, 1, __ATOMIC_RELAXED)
+                                          : new_bucket->size++;
+            memcpy(entry_at(task->self, new_bucket, index), entry, task->self->entry_size);
+        }
+    }
+}
 
-            bucket->buffer[bucket->size] = current;
-            bucket->size++;
+// Moves the entries to a new array of buckets, each sized exactly for its entries. Everything is
+// allocated before the first entry moves, so the map stays as it was when there is no memory.
+// Entries are counted and copied by resize_threads threads, each taking its own part of the old
+// buckets, and the buffers are allocated in between in the calling thread, because the bucket
+// allocator may not be thread-safe.
+static bool resize_map(struct hashmap_sc *const self, uint32_t new_buckets_count) {
+    struct bucket *new_buckets =
+            self->allocator.alloc_zeroed(self->allocator.context, new_buckets_count * sizeof(struct bucket));
+    if (new_buckets == NULL) {
+        return false;
+    }
+    size_t threads_count = self->buckets_count >= PARALLEL_RESIZE_MIN_BUCKETS ? self->resize_threads : 1;
+    struct resize_task task = {.self = self, .new_buckets = new_buckets, .new_buckets_count = new_buckets_count,
+                               .shared = threads_count > 1};
+    hashmap_parallel_for(threads_count, self->buckets_count, count_range, &task);
+    for (size_t i = 0; i < new_buckets_count; ++i) {
+        struct bucket *bucket = new_buckets + i;
+        if (bucket->capacity == 0) {
+            continue;
+        }
+        bucket->buffer = self->bucket_allocator.alloc(self->bucket_allocator.context,
+                                                      bucket->capacity * self->entry_size);
+        if (bucket->buffer == NULL) {
+            buckets_free(self, new_buckets, new_buckets_count);
+            return false;
         }
     }
+    hashmap_parallel_for(threads_count, self->buckets_count, fill_range, &task);
 
+    buckets_free(self, self->buckets, self->buckets_count);
     self->buckets_count = new_buckets_count;
-    free(self->buckets);
     self->buckets = new_buckets;
+    self->resizes_count++;
+    return true;
 }
 
-static struct entry *find_inner(struct hashmap_sc *const self, uint64_t key) {
-    size_t hash_index = self->hasher(key) % self->buckets_count;
-    struct bucket b = self->buckets[hash_index];
-    for (size_t i = 0; i < b.size; ++i) {
-        if (b.buffer[i].key == key) {
-            return b.buffer + i;
+// Moves the entries of up to count old buckets into the current ones and frees the old buckets
+// once all are empty. Entries are taken from the end of an old bucket, so if a current bucket
+// can't grow, the rest of them stay where lookups still find them and false is returned.
+static bool migrate(struct hashmap_sc *const self, uint32_t count) {
+    uint32_t end = self->old_buckets_count - self->migrated_count > count ? self->migrated_count + count
+                                                                           : self->old_buckets_count;
+    for (; self->migrated_count < end; ++self->migrated_count) {
+        struct bucket *old = self->old_buckets + self->migrated_count;
+        for (; old->size > 0; --old->size) {
+            struct entry *entry = entry_at(self, old, old->size - 1);
+            struct entry *moved = bucket_push(self, self->buckets + entry->hash % self->buckets_count);
+            if (moved == NULL) {
+                return false;
+            }
+            memcpy(moved, entry, self->entry_size);
+        }
+        self->bucket_allocator.free(self->bucket_allocator.context, old->buffer, old->capacity * self->entry_size);
+        old->buffer = NULL;
+        old->capacity = 0;
+    }
+    if (self->migrated_count == self->old_buckets_count) {
+        buckets_free(self, self->old_buckets, self->old_buckets_count);
+        self->old_buckets_count = 0;
+    }
+    return true;
+}
+
+static bool finish_migration(struct hashmap_sc *const self) {
+    return self->old_buckets_count == 0 || migrate(self, self->old_buckets_count);
+}
+
+// Returns false if the map should grow but there is no memory for it.
+static bool resize_if_load_factor_exceeded(struct hashmap_sc *const self) {
+    if (100 * (uint64_t) self->entries_count < (uint64_t) self->max_load_factor * self->buckets_count) {
+        return true;
+    }
+
+    if (!self->incremental_resize) {
+        return resize_map(self, grown_buckets_count(self));
+    }
+    if (!finish_migration(self)) {
+        return false;
+    }
+    uint32_t buckets_count = grown_buckets_count(self);
+    struct bucket *buckets =
+            self->allocator.alloc_zeroed(self->allocator.context, buckets_count * sizeof(struct bucket));
+    if (buckets == NULL) {
+        return false;
+    }
+    self->old_buckets = self->buckets;
+    self->old_buckets_count = self->buckets_count;
+    self->migrated_count = 0;
+    self->buckets_count = buckets_count;
+    self->buckets = buckets;
+    self->resizes_count++;
+    return true;
+}
+
+static struct entry *bucket_find(const struct hashmap_sc *const self, const struct bucket *const bucket,
+                                 uint64_t key) {
+    for (size_t i = 0; i < bucket->size; ++i) {
+        struct entry *entry = entry_at(self, bucket, i);
+        if (entry->key == key) {
+            return entry;
         }
     }
     return NULL;
 }
 
+// Looks into the old buckets as well while they are being migrated.
+static struct entry *find_inner(struct hashmap_sc *const self, uint64_t key, uint64_t hash) {
+    struct entry *entry = bucket_find(self, self->buckets + hash % self->buckets_count, key);
+    if (entry == NULL && self->old_buckets_count != 0) {
+        entry = bucket_find(self, self->old_buckets + hash % self->old_buckets_count, key);
+    }
+    return entry;
+}
+
+static bool bucket_delete(struct hashmap_sc *const self, struct bucket *bucket, uint64_t key) {
+    for (size_t i = 0; i < bucket->size; ++i) {
+        struct entry *entry = entry_at(self, bucket, i);
+        if (entry->key != key) {
+            continue;
+        }
+        value_release(self, entry);
+        bucket_remove(self, bucket, i);
+        self->entries_count--;
+        return true;
+    }
+    return false;
+}
+
+struct release_task {
+    const struct hashmap_sc *self;
+    struct bucket *buckets;
+    bool empty_buckets;
+};
+
+static void release_range(void *context, uint64_t begin, uint64_t end) {
+    const struct release_task *task = context;
+    for (size_t i = begin; i < end; ++i) {
+        struct bucket *bucket = task->buckets + i;
+        if (task->self->value_free != NULL) {
+            for (size_t j = 0; j < bucket->size; ++j) {
+                value_release(task->self, entry_at(task->self, bucket, j));
+            }
+        }
+        if (task->empty_buckets) {
+            bucket->size = 0;
+        }
+    }
+}
+
+// Releases the values kept in the buckets and, if empty_buckets is set, drops the entries while the
+// bucket is still in cache. Without value_free and empty_buckets there is nothing to walk them for.
+static void release_values(struct hashmap_sc *const self, struct bucket *buckets, uint32_t buckets_count,
+                           bool empty_buckets) {
+    if (self->value_free == NULL && !empty_buckets) {
+        return;
+    }
+    struct release_task task = {.self = self, .buckets = buckets, .empty_buckets = empty_buckets};
+    size_t threads_count = buckets_count >= PARALLEL_CLEAR_MIN_BUCKETS ? self->clear_threads : 1;
+    hashmap_parallel_for(threads_count, buckets_count, release_range, &task);
+}
+
 struct hashmap_sc *hashmap_sc_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
-    struct hashmap_sc *self = malloc(sizeof(struct hashmap_sc));
+    return hashmap_sc_new_with_options(hasher, value_free, (struct hashmap_sc_options) {0});
+}
+
+struct hashmap_sc *hashmap_sc_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity) {
+    return hashmap_sc_new_with_options(hasher, value_free, (struct hashmap_sc_options) {.capacity = capacity});
+}
+
+struct hashmap_sc *hashmap_sc_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_sc_options options) {
+    // Growing must add buckets
+    if (options.growth_factor != 0 && options.growth_factor <= 100) {
+        return NULL;
+    }
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_sc *self = allocator->alloc(allocator->context, sizeof(struct hashmap_sc));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    self->bucket_allocator = options.bucket_allocator != NULL ? *options.bucket_allocator : *allocator;
     self->entries_count = 0;
-    self->buckets_count = 10;
+    self->max_load_factor = options.max_load_factor != 0 ? options.max_load_factor : DEFAULT_MAX_LOAD_FACTOR;
+    self->growth_factor = options.growth_factor != 0 ? options.growth_factor : DEFAULT_GROWTH_FACTOR;
+    self->buckets_count = buckets_count_for(self, options.capacity);
     self->hasher = hasher;
-    self->buckets = calloc(self->buckets_count, sizeof(struct bucket));
+    self->buckets = allocator->alloc_zeroed(allocator->context, self->buckets_count * sizeof(struct bucket));
+    if (self->buckets == NULL) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_sc));
+        return NULL;
+    }
+    self->value_size = options.value_size;
+    size_t value_stride = options.value_size == 0 ? sizeof(void *) : (options.value_size + 7) & ~(size_t) 7;
+    self->entry_size = sizeof(struct entry) + value_stride;
+    self->incremental_resize = options.incremental_resize;
+    self->resize_threads = options.resize_threads;
+    self->clear_threads = options.clear_threads;
+    self->old_buckets_count = 0;
+    self->resizes_count = 0;
     self->value_free = value_free;
 
     return self;
 }
 
+struct hashmap_sc *hashmap_sc_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              struct hashmap_sc_options options,
+                                              const uint64_t *keys, void *const *values, size_t n) {
+    if (options.capacity < n) {
+        options.capacity = n;
+    }
+    struct hashmap_sc *self = hashmap_sc_new_with_options(hasher, value_free, options);
+    if (!hashmap_sc_insert_batch(self, keys, values, n)) {
+        hashmap_sc_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
 bool hashmap_sc_insert(struct hashmap_sc *const self, uint64_t key, void *value) {
     if (self == NULL) {
         return false;
     }
 
-    struct entry *c = find_inner(self, key);
+    if (self->old_buckets_count != 0) {
+        migrate(self, MIGRATION_STEP);
+    }
+
+    uint64_t hash = self->hasher(key);
+    struct entry *c = find_inner(self, key, hash);
     if (c != NULL) {
-        self->value_free(c->value);
-        c->value = value;
+        value_release(self, c);
+        value_store(self, c, value);
         return true;
     }
 
+    // A map that can't grow keeps chaining into longer buckets
     resize_if_load_factor_exceeded(self);
 
-    uint64_t hash = self->hasher(key);
     size_t hash_index = hash % self->buckets_count;
-    struct entry new_entry = (struct entry) {
-            .key = key,
-            .value = value,
-            .hash = hash
-    };
-
-    struct bucket *bucket = self->buckets + hash_index;
-    if (bucket->buffer == NULL) {
-        bucket->size = 0;
-        bucket->capacity = 1;
-        bucket->buffer = malloc(sizeof(struct entry));
-    } else if (bucket->size == bucket->capacity) {
-        bucket->capacity *= 2;
-        bucket->buffer = reallocarray(bucket->buffer, bucket->capacity, sizeof(struct entry));
+    struct entry *new_entry = bucket_push(self, self->buckets + hash_index);
+    if (new_entry == NULL) {
+        return false;
     }
-
-    bucket->buffer[bucket->size] = new_entry;
-    bucket->size++;
+    new_entry->hash = hash;
+    new_entry->key = key;
+    value_store(self, new_entry, value);
     self->entries_count++;
 
     return true;
 }
 
+bool hashmap_sc_insert_batch(struct hashmap_sc *const self, const uint64_t *keys, void *const *values, size_t n) {
+    if (self == NULL) {
+        return false;
+    }
+
+    // One resize up front instead of a doubling every time the load factor is hit
+    if (!hashmap_sc_reserve(self, self->entries_count + n)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!hashmap_sc_insert(self, keys[i], values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void *hashmap_sc_find(struct hashmap_sc *const self, uint64_t key) {
     if (self == NULL) {
         return NULL;
     }
 
-    struct entry *e = find_inner(self, key);
+    struct entry *e = find_inner(self, key, self->hasher(key));
     if (e == NULL) {
         return NULL;
     } else {
-        return e->value;
+        return value_load(self, e);
     }
 }
 
-bool hashmap_sc_delete(struct hashmap_sc *const self, uint64_t key) {
+// Keys are resolved in groups of BATCH_WIDTH: the whole group is hashed and its home buckets are
+// prefetched before the first probe, so the cache misses of the group overlap.
+void hashmap_sc_find_batch(struct hashmap_sc *const self, const uint64_t *keys, size_t n, void **out) {
     if (self == NULL) {
-        return false;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = NULL;
+        }
+        return;
     }
 
-    size_t hash_index = self->hasher(key) % self->buckets_count;
-    struct bucket *bucket = self->buckets + hash_index;
-    for (size_t i = 0; i < bucket->size; ++i) {
-        if (bucket->buffer[i].key != key) {
-            continue;
+    uint64_t hashes[BATCH_WIDTH];
+    for (size_t start = 0; start < n; start += BATCH_WIDTH) {
+        size_t width = n - start < BATCH_WIDTH ? n - start : BATCH_WIDTH;
+        for (size_t i = 0; i < width; ++i) {
+            hashes[i] = self->hasher(keys[start + i]);
+            __builtin_prefetch(self->buckets + hashes[i] % self->buckets_count);
         }
-        self->value_free(bucket->buffer[i].value);
-        if (bucket->size - 1 != i) {
-            bucket->buffer[i] = bucket->buffer[bucket->size - 1];
+        // Entries live behind the bucket, so they are fetched in a second pass
+        for (size_t i = 0; i < width; ++i) {
+            __builtin_prefetch(self->buckets[hashes[i] % self->buckets_count].buffer);
         }
-        bucket->size--;
-        self->entries_count--;
+        for (size_t i = 0; i < width; ++i) {
+            struct entry *e = find_inner(self, keys[start + i], hashes[i]);
+            out[start + i] = e == NULL ? NULL : value_load(self, e);
+        }
+    }
+}
+
+bool hashmap_sc_delete(struct hashmap_sc *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    if (self->old_buckets_count != 0) {
+        migrate(self, MIGRATION_STEP);
+    }
+
+    uint64_t hash = self->hasher(key);
+    if (bucket_delete(self, self->buckets + hash % self->buckets_count, key)) {
         return true;
     }
+    return self->old_buckets_count != 0 &&
+           bucket_delete(self, self->old_buckets + hash % self->old_buckets_count, key);
+}
 
+// Moves the position to the next entry from it on and returns false if there is none.
+static bool iter_buckets(const struct bucket *const buckets, uint32_t buckets_count, uint64_t *bucket,
+                         uint64_t *index) {
+    for (; *bucket < buckets_count; ++*bucket, *index = 0) {
+        if (*index < buckets[*bucket].size) {
+            return true;
+        }
+    }
     return false;
 }
 
-void hashmap_sc_clear(struct hashmap_sc *const self) {
+void hashmap_sc_iter_begin(struct hashmap_sc *const self, struct hashmap_sc_iter *iter) {
+    iter->bucket = 0;
+    iter->index = 0;
+    iter->old = self != NULL && self->old_buckets_count != 0;
+}
+
+// The old buckets go first, the ones already moved out of are empty.
+bool hashmap_sc_iter_next(struct hashmap_sc *const self, struct hashmap_sc_iter *iter, uint64_t *key, void **value) {
     if (self == NULL) {
+        return false;
+    }
+
+    const struct bucket *buckets = self->buckets;
+    if (iter->old) {
+        if (iter_buckets(self->old_buckets, self->old_buckets_count, &iter->bucket, &iter->index)) {
+            buckets = self->old_buckets;
+        } else {
+            iter->old = false;
+            iter->bucket = 0;
+            iter->index = 0;
+        }
+    }
+    if (!iter->old && !iter_buckets(buckets, self->buckets_count, &iter->bucket, &iter->index)) {
+        return false;
+    }
+    struct entry *entry = entry_at(self, buckets + iter->bucket, iter->index);
+    *key = entry->key;
+    *value = value_load(self, entry);
+    iter->index++;
+    return true;
+}
+
+// Visits the entries of up to count buckets from bucket on, moves bucket past them and returns how many were walked.
+static uint64_t scan_buckets(const struct hashmap_sc *const self, const struct bucket *const buckets,
+                             uint32_t buckets_count, uint64_t *bucket, uint64_t count,
+                             void (*visit)(void *context, uint64_t key, void *value), void *context) {
+    uint64_t end = buckets_count - *bucket > count ? *bucket + count : buckets_count;
+    uint64_t walked = end - *bucket;
+    for (; *bucket < end; ++*bucket) {
+        for (size_t i = 0; i < buckets[*bucket].size; ++i) {
+            struct entry *entry = entry_at(self, buckets + *bucket, i);
+            visit(context, entry->key, value_load(self, entry));
+        }
+    }
+    return walked;
+}
+
+void hashmap_sc_cursor_begin(struct hashmap_sc *const self, struct hashmap_sc_cursor *cursor) {
+    *cursor = (struct hashmap_sc_cursor) {0};
+    if (self != NULL) {
+        cursor->resizes_count = self->resizes_count;
+        cursor->old = self->old_buckets_count != 0;
+    }
+}
+
+// Entries move between buckets only on resizes and migration, and a whole bucket is scanned in one call,
+// so reordering within a bucket on delete doesn't concern the cursor.
+bool hashmap_sc_scan(struct hashmap_sc *const self, struct hashmap_sc_cursor *cursor, size_t count,
+                     void (*visit)(void *context, uint64_t key, void *value), void *context) {
+    if (self == NULL || cursor->finished) {
+        return false;
+    }
+
+    if (cursor->resizes_count != self->resizes_count) {
+        // The scanned buckets may have just become the old ones of an incremental resize, then the scan goes on there
+        bool kept = !cursor->old && self->old_buckets_count != 0 && cursor->resizes_count + 1 == self->resizes_count;
+        cursor->bucket = kept ? cursor->bucket : 0;
+        cursor->old = self->old_buckets_count != 0;
+    } else if (cursor->old && self->old_buckets_count == 0) {
+        // The migration is over, so the entries not scanned in the old buckets are somewhere in the current ones
+        cursor->old = false;
+        cursor->bucket = 0;
+    }
+    cursor->resizes_count = self->resizes_count;
+
+    if (cursor->old) {
+        count -= scan_buckets(self, self->old_buckets, self->old_buckets_count, &cursor->bucket, count, visit,
+                              context);
+        if (cursor->bucket < self->old_buckets_count) {
+            return true;
+        }
+        cursor->old = false;
+        cursor->bucket = 0;
+    }
+    scan_buckets(self, self->buckets, self->buckets_count, &cursor->bucket, count, visit, context);
+    if (cursor->bucket < self->buckets_count) {
+        return true;
+    }
+    cursor->finished = true;
+    return false;
+}
+
+bool hashmap_sc_reserve(struct hashmap_sc *const self, size_t capacity) {
+    if (self == NULL || !finish_migration(self)) {
+        return false;
+    }
+
+    uint32_t buckets_count = buckets_count_for(self, capacity);
+    return buckets_count <= self->buckets_count || resize_map(self, buckets_count);
+}
+
+void hashmap_sc_shrink_to_fit(struct hashmap_sc *const self) {
+    // If there is no memory for the smaller buckets, the map just stays as it is
+    if (self == NULL || !finish_migration(self)) {
         return;
     }
 
+    uint32_t buckets_count = buckets_count_for(self, self->entries_count);
+    if (buckets_count < self->buckets_count && resize_map(self, buckets_count)) {
+        return;
+    }
+    // Buckets keep their capacity after deletes and clear, so it is given back here
+    const struct hashmap_allocator *allocator = &self->bucket_allocator;
     for (size_t i = 0; i < self->buckets_count; ++i) {
         struct bucket *bucket = self->buckets + i;
-        for (size_t j = 0; j < bucket->size; ++j) {
-            self->value_free(bucket->buffer[j].value);
+        if (bucket->size == bucket->capacity) {
+            continue;
         }
-        bucket->size = 0;
+        if (bucket->size == 0) {
+            allocator->free(allocator->context, bucket->buffer, bucket->capacity * self->entry_size);
+            bucket->buffer = NULL;
+        } else {
+            struct entry *buffer = allocator->realloc(allocator->context, bucket->buffer,
+                                                      bucket->capacity * self->entry_size,
+                                                      bucket->size * self->entry_size);
+            if (buffer == NULL) {
+                continue;
+            }
+            bucket->buffer = buffer;
+        }
+        bucket->capacity = bucket->size;
+    }
+}
+
+void hashmap_sc_clear(struct hashmap_sc *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    release_values(self, self->buckets, self->buckets_count, true);
+    if (self->old_buckets_count != 0) {
+        release_values(self, self->old_buckets, self->old_buckets_count, false);
+        buckets_free(self, self->old_buckets, self->old_buckets_count);
+        self->old_buckets_count = 0;
     }
     self->entries_count = 0;
 }
@@ -188,13 +672,12 @@ void hashmap_sc_free(struct hashmap_sc *const self) {
         return;
     }
 
-    for (size_t i = 0; i < self->buckets_count; ++i) {
-        struct bucket *bucket = self->buckets + i;
-        for (size_t j = 0; j < bucket->size; ++j) {
-            self->value_free(bucket->buffer[j].value);
-        }
-        free(bucket->buffer);
+    release_values(self, self->buckets, self->buckets_count, false);
+    buckets_free(self, self->buckets, self->buckets_count);
+    if (self->old_buckets_count != 0) {
+        release_values(self, self->old_buckets, self->old_buckets_count, false);
+        buckets_free(self, self->old_buckets, self->old_buckets_count);
     }
-    free(self->buckets);
-    free(self);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_sc));
 }
@@ -2,18 +2,105 @@
 #define HASHMAPS_HASHMAP_SC_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "../hashmap_allocator.h"
 
 struct hashmap_sc;
 
+struct hashmap_sc_options {
+    // Store values of this size right in the buckets instead of the passed pointers. Insert then copies
+    // value_size bytes from the passed pointer, and find returns a pointer into the bucket, which stays
+    // valid until the next insert or delete. Zero keeps the passed pointers.
+    size_t value_size;
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Average entries per bucket, in percent, the array grows at. Zero keeps 300, three entries per bucket.
+    unsigned max_load_factor;
+    // Percent the buckets count is multiplied by when the array grows, above 100. Zero keeps 200.
+    unsigned growth_factor;
+    // Grow by moving a few buckets into the bigger array on every insert and delete instead of
+    // rehashing all of them at once. Until the move is over, lookups check both arrays.
+    bool incremental_resize;
+    // Rehash arrays of at least 65536 buckets with this many threads, each moving the entries of its own
+    // part of the old buckets. Zero or one rehashes in the calling thread.
+    size_t resize_threads;
+    // Release the values of tables of at least 65536 buckets in clear and free with this many threads,
+    // each taking its own part of the buckets. value_free is then called from all of them at once,
+    // so it must be thread-safe. Zero or one releases them in the calling thread.
+    size_t clear_threads;
+    // Where the map itself and its array of buckets are allocated. NULL means malloc and free.
+    const struct hashmap_allocator *allocator;
+    // Where the entries of the buckets are allocated. NULL means the same allocator as above.
+    const struct hashmap_allocator *bucket_allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map or the options are out of range, and inserts return false when
+// there is no memory to grow it.
 struct hashmap_sc *hashmap_sc_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
 
+struct hashmap_sc *hashmap_sc_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity);
+
+struct hashmap_sc *hashmap_sc_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_sc_options options);
+
+// Builds a map from n entries, sized for all of them up front.
+struct hashmap_sc *hashmap_sc_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              struct hashmap_sc_options options,
+                                              const uint64_t *keys, void *const *values, size_t n);
+
 bool hashmap_sc_insert(struct hashmap_sc *self, uint64_t key, void *value);
 
+// Inserts n entries into a map sized for all of them up front, values[i] is passed as to hashmap_sc_insert.
+bool hashmap_sc_insert_batch(struct hashmap_sc *self, const uint64_t *keys, void *const *values, size_t n);
+
 void *hashmap_sc_find(struct hashmap_sc *self, uint64_t key);
 
+// Looks up n keys at once, out[i] gets what hashmap_sc_find would return for keys[i].
+void hashmap_sc_find_batch(struct hashmap_sc *self, const uint64_t *keys, size_t n, void **out);
+
 bool hashmap_sc_delete(struct hashmap_sc *self, uint64_t key);
 
+// Position of a walk over all the entries. The fields are internal.
+struct hashmap_sc_iter {
+    uint64_t bucket;
+    uint64_t index;
+    bool old;
+};
+
+void hashmap_sc_iter_begin(struct hashmap_sc *self, struct hashmap_sc_iter *iter);
+
+// Stores the next entry into key and value, which gets what hashmap_sc_find would return for the key, and returns
+// false when no entries are left. The buckets are walked in order, so the map must not change until the walk is over.
+bool hashmap_sc_iter_next(struct hashmap_sc *self, struct hashmap_sc_iter *iter, uint64_t *key, void **value);
+
+// Position of a scan, which unlike hashmap_sc_iter may be resumed after the map changed. The fields are internal.
+struct hashmap_sc_cursor {
+    uint64_t bucket;
+    uint64_t resizes_count;
+    bool old;
+    bool finished;
+};
+
+void hashmap_sc_cursor_begin(struct hashmap_sc *self, struct hashmap_sc_cursor *cursor);
+
+// Calls visit for the entries of the next count buckets and returns false once the last bucket is scanned. Between
+// the calls the map may change: an entry that stays in it for the whole scan is visited at least once, entries
+// inserted or deleted meanwhile may be visited or not. An incremental resize keeps the scanned buckets as the old
+// ones, so the scan goes on, but after any other resize it starts over in the new buckets, and so entries may be
+// visited more than once. visit itself must not change the map.
+bool hashmap_sc_scan(struct hashmap_sc *self, struct hashmap_sc_cursor *cursor, size_t count,
+                     void (*visit)(void *context, uint64_t key, void *value), void *context);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger table.
+bool hashmap_sc_reserve(struct hashmap_sc *self, size_t capacity);
+
+// Moves the entries into the smallest array of buckets that holds them and trims the buckets.
+void hashmap_sc_shrink_to_fit(struct hashmap_sc *self);
+
 void hashmap_sc_clear(struct hashmap_sc *self);
 
 void hashmap_sc_free(struct hashmap_sc *self);
@@ -0,0 +1,209 @@
+#ifndef HASHMAPS_HASHMAP_SC_DEFINE_H
+#define HASHMAPS_HASHMAP_SC_DEFINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// HASHMAP_SC_DEFINE(name, hash_fn, value_type) generates a separate chaining map specialized for one hasher
+// and one value type. hash_fn is called directly, so it is inlined into every lookup, and values are kept
+// right in the entries. Everything is static inline, so the same map may be defined in several files:
+//
+//     HASHMAP_SC_DEFINE(points, hash_u64, struct point)
+//
+// defines struct points and points_new, points_new_with_capacity, points_insert, points_find,
+// points_delete, points_reserve, points_clear and points_free. The buckets count is a power of two, so a bucket
+// is picked by a mask, and the array doubles at the load factor of hashmap_sc. find returns a pointer into
+// the bucket, which stays valid until the next insert or delete. Constructors return NULL and inserts return
+// false when there is no memory.
+
+#define HASHMAP_SC_DEFINE_MAX_LOAD_FACTOR 300
+#define HASHMAP_SC_DEFINE_INITIAL_BUCKETS_COUNT 16
+
+#define HASHMAP_SC_DEFINE(name, hash_fn, value_type)                                                            \
+    struct name##_entry {                                                                                       \
+        uint64_t key;                                                                                           \
+        value_type value;                                                                                       \
+    };                                                                                                          \
+                                                                                                                \
+    struct name##_bucket {                                                                                      \
+        uint32_t size;                                                                                          \
+        uint32_t capacity;                                                                                      \
+        struct name##_entry *buffer;                                                                            \
+    };                                                                                                          \
+                                                                                                                \
+    struct name {                                                                                               \
+        uint64_t entries_count;                                                                                 \
+        uint64_t buckets_count;                                                                                 \
+        struct name##_bucket *buckets;                                                                          \
+    };                                                                                                          \
+                                                                                                                \
+    static inline uint64_t name##_buckets_count_for(uint64_t entries_count) {                                   \
+        uint64_t buckets_count = HASHMAP_SC_DEFINE_INITIAL_BUCKETS_COUNT;                                       \
+        while (100 * entries_count >= HASHMAP_SC_DEFINE_MAX_LOAD_FACTOR * buckets_count) {                      \
+            buckets_count *= 2;                                                                                 \
+        }                                                                                                       \
+        return buckets_count;                                                                                   \
+    }                                                                                                           \
+                                                                                                                \
+    /* Returns the place for a new entry at the end of the bucket, or NULL if the bucket can't grow */          \
+    static inline struct name##_entry *name##_bucket_push(struct name##_bucket *bucket) {                       \
+        if (bucket->size == bucket->capacity) {                                                                 \
+            uint32_t capacity = bucket->capacity == 0 ? 1 : 2 * bucket->capacity;                               \
+            struct name##_entry *buffer =                                                                       \
+                    (struct name##_entry *) realloc(bucket->buffer, capacity * sizeof(struct name##_entry));    \
+            if (buffer == NULL) {                                                                               \
+                return NULL;                                                                                    \
+            }                                                                                                   \
+            bucket->buffer = buffer;                                                                            \
+            bucket->capacity = capacity;                                                                        \
+        }                                                                                                       \
+        return bucket->buffer + bucket->size++;                                                                 \
+    }                                                                                                           \
+                                                                                                                \
+    static inline void name##_buckets_free(struct name##_bucket *buckets, uint64_t buckets_count) {             \
+        for (uint64_t i = 0; i < buckets_count; ++i) {                                                          \
+            free(buckets[i].buffer);                                                                            \
+        }                                                                                                       \
+        free(buckets);                                                                                          \
+    }                                                                                                           \
+                                                                                                                \
+    /* Moves the entries to a new array of buckets, each sized exactly for its entries. Everything is */        \
+    /* allocated before the first entry moves, so the map stays as it was when there is no memory. */           \
+    static inline bool name##_resize(struct name *self, uint64_t buckets_count) {                               \
+        struct name##_bucket *buckets =                                                                         \
+                (struct name##_bucket *) calloc(buckets_count, sizeof(struct name##_bucket));                   \
+        if (buckets == NULL) {                                                                                  \
+            return false;                                                                                       \
+        }                                                                                                       \
+        uint64_t mask = buckets_count - 1;                                                                      \
+        for (uint64_t i = 0; i < self->buckets_count; ++i) {                                                    \
+            for (uint32_t j = 0; j < self->buckets[i].size; ++j) {                                              \
+                buckets[hash_fn(self->buckets[i].buffer[j].key) & mask].capacity++;                             \
+            }                                                                                                   \
+        }                                                                                                       \
+        for (uint64_t i = 0; i < buckets_count; ++i) {                                                          \
+            if (buckets[i].capacity == 0) {                                                                     \
+                continue;                                                                                       \
+            }                                                                                                   \
+            buckets[i].buffer = (struct name##_entry *) malloc(buckets[i].capacity * sizeof(struct name##_entry)); \
+            if (buckets[i].buffer == NULL) {                                                                    \
+                name##_buckets_free(buckets, buckets_count);                                                    \
+                return false;                                                                                   \
+            }                                                                                                   \
+        }                                                                                                       \
+        for (uint64_t i = 0; i < self->buckets_count; ++i) {                                                    \
+            for (uint32_t j = 0; j < self->buckets[i].size; ++j) {                                              \
+                struct name##_entry *entry = self->buckets[i].buffer + j;                                       \
+                struct name##_bucket *bucket = buckets + (hash_fn(entry->key) & mask);                          \
+                bucket->buffer[bucket->size++] = *entry;                                                        \
+            }                                                                                                   \
+        }                                                                                                       \
+        name##_buckets_free(self->buckets, self->buckets_count);                                                \
+        self->buckets = buckets;                                                                                \
+        self->buckets_count = buckets_count;                                                                    \
+        return true;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline struct name *name##_new_with_capacity(size_t capacity) {                                      \
+        struct name *self = (struct name *) malloc(sizeof(struct name));                                        \
+        if (self == NULL) {                                                                                     \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        self->buckets_count = name##_buckets_count_for(capacity);                                               \
+        self->buckets = (struct name##_bucket *) calloc(self->buckets_count, sizeof(struct name##_bucket));     \
+        if (self->buckets == NULL) {                                                                            \
+            free(self);                                                                                         \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        self->entries_count = 0;                                                                                \
+        return self;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline struct name *name##_new(void) {                                                               \
+        return name##_new_with_capacity(0);                                                                     \
+    }                                                                                                           \
+                                                                                                                \
+    static inline value_type *name##_find(struct name *self, uint64_t key) {                                    \
+        if (self == NULL) {                                                                                     \
+            return NULL;                                                                                        \
+        }                                                                                                       \
+        struct name##_bucket *bucket = self->buckets + (hash_fn(key) & (self->buckets_count - 1));              \
+        for (uint32_t i = 0; i < bucket->size; ++i) {                                                           \
+            if (bucket->buffer[i].key == key) {                                                                 \
+                return &bucket->buffer[i].value;                                                                \
+            }                                                                                                   \
+        }                                                                                                       \
+        return NULL;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline bool name##_insert(struct name *self, uint64_t key, value_type value) {                       \
+        if (self == NULL) {                                                                                     \
+            return false;                                                                                       \
+        }                                                                                                       \
+        value_type *found = name##_find(self, key);                                                             \
+        if (found != NULL) {                                                                                    \
+            *found = value;                                                                                     \
+            return true;                                                                                        \
+        }                                                                                                       \
+        if (100 * self->entries_count >= HASHMAP_SC_DEFINE_MAX_LOAD_FACTOR * self->buckets_count &&             \
+            !name##_resize(self, 2 * self->buckets_count)) {                                                    \
+            return false;                                                                                       \
+        }                                                                                                       \
+        struct name##_entry *entry =                                                                            \
+                name##_bucket_push(self->buckets + (hash_fn(key) & (self->buckets_count - 1)));                 \
+        if (entry == NULL) {                                                                                    \
+            return false;                                                                                       \
+        }                                                                                                       \
+        entry->key = key;                                                                                       \
+        entry->value = value;                                                                                   \
+        self->entries_count++;                                                                                  \
+        return true;                                                                                            \
+    }                                                                                                           \
+                                                                                                                \
+    static inline bool name##_delete(struct name *self, uint64_t key) {                                         \
+        if (self == NULL) {                                                                                     \
+            return false;                                                                                       \
+        }                                                                                                       \
+        struct name##_bucket *bucket = self->buckets + (hash_fn(key) & (self->buckets_count - 1));              \
+        for (uint32_t i = 0; i < bucket->size; ++i) {                                                           \
+            if (bucket->buffer[i].key != key) {                                                                 \
+                continue;                                                                                       \
+            }                                                                                                   \
+            bucket->buffer[i] = bucket->buffer[bucket->size - 1];                                               \
+            bucket->size--;                                                                                     \
+            self->entries_count--;                                                                              \
+            return true;                                                                                        \
+        }                                                                                                       \
+        return false;                                                                                           \
+    }                                                                                                           \
+                                                                                                                \
+    static inline bool name##_reserve(struct name *self, size_t capacity) {                                     \
+        if (self == NULL) {                                                                                     \
+            return false;                                                                                       \
+        }                                                                                                       \
+        uint64_t buckets_count = name##_buckets_count_for(capacity);                                            \
+        return buckets_count <= self->buckets_count || name##_resize(self, buckets_count);                      \
+    }                                                                                                           \
+                                                                                                                \
+    /* Keeps the bucket buffers for the entries to come */                                                      \
+    static inline void name##_clear(struct name *self) {                                                        \
+        if (self == NULL) {                                                                                     \
+            return;                                                                                             \
+        }                                                                                                       \
+        for (uint64_t i = 0; i < self->buckets_count; ++i) {                                                    \
+            self->buckets[i].size = 0;                                                                          \
+        }                                                                                                       \
+        self->entries_count = 0;                                                                                \
+    }                                                                                                           \
+                                                                                                                \
+    static inline void name##_free(struct name *self) {                                                         \
+        if (self == NULL) {                                                                                     \
+            return;                                                                                             \
+        }                                                                                                       \
+        name##_buckets_free(self->buckets, self->buckets_count);                                                \
+        free(self);                                                                                             \
+    }
+
+#endif // HASHMAPS_HASHMAP_SC_DEFINE_H
@@ -1,14 +1,30 @@
 #include "../minunit.h"
 #include "hashmap_sc.h"
+#include "hashmap_sc_define.h"
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct hashmap_sc {
     uint32_t entries_count;
     uint32_t buckets_count;
     struct bucket *buckets;
+    unsigned max_load_factor;
+    unsigned growth_factor;
+    size_t value_size;
+    size_t entry_size;
+    bool incremental_resize;
+    size_t resize_threads;
+    size_t clear_threads;
+    struct bucket *old_buckets;
+    uint32_t old_buckets_count;
+    uint32_t migrated_count;
+    uint64_t resizes_count;
+    struct hashmap_allocator allocator;
+    struct hashmap_allocator bucket_allocator;
 
     uint64_t (*hasher)(uint64_t);
 
@@ -24,7 +40,7 @@ struct bucket {
 struct entry {
     uint64_t hash;
     uint64_t key;
-    void *value;
+    unsigned char value[];
 };
 
 static uint64_t hasher(uint64_t x) {
@@ -34,6 +50,10 @@ static uint64_t hasher(uint64_t x) {
     return x;
 }
 
+static uint64_t fake_hasher(uint64_t _) {
+    return 1;
+}
+
 static void *make_ptr(uint64_t value) {
     uint64_t *p = malloc(sizeof(uint64_t));
     *p = value;
@@ -42,6 +62,50 @@ static void *make_ptr(uint64_t value) {
 
 static void leak(void *_) {}
 
+static atomic_size_t freed_count;
+
+static void count_free(void *_) {
+    atomic_fetch_add(&freed_count, 1);
+}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
 int tests_run = 0;
 
 static char *test_constructs() {
@@ -75,18 +139,18 @@ static char *test_inserts() {
     mu_assert("error, map must contain the value", entry != NULL);
     mu_assert("error, saved incorrect hash", entry->hash == hash);
     mu_assert("error, saved incorrect key", entry->key == 666);
-    mu_assert("error, saved incorrect value", *(uint64_t *) entry->value == 5);
+    mu_assert("error, saved incorrect value", **(uint64_t **) entry->value == 5);
 
     hashmap_sc_insert(map, 666, make_ptr(10));
     mu_assert(
             "error, entries count shouldn't be incremented when saving existent key",
             map->entries_count == 1);
-    mu_assert("error, value should be changed", *(uint64_t *) entry->value == 10);
+    mu_assert("error, value should be changed", **(uint64_t **) entry->value == 10);
 
     hashmap_sc_insert(map, 777, make_ptr(15));
-    entry = map->buckets[hash % map->buckets_count].buffer + 1;
+    entry = (struct entry *) ((unsigned char *) map->buckets[hash % map->buckets_count].buffer + map->entry_size);
     mu_assert("error, entries count must be equal to 2", map->entries_count == 2);
-    mu_assert("error, new value must be saved at the next slot", *(uint64_t *) entry->value == 15);
+    mu_assert("error, new value must be saved at the next slot", **(uint64_t **) entry->value == 15);
     mu_assert("error, new key must be saved at the next slot", entry->key == 777);
 
     hashmap_sc_free(map);
@@ -158,12 +222,446 @@ static char *test_resizes() {
     return 0;
 }
 
+static char *test_inline_values() {
+    struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, NULL, (struct hashmap_sc_options) {.value_size = sizeof(uint64_t)});
+    mu_assert("error, inline values must not need value_free", map->value_free == NULL);
+
+    for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t value = i + 1;
+        hashmap_sc_insert(map, i, &value);
+    }
+    for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t *value = hashmap_sc_find(map, i);
+        mu_assert("error, inline value must be found", value != NULL && *value == i + 1);
+    }
+
+    uint64_t value = 42;
+    hashmap_sc_insert(map, 7, &value);
+    value = 0;
+    mu_assert("error, inline value must be copied on insert", *(uint64_t *) hashmap_sc_find(map, 7) == 42);
+    *(uint64_t *) hashmap_sc_find(map, 7) = 43;
+    mu_assert("error, found pointer must point into the map", *(uint64_t *) hashmap_sc_find(map, 7) == 43);
+
+    hashmap_sc_insert(map, 1000, NULL);
+    mu_assert("error, inserting NULL must store zeroes", *(uint64_t *) hashmap_sc_find(map, 1000) == 0);
+
+    mu_assert("error, key 7 must be deleted", hashmap_sc_delete(map, 7));
+    mu_assert("error, deleted key must not be found", hashmap_sc_find(map, 7) == NULL);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+
+    hashmap_sc_clear(map);
+    mu_assert("error, cleared map must be empty", map->entries_count == 0 && hashmap_sc_find(map, 1) == NULL);
+
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static char *test_find_batch() {
+    struct hashmap_sc *map = hashmap_sc_new(hasher, leak);
+    for (size_t i = 1; i <= 100; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+
+    // The batch size is not a multiple of the internal group width
+    uint64_t keys[110];
+    void *values[110];
+    for (size_t i = 0; i < 110; ++i) {
+        keys[i] = i + 1;
+    }
+    hashmap_sc_find_batch(map, keys, 110, values);
+    for (size_t i = 0; i < 100; ++i) {
+        mu_assert("error, batch must find all inserted keys", values[i] == (void *) keys[i]);
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        mu_assert("error, batch mustn't find absent keys", values[i] == NULL);
+    }
+
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static char *test_insert_batch() {
+    uint64_t keys[1000];
+    void *values[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        keys[i] = i + 1;
+        values[i] = (void *) (i + 1);
+    }
+
+    struct hashmap_sc *map = hashmap_sc_new(hasher, leak);
+    hashmap_sc_insert_batch(map, keys, values, 1000);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all batch inserted values must be found", hashmap_sc_find(map, i) == (void *) i);
+    }
+    uint64_t buckets_count = map->buckets_count;
+    hashmap_sc_free(map);
+
+    map = hashmap_sc_new_from_arrays(hasher, leak, (struct hashmap_sc_options) {0}, keys, values, 1000);
+    mu_assert("error, bulk built map must have the same size", map->buckets_count == buckets_count);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all bulk inserted values must be found", hashmap_sc_find(map, i) == (void *) i);
+    }
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static char *test_reserve_and_shrink() {
+    struct hashmap_sc *map = hashmap_sc_new_with_capacity(hasher, leak, 1000);
+    struct hashmap_sc *reserved = hashmap_sc_new(hasher, leak);
+    hashmap_sc_reserve(reserved, 1000);
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->buckets_count == map->buckets_count);
+    hashmap_sc_reserve(reserved, 10);
+    mu_assert("error, reserve mustn't shrink the map", reserved->buckets_count == map->buckets_count);
+    hashmap_sc_free(reserved);
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    for (size_t i = 6; i <= 1000; ++i) {
+        hashmap_sc_delete(map, i);
+    }
+    hashmap_sc_shrink_to_fit(map);
+    mu_assert("error, map must shrink to the initial size", map->buckets_count == 10);
+    for (size_t i = 1; i <= 5; ++i) {
+        mu_assert("error, remaining values must be found after shrinking", hashmap_sc_find(map, i) == (void *) i);
+    }
+    mu_assert("error, deleted values mustn't be found after shrinking", hashmap_sc_find(map, 6) == NULL);
+
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static char *test_incremental_resize() {
+    struct hashmap_sc_options options = {.incremental_resize = true};
+    struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, leak, options);
+    size_t migrations = 0;
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+        if (map->old_buckets_count == 0) {
+            continue;
+        }
+        if (map->migrated_count == 0) {
+            // Right after the resize started all of the keys are still in the old buckets
+            migrations++;
+            mu_assert("error, key 1 must be deleted during migration", hashmap_sc_delete(map, 1));
+            mu_assert("error, deleted key mustn't be found during migration", hashmap_sc_find(map, 1) == NULL);
+            hashmap_sc_insert(map, 1, (void *) 1);
+        }
+        for (size_t j = 1; j <= i; ++j) {
+            mu_assert("error, all keys must be found during migration", hashmap_sc_find(map, j) == (void *) j);
+        }
+    }
+    mu_assert("error, map must have been resized incrementally", migrations > 0);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static char *test_allocators() {
+    struct hashmap_sc_options options = {.allocator = &failing_allocator};
+    allocations_left = 0;
+    mu_assert("error, constructor must fail without memory", hashmap_sc_new_with_options(hasher, leak, options) == NULL);
+    allocations_left = 1;
+    mu_assert("error, constructor must fail without memory for the buckets",
+              hashmap_sc_new_with_options(hasher, leak, options) == NULL);
+
+    allocations_left = SIZE_MAX;
+    struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, leak, options);
+    size_t inserted = 0;
+    for (; inserted < 30; ++inserted) {
+        hashmap_sc_insert(map, inserted + 1, (void *) (inserted + 1));
+    }
+    // Without memory the map can't grow, but buckets still take entries up to their capacity
+    allocations_left = 0;
+    while (hashmap_sc_insert(map, inserted + 1, (void *) (inserted + 1))) {
+        inserted++;
+    }
+    mu_assert("error, reserve must fail when the map can't grow", !hashmap_sc_reserve(map, 1000));
+    mu_assert("error, map mustn't grow without memory", map->buckets_count == 10);
+    mu_assert("error, failed insert mustn't change entries count", map->entries_count == inserted);
+    for (size_t i = 1; i <= inserted; ++i) {
+        mu_assert("error, values must be found after a failed insert", hashmap_sc_find(map, i) == (void *) i);
+    }
+    allocations_left = SIZE_MAX;
+    mu_assert("error, insert must succeed when memory is back",
+              hashmap_sc_insert(map, inserted + 1, (void *) (inserted + 1)));
+    hashmap_sc_free(map);
+
+    // Incremental migration that runs out of memory keeps the unmoved entries in the old buckets
+    options.incremental_resize = true;
+    map = hashmap_sc_new_with_options(hasher, leak, options);
+    for (size_t i = 1; i <= 31; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    allocations_left = 0;
+    hashmap_sc_delete(map, 31);
+    for (size_t i = 1; i <= 30; ++i) {
+        mu_assert("error, values must be found after a failed migration", hashmap_sc_find(map, i) == (void *) i);
+    }
+    allocations_left = SIZE_MAX;
+    hashmap_sc_shrink_to_fit(map);
+    mu_assert("error, migration must finish when memory is back", map->old_buckets_count == 0);
+    for (size_t i = 1; i <= 30; ++i) {
+        mu_assert("error, values must be found after the migration", hashmap_sc_find(map, i) == (void *) i);
+    }
+    hashmap_sc_free(map);
+
+    struct hashmap_arena *arena = hashmap_arena_new(1 << 20);
+    struct hashmap_allocator arena_allocator = hashmap_arena_allocator(arena);
+    options = (struct hashmap_sc_options) {.allocator = &hashmap_huge_page_allocator, .bucket_allocator = &arena_allocator};
+    map = hashmap_sc_new_with_options(hasher, leak, options);
+    for (size_t i = 1; i <= 200000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, values must be found in a map with custom allocators", hashmap_sc_find(map, i) == (void *) i);
+    }
+    hashmap_sc_free(map);
+    hashmap_arena_free(arena);
+
+    // A huge page block shrunk under 2 MiB moves to malloc, which frees it by its new size
+    const struct hashmap_allocator *huge = &hashmap_huge_page_allocator;
+    unsigned char *block = huge->alloc(huge->context, 2 << 20);
+    memset(block, 7, 2 << 20);
+    block = huge->realloc(huge->context, block, 2 << 20, 1 << 20);
+    mu_assert("error, realloc must keep the contents", block[0] == 7 && block[(1 << 20) - 1] == 7);
+    block = huge->realloc(huge->context, block, 1 << 20, (1 << 20) + 1);
+    mu_assert("error, realloc must keep the contents", block[(1 << 20) - 1] == 7);
+    huge->free(huge->context, block, (1 << 20) + 1);
+
+    return 0;
+}
+
+static char *test_parallel_resize() {
+    for (int variant = 0; variant < 2; ++variant) {
+        struct hashmap_sc_options options = {.value_size = variant ? sizeof(uint64_t) : 0, .resize_threads = 4};
+        struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, variant ? NULL : leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_sc_insert(map, i, variant ? (void *) &i : (void *) i);
+        }
+        mu_assert("error, entries count must be equal to 200000", map->entries_count == 200000);
+        for (size_t i = 1; i <= 200000; ++i) {
+            uint64_t *value = hashmap_sc_find(map, i);
+            mu_assert("error, values must be found after a parallel resize",
+                      variant ? value != NULL && *value == i : value == (void *) i);
+        }
+
+        // Reserve rehashes all of the entries at once
+        mu_assert("error, reserve must succeed", hashmap_sc_reserve(map, 1000000));
+        for (size_t i = 1; i <= 200000; ++i) {
+            uint64_t *value = hashmap_sc_find(map, i);
+            mu_assert("error, values must be found after a parallel reserve",
+                      variant ? value != NULL && *value == i : value == (void *) i);
+        }
+        mu_assert("error, missing key mustn't be found", hashmap_sc_find(map, 200001) == NULL);
+        hashmap_sc_free(map);
+    }
+
+    return 0;
+}
+
+static char *test_parallel_clear() {
+    struct hashmap_sc *map =
+            hashmap_sc_new_with_options(hasher, count_free, (struct hashmap_sc_options) {.clear_threads = 4});
+    for (size_t i = 1; i <= 200000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    freed_count = 0;
+    hashmap_sc_clear(map);
+    mu_assert("error, clear must release every value", freed_count == 200000);
+    mu_assert("error, map must be empty after clear", map->entries_count == 0);
+    for (size_t i = 1; i <= 200000; ++i) {
+        mu_assert("error, keys mustn't be found after clear", hashmap_sc_find(map, i) == NULL);
+    }
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    mu_assert("error, map must take keys after clear", hashmap_sc_find(map, 1000) == (void *) 1000);
+    hashmap_sc_free(map);
+    mu_assert("error, free must release every value", freed_count == 201000);
+
+    return 0;
+}
+
+static char *test_tuning() {
+    mu_assert("error, map that doesn't grow mustn't be constructed",
+              hashmap_sc_new_with_options(hasher, leak, (struct hashmap_sc_options) {.growth_factor = 100}) == NULL);
+
+    struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, leak, (struct hashmap_sc_options) {
+            .max_load_factor = 50, .capacity = 100});
+    mu_assert("error, capacity must fit under the load factor", map->buckets_count == 201);
+    hashmap_sc_free(map);
+
+    map = hashmap_sc_new_with_options(hasher, leak, (struct hashmap_sc_options) {
+            .max_load_factor = 100, .growth_factor = 150});
+    for (size_t i = 1; i < 11; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+        mu_assert("error, buckets count must be equal to 10", map->buckets_count == 10);
+    }
+    hashmap_sc_insert(map, 11, (void *) 11);
+    mu_assert("error, buckets count must grow by the growth factor", map->buckets_count == 15);
+    for (size_t i = 1; i <= 100000; ++i) {
+        hashmap_sc_insert(map, i, (void *) i);
+    }
+    mu_assert("error, load factor must stay under one entry per bucket", map->entries_count <= map->buckets_count);
+    for (size_t i = 1; i <= 100000; ++i) {
+        mu_assert("error, all inserted values must be found", hashmap_sc_find(map, i) == (void *) i);
+    }
+    hashmap_sc_free(map);
+
+    return 0;
+}
+
+static void count_visit(void *context, uint64_t key, void *value) {
+    uint8_t *visits = context;
+    if (value == (void *) key && visits[key] < UINT8_MAX) {
+        visits[key]++;
+    }
+}
+
+static char *test_iteration() {
+    uint8_t *visits = malloc(20000);
+    for (int variant = 0; variant < 2; ++variant) {
+        struct hashmap_sc *map = hashmap_sc_new_with_options(hasher, leak, (struct hashmap_sc_options) {
+                .incremental_resize = variant == 1});
+        // The buckets grow at 7680 entries, so the incremental variant is walked in the middle of a migration
+        uint64_t count = 7700;
+        for (uint64_t i = 0; i < count; ++i) {
+            hashmap_sc_insert(map, i, (void *) i);
+        }
+        if (variant == 1) {
+            mu_assert("error, incremental resize must be in progress", map->old_buckets_count != 0);
+        }
+
+        memset(visits, 0, 20000);
+        struct hashmap_sc_iter iter;
+        uint64_t key;
+        void *value;
+        hashmap_sc_iter_begin(map, &iter);
+        while (hashmap_sc_iter_next(map, &iter, &key, &value)) {
+            mu_assert("error, iteration must return the inserted entries", key < count && value == (void *) key);
+            visits[key]++;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            mu_assert("error, iteration must return every entry once", visits[i] == 1);
+        }
+
+        memset(visits, 0, 20000);
+        struct hashmap_sc_cursor cursor;
+        hashmap_sc_cursor_begin(map, &cursor);
+        while (hashmap_sc_scan(map, &cursor, 2, count_visit, visits)) {
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            mu_assert("error, scan of an unchanged map must visit every entry once", visits[i] == 1);
+        }
+        mu_assert("error, finished scan mustn't go on", !hashmap_sc_scan(map, &cursor, 2, count_visit, visits));
+
+        // Keys below count / 2 stay, the rest are deleted while the new keys make the table grow mid-scan
+        memset(visits, 0, 20000);
+        uint64_t resizes_count = map->resizes_count;
+        uint64_t inserted = count, deleted = count / 2;
+        hashmap_sc_cursor_begin(map, &cursor);
+        while (hashmap_sc_scan(map, &cursor, 2, count_visit, visits)) {
+            for (int i = 0; i < 5 && inserted < 20000; ++i, ++inserted) {
+                hashmap_sc_insert(map, inserted, (void *) inserted);
+            }
+            if (deleted < count) {
+                hashmap_sc_delete(map, deleted++);
+            }
+        }
+        mu_assert("error, table must grow during the scan", map->resizes_count != resizes_count);
+        for (uint64_t i = 0; i < count / 2; ++i) {
+            mu_assert("error, scan must visit every entry kept during it", visits[i] >= 1);
+        }
+        hashmap_sc_free(map);
+    }
+
+    free(visits);
+
+    return 0;
+}
+
+struct point {
+    int32_t x;
+    int32_t y;
+};
+
+HASHMAP_SC_DEFINE(points, hasher, struct point)
+HASHMAP_SC_DEFINE(colliding_points, fake_hasher, struct point)
+
+static char *test_specialized() {
+    struct points *map = points_new();
+    for (int32_t i = 0; i < 100000; ++i) {
+        mu_assert("error, specialized map must take new keys", points_insert(map, i, (struct point) {i, -i}));
+    }
+    mu_assert("error, entries count must be 100000", map->entries_count == 100000);
+    for (int32_t i = 0; i < 100000; ++i) {
+        struct point *found = points_find(map, i);
+        mu_assert("error, all inserted values must be found", found != NULL && found->x == i && found->y == -i);
+    }
+    mu_assert("error, absent key mustn't be found", points_find(map, 100000) == NULL);
+    for (int32_t i = 0; i < 100000; i += 2) {
+        mu_assert("error, present key must be deleted", points_delete(map, i));
+        mu_assert("error, deleted key mustn't be deleted again", !points_delete(map, i));
+    }
+    for (int32_t i = 0; i < 100000; ++i) {
+        mu_assert("error, only deleted keys must be gone", (points_find(map, i) == NULL) == (i % 2 == 0));
+    }
+    mu_assert("error, reserve must keep the entries", points_reserve(map, 1000000) && points_find(map, 1) != NULL);
+    points_clear(map);
+    mu_assert("error, clear must drop the entries", map->entries_count == 0 && points_find(map, 1) == NULL);
+    points_insert(map, 1, (struct point) {1, 1});
+    mu_assert("error, map must take keys after clear", points_find(map, 1)->x == 1);
+    points_free(map);
+
+    // Keys deleted ahead of an existing one mustn't let it in for the second time
+    struct colliding_points *colliding = colliding_points_new();
+    for (int32_t i = 1; i <= 6; ++i) {
+        colliding_points_insert(colliding, i, (struct point) {i, i});
+    }
+    for (int32_t i = 1; i <= 3; ++i) {
+        colliding_points_delete(colliding, i);
+    }
+    for (int32_t i = 4; i <= 6; ++i) {
+        colliding_points_insert(colliding, i, (struct point) {-i, -i});
+    }
+    mu_assert("error, existing keys must be replaced", colliding->entries_count == 3);
+    for (int32_t i = 4; i <= 6; ++i) {
+        colliding_points_delete(colliding, i);
+        mu_assert("error, replaced key must be deleted at once", colliding_points_find(colliding, i) == NULL);
+    }
+    colliding_points_free(colliding);
+
+    return 0;
+}
+
 static char *all_tests() {
     mu_run_test(test_constructs);
     mu_run_test(test_inserts);
     mu_run_test(test_finds);
     mu_run_test(test_deletes);
     mu_run_test(test_resizes);
+    mu_run_test(test_inline_values);
+    mu_run_test(test_find_batch);
+    mu_run_test(test_insert_batch);
+    mu_run_test(test_reserve_and_shrink);
+    mu_run_test(test_incremental_resize);
+    mu_run_test(test_allocators);
+    mu_run_test(test_parallel_resize);
+    mu_run_test(test_parallel_clear);
+    mu_run_test(test_tuning);
+    mu_run_test(test_iteration);
+    mu_run_test(test_specialized);
 
     return NULL;
 }
@@ -0,0 +1,223 @@
+#include "hashmap_sharded.h"
+#include "../separate_chaining/hashmap_sc.h"
+#include "../linear_probing/hashmap_lp.h"
+#include "../quadratic_probing/hashmap_qp.h"
+#include "../double_hashing/hashmap_dh.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define DEFAULT_SHARDS_COUNT 64
+#define CACHE_LINE_SIZE 64
+
+// Each shard takes a cache line of its own, so threads working on neighbouring shards don't
+// bounce the same line between cores.
+struct shard {
+    _Alignas(CACHE_LINE_SIZE) pthread_rwlock_t lock;
+    void *map;
+};
+
+// Operations of the maps the shards are made of
+struct backend {
+    void *(*new)(const struct hashmap_sharded *self, size_t capacity);
+    bool (*insert)(void *map, uint64_t key, void *value);
+    void *(*find)(void *map, uint64_t key);
+    bool (*delete)(void *map, uint64_t key);
+    bool (*reserve)(void *map, size_t capacity);
+    void (*clear)(void *map);
+    void (*free)(void *map);
+};
+
+struct hashmap_sharded {
+    const struct backend *backend;
+    struct shard *shards;
+    // What was allocated for the shards before aligning them to a cache line
+    void *shards_memory;
+    size_t shards_count;
+    // A shard index is the hash shifted right by this much
+    unsigned shift;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    uint64_t (*hasher2)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+// Every kind of map gets the same set of wrappers that only cast the map pointer
+#define BACKEND(name, ...)                                                                                     \
+    static void *name##_new(const struct hashmap_sharded *const self, size_t capacity) {                        \
+        return hashmap_##name##_new_with_options(self->hasher, __VA_ARGS__ self->value_free,                    \
+                                                 (struct hashmap_##name##_options) {                             \
+                                                         .capacity = capacity, .allocator = &self->allocator}); \
+    }                                                                                                           \
+    static bool name##_insert(void *map, uint64_t key, void *value) {                                           \
+        return hashmap_##name##_insert(map, key, value);                                                        \
+    }                                                                                                           \
+    static void *name##_find(void *map, uint64_t key) { return hashmap_##name##_find(map, key); }               \
+    static bool name##_delete(void *map, uint64_t key) { return hashmap_##name##_delete(map, key); }            \
+    static bool name##_reserve(void *map, size_t capacity) { return hashmap_##name##_reserve(map, capacity); }  \
+    static void name##_clear(void *map) { hashmap_##name##_clear(map); }                                        \
+    static void name##_free(void *map) { hashmap_##name##_free(map); }                                          \
+    static const struct backend name##_backend = {name##_new,     name##_insert, name##_find, name##_delete,     \
+                                                  name##_reserve, name##_clear,  name##_free};
+
+BACKEND(sc)
+BACKEND(lp)
+BACKEND(qp)
+BACKEND(dh, self->hasher2,)
+
+static const struct backend *const backends[] = {
+        [hashmap_sharded_sc] = &sc_backend,
+        [hashmap_sharded_lp] = &lp_backend,
+        [hashmap_sharded_qp] = &qp_backend,
+        [hashmap_sharded_dh] = &dh_backend,
+};
+
+// Each shard gets an equal part of capacity, rounded up
+static inline size_t shard_capacity(const struct hashmap_sharded *const self, size_t capacity) {
+    return (capacity + self->shards_count - 1) / self->shards_count;
+}
+
+// The top bits pick the shard, so the low bits the shards index their slots with stay
+// independent of it
+static inline struct shard *shard_of(const struct hashmap_sharded *const self, uint64_t key) {
+    return self->shift == 64 ? self->shards : self->shards + (self->hasher(key) >> self->shift);
+}
+
+static void shards_free(struct hashmap_sharded *const self, size_t shards_count) {
+    for (size_t i = 0; i < shards_count; ++i) {
+        self->backend->free(self->shards[i].map);
+        pthread_rwlock_destroy(&self->shards[i].lock);
+    }
+    self->allocator.free(self->allocator.context, self->shards_memory,
+                         self->shards_count * sizeof(struct shard) + CACHE_LINE_SIZE);
+}
+
+struct hashmap_sharded *hashmap_sharded_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_sharded_new_with_options(hasher, value_free, (struct hashmap_sharded_options) {0});
+}
+
+struct hashmap_sharded *hashmap_sharded_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                          size_t capacity) {
+    return hashmap_sharded_new_with_options(hasher, value_free,
+                                            (struct hashmap_sharded_options) {.capacity = capacity});
+}
+
+struct hashmap_sharded *hashmap_sharded_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                         struct hashmap_sharded_options options) {
+    if (options.kind == hashmap_sharded_dh && options.hasher2 == NULL) {
+        return NULL;
+    }
+
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_sharded *self = allocator->alloc(allocator->context, sizeof(struct hashmap_sharded));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->backend = backends[options.kind];
+    self->shards_count = 1;
+    self->shift = 64;
+    size_t shards_count = options.shards_count == 0 ? DEFAULT_SHARDS_COUNT : options.shards_count;
+    while (self->shards_count < shards_count) {
+        self->shards_count *= 2;
+        self->shift--;
+    }
+    self->allocator = *allocator;
+    self->hasher = hasher;
+    self->hasher2 = options.hasher2;
+    self->value_free = value_free;
+
+    self->shards_memory =
+            allocator->alloc(allocator->context, self->shards_count * sizeof(struct shard) + CACHE_LINE_SIZE);
+    if (self->shards_memory == NULL) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_sharded));
+        return NULL;
+    }
+    self->shards = (struct shard *) (((uintptr_t) self->shards_memory + CACHE_LINE_SIZE - 1) &
+                                     ~(uintptr_t) (CACHE_LINE_SIZE - 1));
+    for (size_t i = 0; i < self->shards_count; ++i) {
+        self->shards[i].map = self->backend->new(self, shard_capacity(self, options.capacity));
+        if (self->shards[i].map == NULL) {
+            shards_free(self, i);
+            allocator->free(allocator->context, self, sizeof(struct hashmap_sharded));
+            return NULL;
+        }
+        pthread_rwlock_init(&self->shards[i].lock, NULL);
+    }
+
+    return self;
+}
+
+bool hashmap_sharded_insert(struct hashmap_sharded *const self, uint64_t key, void *value) {
+    if (self == NULL) {
+        return false;
+    }
+
+    struct shard *shard = shard_of(self, key);
+    pthread_rwlock_wrlock(&shard->lock);
+    bool inserted = self->backend->insert(shard->map, key, value);
+    pthread_rwlock_unlock(&shard->lock);
+    return inserted;
+}
+
+void *hashmap_sharded_find(struct hashmap_sharded *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    struct shard *shard = shard_of(self, key);
+    pthread_rwlock_rdlock(&shard->lock);
+    void *value = self->backend->find(shard->map, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return value;
+}
+
+bool hashmap_sharded_delete(struct hashmap_sharded *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    struct shard *shard = shard_of(self, key);
+    pthread_rwlock_wrlock(&shard->lock);
+    bool deleted = self->backend->delete(shard->map, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return deleted;
+}
+
+bool hashmap_sharded_reserve(struct hashmap_sharded *const self, size_t capacity) {
+    if (self == NULL) {
+        return false;
+    }
+
+    bool reserved = true;
+    for (size_t i = 0; i < self->shards_count; ++i) {
+        pthread_rwlock_wrlock(&self->shards[i].lock);
+        reserved &= self->backend->reserve(self->shards[i].map, shard_capacity(self, capacity));
+        pthread_rwlock_unlock(&self->shards[i].lock);
+    }
+    return reserved;
+}
+
+void hashmap_sharded_clear(struct hashmap_sharded *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < self->shards_count; ++i) {
+        pthread_rwlock_wrlock(&self->shards[i].lock);
+        self->backend->clear(self->shards[i].map);
+        pthread_rwlock_unlock(&self->shards[i].lock);
+    }
+}
+
+void hashmap_sharded_free(struct hashmap_sharded *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    shards_free(self, self->shards_count);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_sharded));
+}
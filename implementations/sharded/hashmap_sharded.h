@@ -0,0 +1,64 @@
+#ifndef HASHMAPS_HASHMAP_SHARDED_H
+#define HASHMAPS_HASHMAP_SHARDED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+// Map that can be shared between threads, made of independent single-threaded maps. A key goes
+// to the shard picked by the top bits of its hash, and each shard is guarded by a reader-writer
+// lock of its own. Threads that work on different shards never wait for each other, and a resize
+// rehashes only the shard that filled up.
+struct hashmap_sharded;
+
+// Map every shard is made of
+enum hashmap_sharded_kind {
+    hashmap_sharded_sc,
+    hashmap_sharded_lp,
+    hashmap_sharded_qp,
+    hashmap_sharded_dh
+};
+
+struct hashmap_sharded_options {
+    enum hashmap_sharded_kind kind;
+    // Rounded up to a power of two. Zero means 64.
+    size_t shards_count;
+    // Entries count the map takes without resizing, split evenly between the shards.
+    // Zero keeps the default initial size of every shard.
+    size_t capacity;
+    // Second hash function of hashmap_dh shards, required for them and ignored for the others
+    uint64_t (*hasher2)(uint64_t);
+    // Where the shards are allocated. NULL means malloc and free.
+    // The allocator is called under the shard locks, so it must be thread-safe.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map, and inserts return false when there is no memory to grow a shard.
+struct hashmap_sharded *hashmap_sharded_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
+
+struct hashmap_sharded *hashmap_sharded_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                          size_t capacity);
+
+struct hashmap_sharded *hashmap_sharded_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                         struct hashmap_sharded_options options);
+
+bool hashmap_sharded_insert(struct hashmap_sharded *self, uint64_t key, void *value);
+
+// The map doesn't guard the returned value, so if value_free is set, another thread that replaces
+// or deletes the key may free it while it is in use.
+void *hashmap_sharded_find(struct hashmap_sharded *self, uint64_t key);
+
+bool hashmap_sharded_delete(struct hashmap_sharded *self, uint64_t key);
+
+// Grows every shard to hold its part of capacity entries. Returns false when some shard can't grow.
+bool hashmap_sharded_reserve(struct hashmap_sharded *self, size_t capacity);
+
+// Clears the shards one by one, so entries inserted while it runs may stay in the map.
+void hashmap_sharded_clear(struct hashmap_sharded *self);
+
+// Must not run concurrently with anything else on the map.
+void hashmap_sharded_free(struct hashmap_sharded *self);
+
+#endif // HASHMAPS_HASHMAP_SHARDED_H
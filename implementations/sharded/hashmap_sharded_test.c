@@ -0,0 +1,222 @@
+#include "../minunit.h"
+#include "hashmap_sharded.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREADS_COUNT 8
+#define KEYS_PER_THREAD 20000
+
+struct hashmap_sharded {
+    const struct backend *backend;
+    struct shard *shards;
+    void *shards_memory;
+    size_t shards_count;
+    unsigned shift;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    uint64_t (*hasher2)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static uint64_t hasher2(uint64_t x) {
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = (x >> 16) ^ x;
+    return x;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_sharded *map = hashmap_sharded_new(hasher, free);
+    mu_assert("error, map must be constructed", map != NULL);
+    mu_assert("error, map must have the default shards count", map->shards_count == 64 && map->shift == 58);
+    mu_assert("error, shards must be aligned to a cache line", (uintptr_t) map->shards % 64 == 0);
+    hashmap_sharded_free(map);
+
+    map = hashmap_sharded_new_with_options(hasher, free, (struct hashmap_sharded_options) {.shards_count = 5});
+    mu_assert("error, shards count must be rounded up to a power of two", map->shards_count == 8 && map->shift == 61);
+    hashmap_sharded_free(map);
+
+    mu_assert("error, double hashing shards mustn't be constructed without hasher2",
+              hashmap_sharded_new_with_options(hasher, free, (struct hashmap_sharded_options) {
+                      .kind = hashmap_sharded_dh}) == NULL);
+
+    // Every allocation the constructor makes may fail, and none of them must leak then
+    struct hashmap_sharded_options options = {.shards_count = 4, .allocator = &failing_allocator};
+    map = NULL;
+    size_t allocations = 0;
+    for (; map == NULL; ++allocations) {
+        allocations_left = allocations;
+        map = hashmap_sharded_new_with_options(hasher, free, options);
+    }
+    mu_assert("error, map must take the shards array and the map of every shard", allocations > 5);
+    hashmap_sharded_free(map);
+
+    return 0;
+}
+
+static char *test_inserts_finds_deletes() {
+    enum hashmap_sharded_kind kinds[] = {hashmap_sharded_sc, hashmap_sharded_lp, hashmap_sharded_qp,
+                                         hashmap_sharded_dh};
+    for (size_t k = 0; k < 4; ++k) {
+        struct hashmap_sharded_options options = {.kind = kinds[k], .shards_count = 4, .hasher2 = hasher2};
+        struct hashmap_sharded *map = hashmap_sharded_new_with_options(hasher, free, options);
+        for (uint64_t i = 1; i <= 1000; ++i) {
+            mu_assert("error, insert must succeed", hashmap_sharded_insert(map, i, make_ptr(i)));
+        }
+        for (uint64_t i = 1; i <= 1000; ++i) {
+            uint64_t *value = hashmap_sharded_find(map, i);
+            mu_assert("error, inserted values must be found", value != NULL && *value == i);
+        }
+        mu_assert("error, missing key mustn't be found", hashmap_sharded_find(map, 1001) == NULL);
+
+        hashmap_sharded_insert(map, 1, make_ptr(100));
+        mu_assert("error, insert must replace the value", *(uint64_t *) hashmap_sharded_find(map, 1) == 100);
+
+        for (uint64_t i = 1; i <= 500; ++i) {
+            mu_assert("error, delete must find the key", hashmap_sharded_delete(map, i));
+        }
+        mu_assert("error, deleted key mustn't be deleted twice", !hashmap_sharded_delete(map, 1));
+        for (uint64_t i = 1; i <= 1000; ++i) {
+            mu_assert("error, only the rest of the keys must be found",
+                      (hashmap_sharded_find(map, i) != NULL) == (i > 500));
+        }
+
+        mu_assert("error, reserve must succeed", hashmap_sharded_reserve(map, 10000));
+        hashmap_sharded_clear(map);
+        for (uint64_t i = 1; i <= 1000; ++i) {
+            mu_assert("error, keys mustn't be found after clear", hashmap_sharded_find(map, i) == NULL);
+        }
+        hashmap_sharded_free(map);
+    }
+
+    return 0;
+}
+
+struct worker {
+    struct hashmap_sharded *map;
+    uint64_t first_key;
+    size_t misses;
+};
+
+static void *insert_and_delete(void *arg) {
+    struct worker *worker = arg;
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        hashmap_sharded_insert(worker->map, worker->first_key + i, (void *) (worker->first_key + i));
+    }
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; ++i) {
+        if (hashmap_sharded_find(worker->map, worker->first_key + i) != (void *) (worker->first_key + i)) {
+            worker->misses++;
+        }
+    }
+    // Every other key is deleted while the other threads still insert and resize their shards
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; i += 2) {
+        if (!hashmap_sharded_delete(worker->map, worker->first_key + i)) {
+            worker->misses++;
+        }
+    }
+    return NULL;
+}
+
+static char *test_concurrent_access() {
+    struct hashmap_sharded *map = hashmap_sharded_new_with_options(hasher, leak, (struct hashmap_sharded_options) {
+            .kind = hashmap_sharded_lp, .shards_count = 16});
+    pthread_t threads[THREADS_COUNT];
+    struct worker workers[THREADS_COUNT];
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        workers[i] = (struct worker) {.map = map, .first_key = 1 + i * KEYS_PER_THREAD, .misses = 0};
+        pthread_create(threads + i, NULL, insert_and_delete, workers + i);
+    }
+    for (size_t i = 0; i < THREADS_COUNT; ++i) {
+        pthread_join(threads[i], NULL);
+        mu_assert("error, every thread must find its keys", workers[i].misses == 0);
+    }
+
+    for (uint64_t key = 1; key <= THREADS_COUNT * KEYS_PER_THREAD; ++key) {
+        bool deleted = (key - 1) % KEYS_PER_THREAD % 2 == 0;
+        mu_assert("error, only the keys that were not deleted must be found",
+                  hashmap_sharded_find(map, key) == (deleted ? NULL : (void *) key));
+    }
+    hashmap_sharded_free(map);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts_finds_deletes);
+    mu_run_test(test_concurrent_access);
+    return 0;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
@@ -0,0 +1,371 @@
+#include "hashmap_sw.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAX_LOAD_FACTOR 87
+#define GROUP_WIDTH 16
+#define BATCH_WIDTH 16
+
+// Control bytes: a full slot keeps 7 bits of its hash (top bit clear),
+// empty and deleted slots are marked with the top bit set.
+#define CTRL_EMPTY ((uint8_t) 0x80)
+#define CTRL_DELETED ((uint8_t) 0xFE)
+
+struct hashmap_sw {
+    uint64_t entries_count;
+    uint64_t tombstones_count;
+    uint64_t slots_count;
+    uint8_t *ctrl;
+    struct slot *slots;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+struct slot {
+    uint64_t key;
+    void *value;
+};
+
+static inline uint64_t h1(uint64_t hash) {
+    return hash >> 7;
+}
+
+static inline uint8_t h2(uint64_t hash) {
+    return hash & 0x7F;
+}
+
+// Bit i of the result is set if group[i] == byte.
+static inline uint32_t match_byte(const uint8_t *group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) byte)));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (uint32_t) (group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i of the result is set if group[i] is empty or deleted.
+static inline uint32_t match_vacant(const uint8_t *group) {
+#ifdef __SSE2__
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (uint32_t) (group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+// Groups are probed with triangular steps, which visits every group
+// because the groups count is a power of two.
+static size_t find_vacant(const uint8_t *ctrl, uint64_t slots_count, uint64_t hash) {
+    uint64_t groups_mask = slots_count / GROUP_WIDTH - 1;
+    uint64_t group = h1(hash) & groups_mask;
+    for (size_t i = 1;; ++i) {
+        uint32_t mask = match_vacant(ctrl + group * GROUP_WIDTH);
+        if (mask != 0) {
+            return group * GROUP_WIDTH + __builtin_ctz(mask);
+        }
+        group = (group + i) & groups_mask;
+    }
+}
+
+// Smallest slots count that keeps entries_count entries under the load factor.
+static uint64_t slots_count_for(uint64_t entries_count) {
+    uint64_t slots_count = GROUP_WIDTH;
+    while (100 * entries_count > MAX_LOAD_FACTOR * slots_count) {
+        slots_count *= 2;
+    }
+    return slots_count;
+}
+
+static void slots_free(const struct hashmap_sw *const self, uint8_t *ctrl, struct slot *slots, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    allocator->free(allocator->context, ctrl, slots_count);
+    allocator->free(allocator->context, slots, slots_count * sizeof(struct slot));
+}
+
+static bool slots_new(const struct hashmap_sw *const self, uint8_t **ctrl, struct slot **slots, uint64_t slots_count) {
+    const struct hashmap_allocator *allocator = &self->allocator;
+    *ctrl = allocator->alloc(allocator->context, slots_count);
+    *slots = allocator->alloc(allocator->context, slots_count * sizeof(struct slot));
+    if (*ctrl == NULL || *slots == NULL) {
+        slots_free(self, *ctrl, *slots, slots_count);
+        return false;
+    }
+    memset(*ctrl, CTRL_EMPTY, slots_count);
+    return true;
+}
+
+// Leaves the map as it was when there is no memory for the new slots.
+static bool resize_map(struct hashmap_sw *const self, uint64_t new_slots_count) {
+    uint8_t *new_ctrl;
+    struct slot *new_slots;
+    if (!slots_new(self, &new_ctrl, &new_slots, new_slots_count)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < self->slots_count; ++i) {
+        if (self->ctrl[i] & CTRL_EMPTY) {
+            continue;
+        }
+
+        uint64_t hash = self->hasher(self->slots[i].key);
+        size_t index = find_vacant(new_ctrl, new_slots_count, hash);
+        new_ctrl[index] = h2(hash);
+        new_slots[index] = self->slots[i];
+    }
+    slots_free(self, self->ctrl, self->slots, self->slots_count);
+    self->ctrl = new_ctrl;
+    self->slots = new_slots;
+    self->slots_count = new_slots_count;
+    self->tombstones_count = 0;
+    return true;
+}
+
+static struct slot *find_inner(struct hashmap_sw *const self, uint64_t key, uint64_t hash) {
+    uint8_t tag = h2(hash);
+    uint64_t groups_mask = self->slots_count / GROUP_WIDTH - 1;
+    uint64_t group = h1(hash) & groups_mask;
+    for (size_t i = 1; i <= groups_mask + 1; ++i) {
+        const uint8_t *ctrl = self->ctrl + group * GROUP_WIDTH;
+        for (uint32_t mask = match_byte(ctrl, tag); mask != 0; mask &= mask - 1) {
+            struct slot *slot = self->slots + group * GROUP_WIDTH + __builtin_ctz(mask);
+            if (slot->key == key) {
+                return slot;
+            }
+        }
+        if (match_byte(ctrl, CTRL_EMPTY) != 0) {
+            return NULL;
+        }
+        group = (group + i) & groups_mask;
+    }
+
+    return NULL;
+}
+
+struct hashmap_sw *hashmap_sw_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *)) {
+    return hashmap_sw_new_with_capacity(hasher, value_free, 0);
+}
+
+struct hashmap_sw *hashmap_sw_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity) {
+    return hashmap_sw_new_with_options(hasher, value_free, (struct hashmap_sw_options) {.capacity = capacity});
+}
+
+struct hashmap_sw *hashmap_sw_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_sw_options options) {
+    const struct hashmap_allocator *allocator =
+            options.allocator != NULL ? options.allocator : &hashmap_libc_allocator;
+    struct hashmap_sw *self = allocator->alloc(allocator->context, sizeof(struct hashmap_sw));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->allocator = *allocator;
+    self->entries_count = 0;
+    self->tombstones_count = 0;
+    self->slots_count = slots_count_for(options.capacity);
+    if (!slots_new(self, &self->ctrl, &self->slots, self->slots_count)) {
+        allocator->free(allocator->context, self, sizeof(struct hashmap_sw));
+        return NULL;
+    }
+    self->hasher = hasher;
+    self->value_free = value_free;
+
+    return self;
+}
+
+struct hashmap_sw *hashmap_sw_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              const uint64_t *keys, void *const *values, size_t n) {
+    struct hashmap_sw *self = hashmap_sw_new_with_capacity(hasher, value_free, n);
+    if (!hashmap_sw_insert_batch(self, keys, values, n)) {
+        hashmap_sw_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+bool hashmap_sw_insert(struct hashmap_sw *const self, uint64_t key, void *value) {
+    if (self == NULL) {
+        return false;
+    }
+
+    uint64_t hash = self->hasher(key);
+    struct slot *slot = find_inner(self, key, hash);
+    if (slot != NULL) {
+        if (self->value_free != NULL) {
+            self->value_free(slot->value);
+        }
+        slot->value = value;
+        return true;
+    }
+
+    if (100 * (self->entries_count + self->tombstones_count + 1) > MAX_LOAD_FACTOR * self->slots_count) {
+        // Rehashing in place is enough when most of the load is tombstones
+        uint64_t slots_count = 200 * self->entries_count >= MAX_LOAD_FACTOR * self->slots_count
+                               ? 2 * self->slots_count : self->slots_count;
+        // Without memory for the rehash the entry still fits while there are vacant slots
+        if (!resize_map(self, slots_count) && self->entries_count == self->slots_count) {
+            return false;
+        }
+    }
+
+    size_t index = find_vacant(self->ctrl, self->slots_count, hash);
+    if (self->ctrl[index] == CTRL_DELETED) {
+        self->tombstones_count--;
+    }
+    self->ctrl[index] = h2(hash);
+    self->slots[index].key = key;
+    self->slots[index].value = value;
+    self->entries_count++;
+
+    return true;
+}
+
+bool hashmap_sw_insert_batch(struct hashmap_sw *const self, const uint64_t *keys, void *const *values, size_t n) {
+    if (self == NULL) {
+        return false;
+    }
+
+    // One resize up front instead of a doubling every time the load factor is hit
+    if (!hashmap_sw_reserve(self, self->entries_count + n)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!hashmap_sw_insert(self, keys[i], values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void *hashmap_sw_find(struct hashmap_sw *const self, uint64_t key) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    struct slot *slot = find_inner(self, key, self->hasher(key));
+    if (slot == NULL) {
+        return NULL;
+    } else {
+        return slot->value;
+    }
+}
+
+// Keys are resolved in groups of BATCH_WIDTH: the whole group is hashed and its home groups are
+// prefetched before the first probe, so the cache misses of the group overlap.
+void hashmap_sw_find_batch(struct hashmap_sw *const self, const uint64_t *keys, size_t n, void **out) {
+    if (self == NULL) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = NULL;
+        }
+        return;
+    }
+
+    uint64_t hashes[BATCH_WIDTH];
+    uint64_t groups_mask = self->slots_count / GROUP_WIDTH - 1;
+    for (size_t start = 0; start < n; start += BATCH_WIDTH) {
+        size_t width = n - start < BATCH_WIDTH ? n - start : BATCH_WIDTH;
+        for (size_t i = 0; i < width; ++i) {
+            hashes[i] = self->hasher(keys[start + i]);
+            uint64_t group = h1(hashes[i]) & groups_mask;
+            __builtin_prefetch(self->ctrl + group * GROUP_WIDTH);
+            __builtin_prefetch(self->slots + group * GROUP_WIDTH);
+        }
+        for (size_t i = 0; i < width; ++i) {
+            struct slot *slot = find_inner(self, keys[start + i], hashes[i]);
+            out[start + i] = slot == NULL ? NULL : slot->value;
+        }
+    }
+}
+
+bool hashmap_sw_delete(struct hashmap_sw *const self, uint64_t key) {
+    if (self == NULL) {
+        return false;
+    }
+
+    struct slot *slot = find_inner(self, key, self->hasher(key));
+    if (slot == NULL) {
+        return false;
+    }
+
+    if (self->value_free != NULL) {
+        self->value_free(slot->value);
+    }
+    size_t index = slot - self->slots;
+    // A group that still has an empty slot never made a probe sequence
+    // continue past it, so the slot can become empty instead of a tombstone.
+    if (match_byte(self->ctrl + (index & ~(size_t) (GROUP_WIDTH - 1)), CTRL_EMPTY) != 0) {
+        self->ctrl[index] = CTRL_EMPTY;
+    } else {
+        self->ctrl[index] = CTRL_DELETED;
+        self->tombstones_count++;
+    }
+    self->entries_count--;
+    return true;
+}
+
+bool hashmap_sw_reserve(struct hashmap_sw *const self, size_t capacity) {
+    if (self == NULL) {
+        return false;
+    }
+
+    uint64_t slots_count = slots_count_for(capacity);
+    return slots_count <= self->slots_count || resize_map(self, slots_count);
+}
+
+void hashmap_sw_shrink_to_fit(struct hashmap_sw *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    // Tombstones don't survive a rehash, so it is worth doing even at the same size.
+    // If there is no memory for the rehash, the map just stays as it is.
+    uint64_t slots_count = slots_count_for(self->entries_count);
+    if (slots_count < self->slots_count || self->tombstones_count != 0) {
+        resize_map(self, slots_count);
+    }
+}
+
+void hashmap_sw_clear(struct hashmap_sw *const self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < self->slots_count; ++i) {
+        if (!(self->ctrl[i] & CTRL_EMPTY) && self->value_free != NULL) {
+            self->value_free(self->slots[i].value);
+        }
+    }
+    memset(self->ctrl, CTRL_EMPTY, self->slots_count);
+    self->entries_count = 0;
+    self->tombstones_count = 0;
+}
+
+void hashmap_sw_free(struct hashmap_sw *const self) {
+    if (self == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < self->slots_count; ++i) {
+        if (!(self->ctrl[i] & CTRL_EMPTY) && self->value_free != NULL) {
+            self->value_free(self->slots[i].value);
+        }
+    }
+    slots_free(self, self->ctrl, self->slots, self->slots_count);
+    struct hashmap_allocator allocator = self->allocator;
+    allocator.free(allocator.context, self, sizeof(struct hashmap_sw));
+}
@@ -0,0 +1,56 @@
+#ifndef HASHMAPS_HASHMAP_SW_H
+#define HASHMAPS_HASHMAP_SW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../hashmap_allocator.h"
+
+struct hashmap_sw;
+
+struct hashmap_sw_options {
+    // Entries count the map takes without resizing. Zero keeps the default initial size.
+    size_t capacity;
+    // Where the slots and the map itself are allocated. NULL means malloc and free.
+    const struct hashmap_allocator *allocator;
+};
+
+// value_free may be NULL when the map does not own the values. Constructors return NULL when
+// there is no memory for the map, and inserts return false when there is no memory to grow it.
+struct hashmap_sw *hashmap_sw_new(uint64_t (*hasher)(uint64_t), void (*value_free)(void *));
+
+// The map takes capacity entries without resizing.
+struct hashmap_sw *hashmap_sw_new_with_capacity(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                                size_t capacity);
+
+struct hashmap_sw *hashmap_sw_new_with_options(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                               struct hashmap_sw_options options);
+
+// Builds a map from n entries, sized for all of them up front.
+struct hashmap_sw *hashmap_sw_new_from_arrays(uint64_t (*hasher)(uint64_t), void (*value_free)(void *),
+                                              const uint64_t *keys, void *const *values, size_t n);
+
+bool hashmap_sw_insert(struct hashmap_sw *self, uint64_t key, void *value);
+
+// Inserts n entries into a map sized for all of them up front, values[i] is passed as to hashmap_sw_insert.
+bool hashmap_sw_insert_batch(struct hashmap_sw *self, const uint64_t *keys, void *const *values, size_t n);
+
+void *hashmap_sw_find(struct hashmap_sw *self, uint64_t key);
+
+// Looks up n keys at once, out[i] gets what hashmap_sw_find would return for keys[i].
+void hashmap_sw_find_batch(struct hashmap_sw *self, const uint64_t *keys, size_t n, void **out);
+
+bool hashmap_sw_delete(struct hashmap_sw *self, uint64_t key);
+
+// Grows the map to hold capacity entries under the load factor, so filling it up takes no doublings.
+// Returns false when there is no memory for the bigger table.
+bool hashmap_sw_reserve(struct hashmap_sw *self, size_t capacity);
+
+// Rehashes the entries into the smallest table that holds them, dropping tombstones.
+void hashmap_sw_shrink_to_fit(struct hashmap_sw *self);
+
+void hashmap_sw_clear(struct hashmap_sw *self);
+
+void hashmap_sw_free(struct hashmap_sw *self);
+
+#endif // HASHMAPS_HASHMAP_SW_H
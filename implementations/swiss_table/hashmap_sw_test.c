@@ -0,0 +1,370 @@
+#include "../minunit.h"
+#include "hashmap_sw.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GROUP_WIDTH 16
+#define CTRL_EMPTY ((uint8_t) 0x80)
+#define CTRL_DELETED ((uint8_t) 0xFE)
+
+struct hashmap_sw {
+    uint64_t entries_count;
+    uint64_t tombstones_count;
+    uint64_t slots_count;
+    uint8_t *ctrl;
+    struct slot *slots;
+    struct hashmap_allocator allocator;
+
+    uint64_t (*hasher)(uint64_t);
+
+    void (*value_free)(void *);
+};
+
+struct slot {
+    uint64_t key;
+    void *value;
+};
+
+static uint64_t hasher(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    x = x ^ (x >> 31);
+    return x;
+}
+
+static uint64_t fake_hasher(uint64_t _) {
+    return 1;
+}
+
+static void *make_ptr(uint64_t value) {
+    uint64_t *p = malloc(sizeof(uint64_t));
+    *p = value;
+    return p;
+}
+
+static void leak(void *_) {}
+
+static size_t allocations_left;
+
+static void *failing_alloc(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc(context, size);
+}
+
+static void *failing_alloc_zeroed(void *context, size_t size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.alloc_zeroed(context, size);
+}
+
+static void *failing_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return hashmap_libc_allocator.realloc(context, ptr, old_size, new_size);
+}
+
+static void libc_free(void *context, void *ptr, size_t size) {
+    hashmap_libc_allocator.free(context, ptr, size);
+}
+
+static const struct hashmap_allocator failing_allocator = {
+        .alloc = failing_alloc,
+        .alloc_zeroed = failing_alloc_zeroed,
+        .realloc = failing_realloc,
+        .free = libc_free,
+        .context = NULL
+};
+
+int tests_run = 0;
+
+static char *test_constructs() {
+    struct hashmap_sw *map = hashmap_sw_new(hasher, free);
+    mu_assert("error, hashmap constructor returned null", map != NULL);
+    mu_assert("error, initial slots count must be equal to one group",
+              map->slots_count == GROUP_WIDTH);
+    mu_assert("error, initial entries count must be equal to 0",
+              map->entries_count == 0);
+    mu_assert("error, array of control bytes didn't alloc", map->ctrl != NULL);
+    mu_assert("error, array of slots didn't alloc", map->slots != NULL);
+
+    for (size_t i = 0; i < map->slots_count; ++i) {
+        mu_assert("error, all slots must be empty", map->ctrl[i] == CTRL_EMPTY);
+    }
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_inserts() {
+    struct hashmap_sw *map = hashmap_sw_new(fake_hasher, free);
+
+    hashmap_sw_insert(map, 999, make_ptr(5));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+    mu_assert("error, control byte must keep low 7 bits of the hash", map->ctrl[0] == 1);
+    mu_assert("error, saved incorrect key", map->slots[0].key == 999);
+    mu_assert("error, saved incorrect value", *(uint64_t *) map->slots[0].value == 5);
+
+    hashmap_sw_insert(map, 999, make_ptr(10));
+    mu_assert(
+            "error, entries count should be incremented when saving existent key",
+            map->entries_count == 1);
+    mu_assert("error, value should be changed", *(uint64_t *) map->slots[0].value == 10);
+
+    hashmap_sw_insert(map, 777, make_ptr(15));
+    mu_assert("error, entries count must be equal to 2", map->entries_count == 2);
+    mu_assert("error, new value must be saved at the next slot", *(uint64_t *) map->slots[1].value == 15);
+    mu_assert("error, new key must be saved at the next slot", map->slots[1].key == 777);
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_finds() {
+    struct hashmap_sw *map = hashmap_sw_new(hasher, free);
+    hashmap_sw_insert(map, 666, make_ptr(5));
+    hashmap_sw_insert(map, 777, make_ptr(10));
+
+    mu_assert("error, map must contain value with key 666",
+              *(uint64_t *) hashmap_sw_find(map, 666) == 5);
+    mu_assert("error, map must contain value with key 777",
+              *(uint64_t *) hashmap_sw_find(map, 777) == 10);
+    mu_assert("error, map shouldn't contain value with key 6666",
+              hashmap_sw_find(map, 6666) == NULL);
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_deletes() {
+    struct hashmap_sw *map = hashmap_sw_new(fake_hasher, leak);
+
+    hashmap_sw_insert(map, 555, NULL);
+    hashmap_sw_insert(map, 777, NULL);
+    mu_assert("error, key 777 must be deleted", hashmap_sw_delete(map, 777));
+    mu_assert("error, slot in a group with empty slots must become empty", map->ctrl[1] == CTRL_EMPTY);
+    mu_assert("error, key 777 already must be deleted", !hashmap_sw_delete(map, 777));
+    mu_assert("error, key 888 can't be deleted because the map doesn't contain it",
+              !hashmap_sw_delete(map, 888));
+    mu_assert("error, entries count must be equal to 1", map->entries_count == 1);
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_overflows_group() {
+    struct hashmap_sw *map = hashmap_sw_new(fake_hasher, leak);
+
+    for (size_t i = 1; i <= GROUP_WIDTH + 1; ++i) {
+        hashmap_sw_insert(map, i, (void *) i);
+    }
+    mu_assert("error, slots count must be equal to two groups", map->slots_count == 2 * GROUP_WIDTH);
+    mu_assert("error, last key must overflow into the next group", map->slots[GROUP_WIDTH].key == GROUP_WIDTH + 1);
+
+    mu_assert("error, key 1 must be deleted", hashmap_sw_delete(map, 1));
+    mu_assert("error, slot in a full group must become a tombstone", map->ctrl[0] == CTRL_DELETED);
+    mu_assert("error, tombstones count must be equal to 1", map->tombstones_count == 1);
+    mu_assert("error, key from the next group must be found through the tombstone",
+              hashmap_sw_find(map, GROUP_WIDTH + 1) == (void *) (GROUP_WIDTH + 1));
+
+    hashmap_sw_insert(map, 1, (void *) 1);
+    mu_assert("error, insert must reuse the tombstone", map->ctrl[0] == 1 && map->tombstones_count == 0);
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_resizes() {
+    struct hashmap_sw *map = hashmap_sw_new(hasher, leak);
+
+    for (size_t i = 1; i < 14; ++i) {
+        hashmap_sw_insert(map, i, (void *) i);
+        mu_assert("error, slots count must be equal to one group",
+                  map->slots_count == GROUP_WIDTH);
+    }
+
+    hashmap_sw_insert(map, 14, (void *) 14);
+    mu_assert("error, entries count must be equal to 14",
+              map->entries_count == 14);
+    mu_assert("error, slots count must be equal to two groups",
+              map->slots_count == 2 * GROUP_WIDTH);
+
+    for (size_t i = 1; i <= 14; ++i) {
+        mu_assert("error, all previously inserted values must be found", hashmap_sw_find(map, i) == (void *) i);
+    }
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_find_batch() {
+    struct hashmap_sw *map = hashmap_sw_new(hasher, leak);
+    for (size_t i = 1; i <= 100; ++i) {
+        hashmap_sw_insert(map, i, (void *) i);
+    }
+
+    // The batch size is not a multiple of the internal group width
+    uint64_t keys[110];
+    void *values[110];
+    for (size_t i = 0; i < 110; ++i) {
+        keys[i] = i + 1;
+    }
+    hashmap_sw_find_batch(map, keys, 110, values);
+    for (size_t i = 0; i < 100; ++i) {
+        mu_assert("error, batch must find all inserted keys", values[i] == (void *) keys[i]);
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        mu_assert("error, batch mustn't find absent keys", values[i] == NULL);
+    }
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_insert_batch() {
+    uint64_t keys[1000];
+    void *values[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        keys[i] = i + 1;
+        values[i] = (void *) (i + 1);
+    }
+
+    struct hashmap_sw *map = hashmap_sw_new(hasher, leak);
+    hashmap_sw_insert_batch(map, keys, values, 1000);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all batch inserted values must be found", hashmap_sw_find(map, i) == (void *) i);
+    }
+    uint64_t slots_count = map->slots_count;
+    hashmap_sw_free(map);
+
+    map = hashmap_sw_new_from_arrays(hasher, leak, keys, values, 1000);
+    mu_assert("error, bulk built map must have the same size", map->slots_count == slots_count);
+    mu_assert("error, entries count must be equal to 1000", map->entries_count == 1000);
+    for (size_t i = 1; i <= 1000; ++i) {
+        mu_assert("error, all bulk inserted values must be found", hashmap_sw_find(map, i) == (void *) i);
+    }
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_reserve_and_shrink() {
+    struct hashmap_sw *map = hashmap_sw_new_with_capacity(hasher, leak, 1000);
+    struct hashmap_sw *reserved = hashmap_sw_new(hasher, leak);
+    hashmap_sw_reserve(reserved, 1000);
+    mu_assert("error, reserve must size the map as the capacity constructor does",
+              reserved->slots_count == map->slots_count);
+    hashmap_sw_reserve(reserved, 10);
+    mu_assert("error, reserve mustn't shrink the map", reserved->slots_count == map->slots_count);
+    hashmap_sw_free(reserved);
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        hashmap_sw_insert(map, i, (void *) i);
+    }
+    for (size_t i = 6; i <= 1000; ++i) {
+        hashmap_sw_delete(map, i);
+    }
+    hashmap_sw_shrink_to_fit(map);
+    mu_assert("error, map must shrink to the initial size", map->slots_count == GROUP_WIDTH);
+    for (size_t i = 1; i <= 5; ++i) {
+        mu_assert("error, remaining values must be found after shrinking", hashmap_sw_find(map, i) == (void *) i);
+    }
+    mu_assert("error, deleted values mustn't be found after shrinking", hashmap_sw_find(map, 6) == NULL);
+
+    hashmap_sw_free(map);
+
+    return 0;
+}
+
+static char *test_allocators() {
+    struct hashmap_sw_options options = {.allocator = &failing_allocator};
+    allocations_left = 0;
+    mu_assert("error, constructor must fail without memory", hashmap_sw_new_with_options(hasher, leak, options) == NULL);
+    allocations_left = 1;
+    mu_assert("error, constructor must fail without memory for the slots",
+              hashmap_sw_new_with_options(hasher, leak, options) == NULL);
+
+    allocations_left = SIZE_MAX;
+    struct hashmap_sw *map = hashmap_sw_new_with_options(hasher, leak, options);
+    size_t inserted = 0;
+    for (; inserted < 10; ++inserted) {
+        hashmap_sw_insert(map, inserted + 1, (void *) (inserted + 1));
+    }
+    // Without memory the map can't rehash, but it still takes entries until every slot is full
+    allocations_left = 0;
+    while (hashmap_sw_insert(map, inserted + 1, (void *) (inserted + 1))) {
+        inserted++;
+    }
+    mu_assert("error, map must be filled up without memory", inserted == 16 && map->slots_count == 16);
+    mu_assert("error, reserve must fail when the map can't grow", !hashmap_sw_reserve(map, 1000));
+    for (size_t i = 1; i <= inserted; ++i) {
+        mu_assert("error, values must be found after a failed insert", hashmap_sw_find(map, i) == (void *) i);
+    }
+    mu_assert("error, existing key must be replaced without memory", hashmap_sw_insert(map, 1, (void *) 1));
+    allocations_left = SIZE_MAX;
+    mu_assert("error, insert must succeed when memory is back",
+              hashmap_sw_insert(map, inserted + 1, (void *) (inserted + 1)));
+    hashmap_sw_free(map);
+
+    struct hashmap_arena *arena = hashmap_arena_new(4096);
+    struct hashmap_allocator arena_allocator = hashmap_arena_allocator(arena);
+    const struct hashmap_allocator *allocators[] = {&hashmap_huge_page_allocator, &arena_allocator};
+    for (size_t a = 0; a < 2; ++a) {
+        options.allocator = allocators[a];
+        map = hashmap_sw_new_with_options(hasher, leak, options);
+        for (size_t i = 1; i <= 200000; ++i) {
+            hashmap_sw_insert(map, i, (void *) i);
+        }
+        for (size_t i = 1; i <= 200000; ++i) {
+            mu_assert("error, values must be found in a map with a custom allocator",
+                      hashmap_sw_find(map, i) == (void *) i);
+        }
+        hashmap_sw_free(map);
+    }
+    hashmap_arena_free(arena);
+
+    return 0;
+}
+
+static char *all_tests() {
+    mu_run_test(test_constructs);
+    mu_run_test(test_inserts);
+    mu_run_test(test_finds);
+    mu_run_test(test_deletes);
+    mu_run_test(test_overflows_group);
+    mu_run_test(test_resizes);
+    mu_run_test(test_find_batch);
+    mu_run_test(test_insert_batch);
+    mu_run_test(test_reserve_and_shrink);
+    mu_run_test(test_allocators);
+
+    return NULL;
+}
+
+int main() {
+    char *result = all_tests();
+    if (result != NULL) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
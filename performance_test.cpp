@@ -1,17 +1,33 @@
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <chrono>
 #include <unordered_set>
 #include <unordered_map>
+#include <vector>
 #include <iostream>
 #include <concepts>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 
-extern "C" {
-#include "implementations/separate_chaining/hashmap_sc.h"
-#include "implementations/linear_probing/hashmap_lp.h"
-#include "implementations/quadratic_probing/hashmap_qp.h"
-#include "implementations/double_hashing/hashmap_dh.h"
-}
+#include "implementations/hashmap.hpp"
+#include "implementations/separate_chaining/hashmap_sc_define.h"
+#include "implementations/linear_probing/hashmap_lp_define.h"
+#include "implementations/quadratic_probing/hashmap_qp_define.h"
+#include "implementations/double_hashing/hashmap_dh_define.h"
 
 using std::string;
 using std::vector;
@@ -31,145 +47,303 @@ static uint64_t hasher2(uint64_t x) {
     return (hasher(x) << 2) + 1;
 }
 
+// Cuckoo hashing needs a second hash that doesn't depend on the first one, which hasher2 does
+static uint64_t murmur_hasher(uint64_t x) {
+    x = (x ^ (x >> 33)) * UINT64_C(0xff51afd7ed558ccd);
+    x = (x ^ (x >> 33)) * UINT64_C(0xc4ceb9fe1a85ec53);
+    x = x ^ (x >> 33);
+    return x;
+}
+
+// Maps with the hasher and the value type compiled in, to compare against the function pointer calls
+HASHMAP_SC_DEFINE(hashmap_sc_u64, hasher, uint64_t)
+HASHMAP_LP_DEFINE(hashmap_lp_u64, hasher, uint64_t)
+HASHMAP_QP_DEFINE(hashmap_qp_u64, hasher, uint64_t)
+HASHMAP_DH_DEFINE(hashmap_dh_u64, hasher, hasher2, uint64_t)
+
 struct Hasher {
     std::size_t operator()(const uint64_t &value) const noexcept {
         return hasher(value);
     }
 };
 
-template<std::destructible T>
-void value_free(void *value) {
-    delete (T *) value;
-}
+// Maps that keep pointers to values in the heap, as the C maps do by default
+template<typename Traits>
+using boxed_map = hashmaps::basic_map<Traits, uint64_t, false>;
 
-template<std::destructible T>
-class hashmap {
-    void *ptr;
-    string _label;
-    std::function<bool(void *self, uint64_t key, T value)> _insert;
-    std::function<T *(void *self, uint64_t key)> _find;
-    std::function<bool(void *self, uint64_t key)> _del;
-    std::function<void(void *self)> _clear;
-    std::function<void(void *self)> _free;
+template<typename Traits>
+using inline_map = hashmaps::basic_map<Traits, uint64_t, true>;
 
-    hashmap() : ptr(nullptr) {}
+// std::unordered_map behind the same interface as hashmaps::basic_map
+class std_map {
+    unordered_map<uint64_t, uint64_t, Hasher> map;
 
 public:
-    static hashmap std() {
-        hashmap map;
-        map.ptr = new unordered_map<uint64_t, T, Hasher>();
-        map._label = "STL";
-        map._insert = [](void *self, uint64_t key, T value) {
-            ((unordered_map<uint64_t, T, Hasher> *) self)->insert({key, value});
-            return true;
-        };
-        map._find = [](void *self, uint64_t key) {
-            auto map = (unordered_map<uint64_t, T, Hasher> *) self;
-            auto it = map->find(key);
-            return it != map->end() ? &it->second : nullptr;
-        };
-        map._del = [](void *self, uint64_t key) {
-            return ((unordered_map<uint64_t, T, Hasher> *) self)->erase(key) == 1;
-        };
-        map._clear = [](void *self) { ((unordered_map<uint64_t, T, Hasher> *) self)->clear(); };
-        map._free = [](void *self) { delete (unordered_map<uint64_t, T, Hasher> *) self; };
-
-        return map;
-    }
-
-    static hashmap sc() {
-        hashmap map;
-        map.ptr = hashmap_sc_new(hasher, value_free<T>);
-        map._label = "Separate chaining";
-        map._insert = [](void *self, uint64_t key, T value) {
-            auto value_ptr = std::make_unique<T>(std::move(value)).release();
-            return hashmap_sc_insert((struct hashmap_sc *) self, key, value_ptr);
-        };
-        map._find = [](void *self, uint64_t key) { return (T *) hashmap_sc_find((struct hashmap_sc *) self, key); };
-        map._del = [](void *self, uint64_t key) { return hashmap_sc_delete((struct hashmap_sc *) self, key); };
-        map._clear = [](void *self) { hashmap_sc_clear((struct hashmap_sc *) self); };
-        map._free = [](void *self) { hashmap_sc_free((struct hashmap_sc *) self); };
-
-        return map;
-    }
-
-    static hashmap lp() {
-        hashmap map;
-        map.ptr = hashmap_lp_new(hasher, value_free<T>);
-        map._label = "Linear probing";
-        map._insert = [](void *self, uint64_t key, T value) {
-            auto value_ptr = std::make_unique<T>(std::move(value)).release();
-            return hashmap_lp_insert((struct hashmap_lp *) self, key, value_ptr);
-        };
-        map._find = [](void *self, uint64_t key) { return (T *) hashmap_lp_find((struct hashmap_lp *) self, key); };
-        map._del = [](void *self, uint64_t key) { return hashmap_lp_delete((struct hashmap_lp *) self, key); };
-        map._clear = [](void *self) { hashmap_lp_clear((struct hashmap_lp *) self); };
-        map._free = [](void *self) { hashmap_lp_free((struct hashmap_lp *) self); };
-
-        return map;
-    }
-
-    static hashmap qp() {
-        hashmap map;
-        map.ptr = hashmap_qp_new(hasher, value_free<T>);
-        map._label = "Quadratic probing";
-        map._insert = [](void *self, uint64_t key, T value) {
-            auto value_ptr = std::make_unique<T>(std::move(value)).release();
-            return hashmap_qp_insert((struct hashmap_qp *) self, key, value_ptr);
-        };
-        map._find = [](void *self, uint64_t key) { return (T *) hashmap_qp_find((struct hashmap_qp *) self, key); };
-        map._del = [](void *self, uint64_t key) { return hashmap_qp_delete((struct hashmap_qp *) self, key); };
-        map._clear = [](void *self) { hashmap_qp_clear((struct hashmap_qp *) self); };
-        map._free = [](void *self) { hashmap_qp_free((struct hashmap_qp *) self); };
-
-        return map;
-    }
-
-    static hashmap dh() {
-        hashmap map;
-        map.ptr = hashmap_dh_new(hasher, hasher2, value_free<T>);
-        map._label = "Double hashing";
-        map._insert = [](void *self, uint64_t key, T value) {
-            auto value_ptr = std::make_unique<T>(std::move(value)).release();
-            return hashmap_dh_insert((struct hashmap_dh *) self, key, value_ptr);
-        };
-        map._find = [](void *self, uint64_t key) { return (T *) hashmap_dh_find((struct hashmap_dh *) self, key); };
-        map._del = [](void *self, uint64_t key) { return hashmap_dh_delete((struct hashmap_dh *) self, key); };
-        map._clear = [](void *self) { hashmap_dh_clear((struct hashmap_dh *) self); };
-        map._free = [](void *self) { hashmap_dh_free((struct hashmap_dh *) self); };
-
-        return map;
-    }
-
-    bool insert(uint64_t key, T value) {
-        return this->_insert(this->ptr, key, value);
-    }
-
-    T *find(uint64_t key) {
-        return this->_find(this->ptr, key);
-    }
-
-    bool del(uint64_t key) {
-        return this->_del(this->ptr, key);
+    static constexpr bool thread_safe = false;
+
+    bool insert(uint64_t key, uint64_t value) {
+        map.insert_or_assign(key, value);
+        return true;
+    }
+
+    bool insert_batch(const uint64_t *keys, const uint64_t *values, size_t n) {
+        map.reserve(map.size() + n);
+        for (size_t i = 0; i < n; ++i) {
+            map.insert_or_assign(keys[i], values[i]);
+        }
+        return true;
+    }
+
+    uint64_t *find(uint64_t key) {
+        auto it = map.find(key);
+        return it != map.end() ? &it->second : nullptr;
+    }
+
+    void find_batch(const uint64_t *keys, size_t n, uint64_t **out) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = find(keys[i]);
+        }
+    }
+
+    bool erase(uint64_t key) {
+        return map.erase(key) == 1;
+    }
+
+    bool reserve(size_t capacity) {
+        map.reserve(capacity);
+        return true;
     }
 
     void clear() {
-        this->_clear(this->ptr);
+        map.clear();
+    }
+
+    auto begin() {
+        return map.begin();
+    }
+
+    auto end() {
+        return map.end();
+    }
+};
+
+// One of the maps generated by the *_define.h headers behind the same interface as hashmaps::basic_map.
+// The functions are template arguments, so they are called directly and inlined.
+template<typename Map, Map *(*New)(), bool (*Insert)(Map *, uint64_t, uint64_t), uint64_t *(*Find)(Map *, uint64_t),
+         bool (*Delete)(Map *, uint64_t), bool (*Reserve)(Map *, size_t), void (*Clear)(Map *), void (*Free)(Map *)>
+class specialized_map {
+    std::unique_ptr<Map, decltype(Free)> map;
+
+public:
+    static constexpr bool thread_safe = false;
+
+    specialized_map() : map(New(), Free) {
+        if (map == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    bool insert(uint64_t key, uint64_t value) {
+        return Insert(map.get(), key, value);
+    }
+
+    bool insert_batch(const uint64_t *keys, const uint64_t *values, size_t n) {
+        bool inserted = Reserve(map.get(), map->entries_count + n);
+        for (size_t i = 0; i < n && inserted; ++i) {
+            inserted = Insert(map.get(), keys[i], values[i]);
+        }
+        return inserted;
+    }
+
+    uint64_t *find(uint64_t key) {
+        return Find(map.get(), key);
+    }
+
+    void find_batch(const uint64_t *keys, size_t n, uint64_t **out) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = Find(map.get(), keys[i]);
+        }
+    }
+
+    bool erase(uint64_t key) {
+        return Delete(map.get(), key);
+    }
+
+    bool reserve(size_t capacity) {
+        return Reserve(map.get(), capacity);
+    }
+
+    void clear() {
+        Clear(map.get());
+    }
+};
+
+#define SPECIALIZED_MAP(name) \
+    specialized_map<struct name, name##_new, name##_insert, name##_find, name##_delete, name##_reserve, name##_clear, \
+                    name##_free>
+
+using sc_specialized_map = SPECIALIZED_MAP(hashmap_sc_u64);
+using lp_specialized_map = SPECIALIZED_MAP(hashmap_lp_u64);
+using qp_specialized_map = SPECIALIZED_MAP(hashmap_qp_u64);
+using dh_specialized_map = SPECIALIZED_MAP(hashmap_dh_u64);
+
+// The arena is declared first, so it outlives the map that allocates its buckets from it
+struct arena_owner {
+    std::unique_ptr<struct hashmap_arena, void (*)(struct hashmap_arena *)> arena{hashmap_arena_new(1 << 20),
+                                                                                  hashmap_arena_free};
+};
+
+class sc_arena_map : arena_owner, public boxed_map<hashmaps::sc_traits> {
+    using base = boxed_map<hashmaps::sc_traits>;
+
+    // The map keeps a copy of the allocator
+    static base make(struct hashmap_arena *arena) {
+        struct hashmap_allocator allocator = hashmap_arena_allocator(arena);
+        return base(hasher, {.bucket_allocator = &allocator});
+    }
+
+public:
+    sc_arena_map() : base(make(arena.get())) {}
+};
+
+// Hardware counters of the measured part of every scenario, read through perf_event_open with --counters.
+// Each event is opened on its own, so the kernel multiplexes those the PMU can't count at once, and the counts
+// are scaled by the share of the time they were counted. Only user space is counted. The threads the maps start
+// for resizing and clearing inherit the counters, and their counts are added in once they exit.
+class perf_counters {
+    struct reading {
+        uint64_t value;
+        uint64_t enabled;
+        uint64_t running;
+    };
+
+    struct counter {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+        int fd;
+        reading start;
+        reading end;
+    };
+
+    static constexpr uint64_t cache_read_miss(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    // The generic cache misses event counts the last level cache on most CPUs
+    counter counters[6] = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, {}, {}},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, {}, {}},
+        {"L1d misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D), -1, {}, {}},
+        {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, {}, {}},
+        {"dTLB misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_DTLB), -1, {}, {}},
+        {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, {}, {}},
+    };
+    uint64_t operations = 0;
+
+    static bool read_counter(int fd, reading &result) {
+        return read(fd, &result, sizeof(result)) == sizeof(result);
+    }
+
+public:
+    perf_counters() = default;
+
+    perf_counters(const perf_counters &) = delete;
+
+    perf_counters &operator=(const perf_counters &) = delete;
+
+    ~perf_counters() {
+        for (auto &counter: counters) {
+            if (counter.fd >= 0) {
+                close(counter.fd);
+            }
+        }
     }
 
-    string get_label() {
-        return this->_label;
+    // Returns the error of the last event that failed to open, or 0
+    int open() {
+        int error = 0;
+        for (auto &counter: counters) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = counter.type;
+            attr.config = counter.config;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = 1;
+            counter.fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (counter.fd < 0) {
+                error = errno;
+            }
+        }
+        return error;
+    }
+
+    bool opened() const {
+        return std::any_of(std::begin(counters), std::end(counters), [](const counter &c) { return c.fd >= 0; });
     }
 
-    ~hashmap() {
-        this->_free(this->ptr);
+    // The counters keep running, so a measurement is the difference of two readings
+    void start(uint64_t operations_count) {
+        operations = operations_count;
+        for (auto &counter: counters) {
+            if (counter.fd >= 0 && !read_counter(counter.fd, counter.start)) {
+                counter.start = {};
+            }
+        }
+    }
+
+    void stop() {
+        for (auto &counter: counters) {
+            if (counter.fd < 0 || !read_counter(counter.fd, counter.end)) {
+                counter.end = counter.start;
+            }
+        }
+    }
+
+    // Prints the counts between start and stop, in total and per operation. Events that weren't counted are n/a.
+    void print() const {
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << "   ";
+        for (size_t i = 0; i < std::size(counters); ++i) {
+            const reading &start = counters[i].start, &end = counters[i].end;
+            line << (i == 0 ? " " : ", ") << counters[i].name << ": ";
+            if (end.running == start.running) {
+                line << "n/a";
+                continue;
+            }
+            const double count = double(end.value - start.value) * double(end.enabled - start.enabled) /
+                                 double(end.running - start.running);
+            line << uint64_t(count) << " (" << count / double(operations) << "/op)";
+        }
+        std::cout << line.str() << "\n";
     }
 };
 
+static perf_counters counters;
+
+// Marks the start of the measured part of a scenario of the given operations count
+static chrono::time_point<chrono::steady_clock> start_measuring(uint64_t operations) {
+    if (counters.opened()) {
+        counters.start(operations);
+    }
+    return chrono::steady_clock::now();
+}
+
+// The concurrent linear probing map is sized only at construction, so there is nothing to reserve
+template<typename Map>
+static void reserve(Map &map, size_t capacity) {
+    if constexpr (requires { map.reserve(capacity); }) {
+        map.reserve(capacity);
+    }
+}
+
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-inserts_into_new(const std::function<hashmap<uint64_t>()> &map_factory) {
+inserts_into_new(const Factory &map_factory) {
     auto map = map_factory();
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(1000000);
 
     for (uint64_t i = 0; i < 1000000; ++i) {
         map.insert(i, 0);
@@ -178,14 +352,63 @@ inserts_into_new(const std::function<hashmap<uint64_t>()> &map_factory) {
     return {"1M inserts into new map", start};
 }
 
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-inserts_into_allocated(const std::function<hashmap<uint64_t>()> &map_factory) {
+slowest_insert(const Factory &map_factory) {
+    auto map = map_factory();
+    chrono::duration<double> slowest{0};
+    auto start = start_measuring(1000000);
+
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        auto insert_start = chrono::steady_clock::now();
+        map.insert(i, 0);
+        slowest = std::max<chrono::duration<double>>(slowest, chrono::steady_clock::now() - insert_start);
+    }
+
+    std::ostringstream title;
+    title << "1M inserts into new map, the slowest took " << slowest.count() << " s";
+    return {title.str(), start};
+}
+
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+inserts_into_reserved(const Factory &map_factory) {
+    auto map = map_factory();
+    auto start = start_measuring(1000000);
+
+    reserve(map, 1000000);
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, 0);
+    }
+
+    return {"1M inserts into new map reserved up front", start};
+}
+
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+inserts_batch_into_new(const Factory &map_factory) {
+    auto map = map_factory();
+    vector<uint64_t> keys(1000000);
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        keys[i] = i;
+    }
+    vector<uint64_t> values(1000000, 0);
+    auto start = start_measuring(1000000);
+
+    map.insert_batch(keys.data(), values.data(), keys.size());
+
+    return {"1M inserts into new map in one batch", start};
+}
+
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+inserts_into_allocated(const Factory &map_factory) {
     auto map = map_factory();
     for (uint64_t i = 0; i < 1000000; ++i) {
         map.insert(i, 0);
     }
     map.clear();
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(1000000);
 
     for (uint64_t i = 0; i < 1000000; ++i) {
         map.insert(i, 0);
@@ -194,41 +417,65 @@ inserts_into_allocated(const std::function<hashmap<uint64_t>()> &map_factory) {
     return {"1M inserts into already allocated map", start};
 }
 
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-clear(const std::function<hashmap<uint64_t>()> &map_factory) {
+clear(const Factory &map_factory) {
     auto map = map_factory();
     for (uint64_t i = 0; i < 1000000; ++i) {
         map.insert(i, 0);
     }
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(1000000);
 
     map.clear();
 
     return {"Clear map with 1M elements", start};
 }
 
+// The map grown by one big batch is reused for many small ones, so clearing it is paid for every batch
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-deletes(const std::function<hashmap<uint64_t>()> &map_factory) {
+small_batches_into_allocated(const Factory &map_factory) {
+    auto map = map_factory();
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, 0);
+    }
+    map.clear();
+    auto start = start_measuring(1000000);
+
+    for (uint64_t batch = 0; batch < 1000; ++batch) {
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map.insert(batch * 1000 + i, 0);
+        }
+        map.clear();
+    }
+
+    return {"1000 batches of 1k inserts into already allocated map, cleared after each", start};
+}
+
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+deletes(const Factory &map_factory) {
     auto map = map_factory();
     for (uint64_t i = 0; i < 100000; ++i) {
         map.insert(i, 0);
     }
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(100000);
 
     for (uint64_t i = 0; i < 100000; ++i) {
-        map.del(i);
+        map.erase(i);
     }
 
     return {"Delete 100k elements one by one", start};
 }
 
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-finds(const std::function<hashmap<uint64_t>()> &map_factory) {
+finds(const Factory &map_factory) {
     auto map = map_factory();
     for (uint64_t i = 0; i < 1000000; ++i) {
         map.insert(i, i + 1);
     }
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(1000000);
 
     for (uint64_t i = 0; i < 1000000; ++i) {
         auto res = map.find(i);
@@ -241,13 +488,69 @@ finds(const std::function<hashmap<uint64_t>()> &map_factory) {
     return {"Find 1M elements", start};
 }
 
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+slowest_find(const Factory &map_factory) {
+    auto map = map_factory();
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, i + 1);
+    }
+    chrono::duration<double> slowest{0};
+    auto start = start_measuring(2000000);
+
+    // Half of the lookups miss, which is where long probe sequences show up
+    for (uint64_t i = 0; i < 2000000; ++i) {
+        auto find_start = chrono::steady_clock::now();
+        auto res = map.find(i);
+        slowest = std::max<chrono::duration<double>>(slowest, chrono::steady_clock::now() - find_start);
+        if ((res != nullptr) != (i < 1000000)) {
+            std::cout << "Key " << i << " is " << (res != nullptr ? "found" : "not found") << std::endl;
+            exit(2);
+        }
+    }
+
+    std::ostringstream title;
+    title << "2M finds, half of them missing, the slowest took " << slowest.count() << " s";
+    return {title.str(), start};
+}
+
+template<size_t N, typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+finds_batch(const Factory &map_factory) {
+    auto map = map_factory();
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, i + 1);
+    }
+    // Keys are picked pseudo-randomly, so neighbouring lookups hit unrelated slots
+    vector<uint64_t> keys(1000000);
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        keys[i] = hasher(i) % 1000000;
+    }
+    vector<uint64_t *> results(N);
+    auto start = start_measuring(1000000);
+
+    for (size_t i = 0; i < keys.size(); i += N) {
+        size_t n = std::min(N, keys.size() - i);
+        map.find_batch(keys.data() + i, n, results.data());
+        for (size_t j = 0; j < n; ++j) {
+            if (*results[j] != keys[i + j] + 1) {
+                std::cout << "Result is " << *results[j] << ", but must be " << keys[i + j] + 1 << std::endl;
+                exit(2);
+            }
+        }
+    }
+
+    return {"Find 1M elements in batches of " + std::to_string(N), start};
+}
+
+template<typename Factory>
 static pair<string, chrono::time_point<chrono::steady_clock>>
-finds_rev(const std::function<hashmap<uint64_t>()> &map_factory) {
+finds_rev(const Factory &map_factory) {
     auto map = map_factory();
     for (uint64_t i = 1; i <= 1000000; ++i) {
         map.insert(i, i + 1);
     }
-    auto start = chrono::steady_clock::now();
+    auto start = start_measuring(1000000);
 
     for (uint64_t i = 1000000; i > 0; --i) {
         auto res = map.find(i);
@@ -260,29 +563,502 @@ finds_rev(const std::function<hashmap<uint64_t>()> &map_factory) {
     return {"Find 1M elements in reverse order", start};
 }
 
-static void test(const std::function<hashmap<uint64_t>()> &map_factory) {
-    auto tests = {inserts_into_new, inserts_into_allocated, clear, deletes, finds, finds_rev};
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+iterates(const Factory &map_factory) {
+    auto map = map_factory();
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, i + 1);
+    }
+    auto start = start_measuring(1000000);
 
-    std::cout << "Testing " + map_factory().get_label() << "\n";
-    for (auto test: tests) {
+    uint64_t count = 0, sum = 0;
+    for (auto [key, value]: map) {
+        count++;
+        sum += value - key;
+    }
+    if (count != 1000000 || sum != 1000000) {
+        std::cout << "Iteration returned " << count << " elements, but must return 1000000" << std::endl;
+        exit(2);
+    }
+
+    return {"Iterate over 1M elements", start};
+}
+
+// The cursor is resumed after every step, as an incremental scan would do between other work
+template<typename Factory>
+static pair<string, chrono::time_point<chrono::steady_clock>>
+scans(const Factory &map_factory) {
+    auto map = map_factory();
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, i + 1);
+    }
+    auto start = start_measuring(1000000);
+
+    uint64_t count = 0, sum = 0;
+    auto cursor = map.scan_cursor();
+    while (map.scan(cursor, 1024, [&](uint64_t key, uint64_t &value) {
+        count++;
+        sum += value - key;
+    })) {
+    }
+    if (count != 1000000 || sum != 1000000) {
+        std::cout << "Scan visited " << count << " elements, but must visit 1000000" << std::endl;
+        exit(2);
+    }
+
+    return {"Scan 1M elements with a cursor, 1024 slots a step", start};
+}
+
+// Keys of the concurrent runs are drawn from twice the prefilled range, so inserts add new keys
+// as often as deletes remove them and the map stays about the same size
+static const uint64_t CONCURRENT_KEYS = 1000000;
+static const uint64_t OPS_PER_THREAD = 1000000;
+
+static void pin_thread(std::thread &thread, size_t index) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+}
+
+// Runs OPS_PER_THREAD random operations on each of threads_count pinned threads, read_percent of them
+// finds and the rest inserts and deletes, and returns how many operations per second all threads did.
+// Maps that are not thread-safe are guarded by one mutex.
+template<typename Map>
+static double concurrent_ops_per_second(Map &map, size_t threads_count, unsigned read_percent) {
+    std::mutex mutex;
+    bool locked = !Map::thread_safe;
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> started{false};
+    vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&, t] {
+            ready++;
+            while (!started) {
+                std::this_thread::yield();
+            }
+            for (uint64_t i = 0; i < OPS_PER_THREAD; ++i) {
+                uint64_t random = hasher(t * OPS_PER_THREAD + i);
+                uint64_t key = random % (2 * CONCURRENT_KEYS);
+                auto operation = [&] {
+                    if ((random >> 40) % 100 < read_percent) {
+                        map.find(key);
+                    } else if (random & (UINT64_C(1) << 32)) {
+                        map.insert(key, key + 1);
+                    } else {
+                        map.erase(key);
+                    }
+                };
+                if (locked) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    operation();
+                } else {
+                    operation();
+                }
+            }
+        });
+        pin_thread(threads.back(), t);
+    }
+    while (ready < threads_count) {
+        std::this_thread::yield();
+    }
+
+    auto start = chrono::steady_clock::now();
+    started = true;
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    const chrono::duration<double> elapsed_seconds = chrono::steady_clock::now() - start;
+    return threads_count * OPS_PER_THREAD / elapsed_seconds.count();
+}
+
+// Scaling efficiency is the throughput per thread relative to the one of the first threads count
+template<typename Factory>
+static void test_concurrent(const string &label, const Factory &map_factory, const vector<size_t> &threads_counts,
+                            const vector<unsigned> &read_percents) {
+    bool thread_safe = std::invoke_result_t<Factory>::thread_safe;
+    std::cout << "Testing " << label << (thread_safe ? "" : " (mutex-wrapped)") << "\n";
+    for (auto read_percent: read_percents) {
+        auto map = map_factory();
+        for (uint64_t i = 0; i < CONCURRENT_KEYS; ++i) {
+            map.insert(2 * i, 2 * i + 1);
+        }
+        double base_per_thread = 0;
+        for (auto threads_count: threads_counts) {
+            double ops_per_second = concurrent_ops_per_second(map, threads_count, read_percent);
+            if (base_per_thread == 0) {
+                base_per_thread = ops_per_second / threads_count;
+            }
+            std::cout << threads_count << " threads, " << read_percent << "/" << 100 - read_percent
+                      << " finds/writes. Ops/sec: " << std::setw(12) << std::fixed << std::setprecision(0)
+                      << ops_per_second << std::defaultfloat << std::setprecision(6)
+                      << ", scaling efficiency: " << ops_per_second / threads_count / base_per_thread << "\n";
+        }
+    }
+    std::cout << "---------------" << std::endl;
+}
+
+// Counts the bytes a map keeps allocated for its tables, so the sweep weighs time against memory
+struct allocation_counter {
+    size_t current = 0;
+    size_t peak = 0;
+
+    void add(size_t size) {
+        current += size;
+        peak = std::max(peak, current);
+    }
+};
+
+static void *counting_alloc(void *context, size_t size) {
+    ((allocation_counter *) context)->add(size);
+    return hashmap_libc_allocator.alloc(hashmap_libc_allocator.context, size);
+}
+
+static void *counting_alloc_zeroed(void *context, size_t size) {
+    ((allocation_counter *) context)->add(size);
+    return hashmap_libc_allocator.alloc_zeroed(hashmap_libc_allocator.context, size);
+}
+
+static void *counting_realloc(void *context, void *ptr, size_t old_size, size_t new_size) {
+    ((allocation_counter *) context)->current -= old_size;
+    ((allocation_counter *) context)->add(new_size);
+    return hashmap_libc_allocator.realloc(hashmap_libc_allocator.context, ptr, old_size, new_size);
+}
+
+static void counting_free(void *context, void *ptr, size_t size) {
+    if (ptr != nullptr) {
+        ((allocation_counter *) context)->current -= size;
+    }
+    hashmap_libc_allocator.free(hashmap_libc_allocator.context, ptr, size);
+}
+
+static const uint64_t SWEEP_KEYS = 1000000;
+
+// Fills the map with SWEEP_KEYS keys, then finds all of them, and prints both times and the peak
+// memory of the tables along the way
+template<typename Map>
+static void sweep_run(Map map, const string &label, const allocation_counter &counter) {
+    auto start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < SWEEP_KEYS; ++i) {
+        map.insert(i, 0);
+    }
+    const chrono::duration<double> inserts_seconds = chrono::steady_clock::now() - start;
+    start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < SWEEP_KEYS; ++i) {
+        if (map.find(i) == nullptr) {
+            std::cerr << "Key " << i << " not found in " << label << std::endl;
+            exit(2);
+        }
+    }
+    const chrono::duration<double> finds_seconds = chrono::steady_clock::now() - start;
+    std::cout << label << ". Inserts: " << std::setw(9) << inserts_seconds.count() << " s, finds: "
+              << std::setw(9) << finds_seconds.count() << " s, peak table memory: " << std::setw(5)
+              << counter.peak / (1 << 20) << " MiB\n";
+}
+
+// Options out of range make the map constructor throw, and such combinations are skipped
+template<typename Map, typename... Args>
+static void sweep_map(const string &label, const allocation_counter &counter, Args &&... args) {
+    std::optional<Map> map;
+    try {
+        map.emplace(std::forward<Args>(args)...);
+    } catch (const std::bad_alloc &) {
+        return;
+    }
+    sweep_run(std::move(*map), label, counter);
+}
+
+// Runs the separate chaining map with every load factor of chain_load_factors and the open addressing
+// maps with every one of load_factors, each with every growth factor and, where probes are limited,
+// every distance limit. Zero stands for the default of a parameter.
+static void test_sweep(const vector<unsigned> &load_factors, const vector<unsigned> &chain_load_factors,
+                       const vector<unsigned> &growth_factors, const vector<uint64_t> &distance_limits) {
+    auto label = [](const string &name, unsigned load_factor, unsigned growth_factor, uint64_t distance_limit,
+                    bool probing) {
+        std::ostringstream title;
+        title << name << " (load factor " << load_factor << "%, growth " << growth_factor << "%";
+        if (probing) {
+            title << ", distance limit " << (distance_limit == 0 ? "log2" : std::to_string(distance_limit));
+        }
+        title << ")";
+        return title.str();
+    };
+
+    for (auto load_factor: chain_load_factors) {
+        for (auto growth_factor: growth_factors) {
+            allocation_counter counter;
+            struct hashmap_allocator allocator = {counting_alloc, counting_alloc_zeroed, counting_realloc,
+                                                  counting_free, &counter};
+            sweep_map<boxed_map<hashmaps::sc_traits>>(
+                    label("Separate chaining", load_factor, growth_factor, 0, false), counter, hasher,
+                    hashmap_sc_options{.max_load_factor = load_factor, .growth_factor = growth_factor,
+                                       .allocator = &allocator});
+        }
+    }
+    std::cout << "---------------" << std::endl;
+
+    for (auto load_factor: load_factors) {
+        for (auto growth_factor: growth_factors) {
+            for (auto distance_limit: distance_limits) {
+                allocation_counter counter;
+                struct hashmap_allocator allocator = {counting_alloc, counting_alloc_zeroed, counting_realloc,
+                                                      counting_free, &counter};
+                sweep_map<boxed_map<hashmaps::lp_traits>>(
+                        label("Linear probing", load_factor, growth_factor, distance_limit, true), counter, hasher,
+                        hashmap_lp_options{.max_load_factor = load_factor, .growth_factor = growth_factor,
+                                           .distance_limit = distance_limit, .allocator = &allocator});
+                counter = {};
+                sweep_map<boxed_map<hashmaps::qp_traits>>(
+                        label("Quadratic probing", load_factor, growth_factor, distance_limit, true), counter, hasher,
+                        hashmap_qp_options{.max_load_factor = load_factor, .growth_factor = growth_factor,
+                                           .distance_limit = distance_limit, .allocator = &allocator});
+                counter = {};
+                sweep_map<boxed_map<hashmaps::dh_traits>>(
+                        label("Double hashing", load_factor, growth_factor, distance_limit, true), counter, hasher,
+                        hasher2, hashmap_dh_options{.max_load_factor = load_factor, .growth_factor = growth_factor,
+                                                    .distance_limit = distance_limit, .allocator = &allocator});
+            }
+        }
+        std::cout << "---------------" << std::endl;
+    }
+}
+
+template<typename N>
+static vector<N> parse_list(const char *list) {
+    vector<N> values;
+    std::istringstream stream(list);
+    string value;
+    while (std::getline(stream, value, ',')) {
+        values.push_back((N) std::stoul(value));
+    }
+    return values;
+}
+
+static void print_elapsed(const string &title, chrono::time_point<chrono::steady_clock> start) {
+    const chrono::duration<double> elapsed_seconds = chrono::steady_clock::now() - start;
+    if (counters.opened()) {
+        counters.stop();
+    }
+    std::cout << title << ". Elapsed time: " << std::setw(9) << elapsed_seconds.count() << "\n";
+    if (counters.opened()) {
+        counters.print();
+    }
+}
+
+template<typename Factory>
+static void test(const string &label, const Factory &map_factory) {
+    auto tests = {inserts_into_new<Factory>, slowest_insert<Factory>, inserts_into_reserved<Factory>,
+                  inserts_batch_into_new<Factory>, inserts_into_allocated<Factory>, clear<Factory>,
+                  small_batches_into_allocated<Factory>, deletes<Factory>, finds<Factory>, slowest_find<Factory>,
+                  finds_rev<Factory>, finds_batch<256, Factory>};
+
+    auto run = [&](auto test) {
         const auto title_and_start = test(map_factory);
-        const auto end = chrono::steady_clock::now();
-        const chrono::duration<double> elapsed_seconds = end - title_and_start.second;
-        std::cout << title_and_start.first << ". Elapsed time: " << std::setw(9) << elapsed_seconds << "\n";
+        print_elapsed(title_and_start.first, title_and_start.second);
+    };
+
+    std::cout << "Testing " + label << "\n";
+    for (auto test: tests) {
+        run(test);
+    }
+    // Full-table scans, for the maps that can enumerate their entries
+    if constexpr (requires(std::invoke_result_t<Factory> &map) { map.begin(); }) {
+        run(iterates<Factory>);
+    }
+    if constexpr (requires(std::invoke_result_t<Factory> &map) { map.scan_cursor(); }) {
+        run(scans<Factory>);
     }
     std::cout << "---------------" << std::endl;
 }
 
+// Startup of a prebuilt map: filling it with inserts against mapping the file it was saved to.
+// open takes the path and returns the mapped map.
+template<typename Traits, typename Open>
+static void test_snapshot(const string &label, inline_map<Traits> map, const Open &open) {
+    std::cout << "Testing " + label << "\n";
+    auto start = start_measuring(1000000);
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        map.insert(i, i + 1);
+    }
+    print_elapsed("Insert 1M elements into a new hash table", start);
+
+    char path[] = "/tmp/hashmaps_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || !Traits::save(map.native_handle(), fd)) {
+        std::cout << "Snapshot can't be saved to " << path << std::endl;
+        exit(2);
+    }
+    close(fd);
+    start = start_measuring(1);
+    typename Traits::map_type *mapped = open(path);
+    print_elapsed("Open the saved hash table with mmap", start);
+
+    start = start_measuring(1000000);
+    for (uint64_t i = 0; i < 1000000; ++i) {
+        auto res = static_cast<uint64_t *>(Traits::find(mapped, i));
+        if (res == nullptr || *res != i + 1) {
+            std::cout << "Key " << i << " isn't found in the mapped file" << std::endl;
+            exit(2);
+        }
+    }
+    // The first lookups fault the pages of the file in
+    print_elapsed("Find 1M elements in the mapped file", start);
+    Traits::free(mapped);
+    unlink(path);
+    std::cout << "---------------" << std::endl;
+}
+
+// With --concurrent the maps are benchmarked under several threads instead, thread counts and
+// percents of finds are taken from --threads=1,2,4 and --reads=90,50.
+// With --sweep the tunable maps are run over --load-factors=50,70,90 (--chain-load-factors=100,300,500
+// for separate chaining), --growth-factors=150,200 and --distance-limits=0,64, zero meaning log2.
+// With --counters every scenario of the single-threaded runs also prints its hardware counters.
 int main(int argc, char *argv[]) {
-    for (auto map_factory: {
-                            hashmap<uint64_t>::std,
-                            hashmap<uint64_t>::sc,
-                            hashmap<uint64_t>::lp,
-                            hashmap<uint64_t>::qp,
-                            hashmap<uint64_t>::dh
-    }) {
-        test(map_factory);
+    bool concurrent = false;
+    vector<size_t> threads_counts;
+    vector<unsigned> read_percents = {90, 50};
+    bool sweep = false;
+    vector<unsigned> load_factors = {50, 70, 90};
+    vector<unsigned> chain_load_factors = {100, 300, 500};
+    vector<unsigned> growth_factors = {150, 200};
+    vector<uint64_t> distance_limits = {0, 64};
+    bool with_counters = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--concurrent") == 0) {
+            concurrent = true;
+        } else if (strcmp(argv[i], "--sweep") == 0) {
+            sweep = true;
+        } else if (strncmp(argv[i], "--load-factors=", 15) == 0) {
+            load_factors = parse_list<unsigned>(argv[i] + 15);
+        } else if (strncmp(argv[i], "--chain-load-factors=", 21) == 0) {
+            chain_load_factors = parse_list<unsigned>(argv[i] + 21);
+        } else if (strncmp(argv[i], "--growth-factors=", 17) == 0) {
+            growth_factors = parse_list<unsigned>(argv[i] + 17);
+        } else if (strncmp(argv[i], "--distance-limits=", 18) == 0) {
+            distance_limits = parse_list<uint64_t>(argv[i] + 18);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads_counts = parse_list<size_t>(argv[i] + 10);
+        } else if (strncmp(argv[i], "--reads=", 8) == 0) {
+            read_percents = parse_list<unsigned>(argv[i] + 8);
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            with_counters = true;
+        }
+    }
+    if (threads_counts.empty()) {
+        for (size_t threads_count = 1; threads_count <= std::max(1u, std::thread::hardware_concurrency());
+             threads_count *= 2) {
+            threads_counts.push_back(threads_count);
+        }
     }
 
+    if (with_counters && !sweep && !concurrent) {
+        int error = counters.open();
+        if (!counters.opened()) {
+            std::cout << "Hardware counters are unavailable: " << strerror(error) << std::endl;
+        }
+    }
+
+    if (sweep) {
+        test_sweep(load_factors, chain_load_factors, growth_factors, distance_limits);
+        return 0;
+    }
+
+    if (concurrent) {
+        test_concurrent("STL", [] { return std_map(); }, threads_counts, read_percents);
+        test_concurrent("Separate chaining", [] { return boxed_map<hashmaps::sc_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Linear probing", [] { return boxed_map<hashmaps::lp_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Quadratic probing", [] { return boxed_map<hashmaps::qp_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Double hashing", [] { return boxed_map<hashmaps::dh_traits>(hasher, hasher2); },
+                        threads_counts, read_percents);
+        test_concurrent("Swiss table", [] { return boxed_map<hashmaps::sw_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Cuckoo hashing", [] { return boxed_map<hashmaps::ch_traits>(hasher, murmur_hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Hopscotch hashing", [] { return boxed_map<hashmaps::hs_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Concurrent separate chaining", [] { return boxed_map<hashmaps::csc_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Concurrent linear probing", [] { return boxed_map<hashmaps::clp_traits>(hasher); },
+                        threads_counts, read_percents);
+        test_concurrent("Sharded linear probing", [] {
+            return boxed_map<hashmaps::sharded_traits>(hasher, {.kind = hashmap_sharded_lp});
+        }, threads_counts, read_percents);
+        return 0;
+    }
+
+    unsigned threads = std::thread::hardware_concurrency();
+    test("STL", [] { return std_map(); });
+    test("Separate chaining", [] { return boxed_map<hashmaps::sc_traits>(hasher); });
+    test("Separate chaining (inline values)", [] { return inline_map<hashmaps::sc_traits>(hasher); });
+    test("Separate chaining (specialized)", [] { return sc_specialized_map(); });
+    test("Separate chaining (incremental resize)", [] {
+        return boxed_map<hashmaps::sc_traits>(hasher, {.incremental_resize = true});
+    });
+    test("Separate chaining (parallel resize and clear)", [threads] {
+        return boxed_map<hashmaps::sc_traits>(hasher, {.resize_threads = threads, .clear_threads = threads});
+    });
+    test("Separate chaining (arena buckets)", [] { return sc_arena_map(); });
+    test("Linear probing", [] { return boxed_map<hashmaps::lp_traits>(hasher); });
+    test("Linear probing (Robin Hood)", [] { return boxed_map<hashmaps::lp_traits>(hasher, {.robin_hood = true}); });
+    test("Linear probing (power of two)", [] {
+        return boxed_map<hashmaps::lp_traits>(hasher, {.power_of_two = true});
+    });
+    test("Linear probing (inline values)", [] { return inline_map<hashmaps::lp_traits>(hasher); });
+    test("Linear probing (specialized)", [] { return lp_specialized_map(); });
+    test("Linear probing (incremental resize)", [] {
+        return boxed_map<hashmaps::lp_traits>(hasher, {.incremental_resize = true});
+    });
+    test("Linear probing (parallel resize and clear)", [threads] {
+        return boxed_map<hashmaps::lp_traits>(hasher, {.resize_threads = threads, .clear_threads = threads});
+    });
+    test("Linear probing (huge pages)", [] {
+        return boxed_map<hashmaps::lp_traits>(hasher, {.allocator = &hashmap_huge_page_allocator});
+    });
+    test("Quadratic probing", [] { return boxed_map<hashmaps::qp_traits>(hasher); });
+    test("Quadratic probing (power of two)", [] {
+        return boxed_map<hashmaps::qp_traits>(hasher, {.power_of_two = true});
+    });
+    test("Quadratic probing (inline values)", [] { return inline_map<hashmaps::qp_traits>(hasher); });
+    test("Quadratic probing (specialized)", [] { return qp_specialized_map(); });
+    test("Quadratic probing (incremental resize)", [] {
+        return boxed_map<hashmaps::qp_traits>(hasher, {.incremental_resize = true});
+    });
+    test("Quadratic probing (parallel resize and clear)", [threads] {
+        return boxed_map<hashmaps::qp_traits>(hasher, {.resize_threads = threads, .clear_threads = threads});
+    });
+    test("Double hashing", [] { return boxed_map<hashmaps::dh_traits>(hasher, hasher2); });
+    test("Double hashing (power of two)", [] {
+        return boxed_map<hashmaps::dh_traits>(hasher, hasher2, {.power_of_two = true});
+    });
+    test("Double hashing (inline values)", [] { return inline_map<hashmaps::dh_traits>(hasher, hasher2); });
+    test("Double hashing (specialized)", [] { return dh_specialized_map(); });
+    test("Double hashing (incremental resize)", [] {
+        return boxed_map<hashmaps::dh_traits>(hasher, hasher2, {.incremental_resize = true});
+    });
+    test("Double hashing (parallel resize and clear)", [threads] {
+        return boxed_map<hashmaps::dh_traits>(hasher, hasher2, {.resize_threads = threads, .clear_threads = threads});
+    });
+    test("Swiss table", [] { return boxed_map<hashmaps::sw_traits>(hasher); });
+    test("Swiss table (huge pages)", [] {
+        return boxed_map<hashmaps::sw_traits>(hasher, {.allocator = &hashmap_huge_page_allocator});
+    });
+    test("Cuckoo hashing", [] { return boxed_map<hashmaps::ch_traits>(hasher, murmur_hasher); });
+    test("Hopscotch hashing", [] { return boxed_map<hashmaps::hs_traits>(hasher); });
+    test("Concurrent separate chaining", [] { return boxed_map<hashmaps::csc_traits>(hasher); });
+    test("Concurrent linear probing", [] { return boxed_map<hashmaps::clp_traits>(hasher); });
+    test("Sharded linear probing", [] { return boxed_map<hashmaps::sharded_traits>(hasher, {.kind = hashmap_sharded_lp}); });
+    test_snapshot("Linear probing (mmap snapshot)", inline_map<hashmaps::lp_traits>(hasher), [](const char *path) {
+        return hashmap_lp_open_mmap(path, hasher);
+    });
+    test_snapshot("Quadratic probing (mmap snapshot)", inline_map<hashmaps::qp_traits>(hasher), [](const char *path) {
+        return hashmap_qp_open_mmap(path, hasher);
+    });
+    test_snapshot("Double hashing (mmap snapshot)", inline_map<hashmaps::dh_traits>(hasher, hasher2),
+                  [](const char *path) { return hashmap_dh_open_mmap(path, hasher, hasher2); });
+
     return 0;
 }
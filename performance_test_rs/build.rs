@@ -12,6 +12,8 @@ fn main() {
         "linear_probing/hashmap_lp",
         "quadratic_probing/hashmap_qp",
         "double_hashing/hashmap_dh",
+        "hashmap_allocator",
+        "hashmap_parallel",
     ] {
         println!("cargo:rerun-if-changed=../implementations/{}.h", source);
         println!("cargo:rerun-if-changed=../implementations/{}.c", source);